@@ -0,0 +1,715 @@
+/* Runs a fixed corpus of workloads, each in a child process of its
+   own, and reports steps per second, allocations, peak RSS and output
+   size, then the steps and time of its reductions under each strategy.
+   Then compares the explicit-stack traversals with the recursive
+   versions they replaced, on the shallow terms a normal run is made
+   of: the δ-definitions and every step of a few short reductions. The
+   recursive versions are kept here only as the baseline. Last, it
+   measures the parser's throughput on large generated inputs.
+
+   The results go to standard output as one JSON document, to be kept
+   and diffed across builds; a readable summary goes to standard
+   error.                                                             */
+
+#define _DEFAULT_SOURCE /* clock_gettime, wait4 */
+
+#include "../include/expr.h"
+#include "../include/fvset.h"
+#include "../include/governor.h"
+#include "../include/lambda.h"
+#include "../include/parser.h"
+#include "../include/sink.h"
+#include "../include/symbol.h"
+#include "../include/types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_ROUNDS       16
+#define BENCH_PASSES       20
+#define MAX_TERMS          4096
+#define GEN_BYTES          (4 << 20)
+#define PRINT_NUMERAL      200000
+#define STRATEGY_STEPS     100000 /* limits for workloads a strategy may not finish */
+#define STRATEGY_SECONDS   10.0
+
+bool beta_reduce(cexpr *e, expr **out);
+bool delta_reduce(cexpr *e, expr **out);
+bool reduce_once(cexpr *e, expr **ne, cchar **rtype);
+expr *substitute_sym(expr *e, sym v, expr *val);
+void free_vars_rec(cexpr *e, VarSet *s);
+void vs_init(VarSet *s);
+void vs_add_sym(VarSet *s, sym x);
+void vs_rm_sym(VarSet *s, sym x);
+void vs_free(const VarSet *s);
+
+/* ---- Recursive baselines ------------------------------------------ */
+
+static expr *rec_substitute(expr *e, const sym v, expr *val) {
+    if (!fv_has(e->fv, v)) return e;
+    if (e->type == VAR_expr) return val;
+
+    if (e->type == ABS_expr) {
+        if (fv_has(val->fv, e->abs_sym)) {
+            const sym nv = sym_fresh(e->abs_sym);
+            expr *renamed_body = rec_substitute(e->abs_body, e->abs_sym, make_var_sym(nv));
+
+            return make_abs_sym(nv, rec_substitute(renamed_body, v, val));
+        }
+
+        return make_abs_sym(e->abs_sym, rec_substitute(e->abs_body, v, val));
+    }
+    expr *substituted_fn = rec_substitute(e->app_fn, v, val);
+    expr *substituted_arg = rec_substitute(e->app_arg, v, val);
+
+    return make_application(substituted_fn, substituted_arg);
+}
+
+static bool rec_reduce_once(cexpr *e, expr **ne, cchar **rtype) {
+    expr *tmp;
+    if (delta_reduce(e, &tmp)) {
+        *ne = tmp;
+        *rtype = "δ";
+        return true;
+    }
+    if (beta_reduce(e, &tmp)) {
+        *ne = tmp;
+        *rtype = "β";
+        return true;
+    }
+    if (e->type == APP_expr) {
+        if (rec_reduce_once(e->app_fn, &tmp, rtype)) {
+            *ne = make_application(tmp, e->app_arg);
+            return true;
+        }
+        if (rec_reduce_once(e->app_arg, &tmp, rtype)) {
+            *ne = make_application(e->app_fn, tmp);
+            return true;
+        }
+    }
+    if ((e->type == ABS_expr) && (rec_reduce_once(e->abs_body, &tmp, rtype))) {
+        *ne = make_abs_sym(e->abs_sym, tmp);
+        return true;
+    }
+
+    return false;
+}
+
+static void rec_free_vars(cexpr *e, VarSet *s) {
+    if (e->type == VAR_expr) vs_add_sym(s, e->var_sym);
+    else if (e->type == NUM_expr) return;
+    else if (e->type == ABS_expr) {
+        rec_free_vars(e->abs_body, s);
+        vs_rm_sym(s, e->abs_sym);
+    } else {
+        rec_free_vars(e->app_fn, s);
+        rec_free_vars(e->app_arg, s);
+    }
+}
+
+static expr *rec_copy(cexpr *e) {
+    switch (e->type) {
+        case VAR_expr: return make_var_sym(e->var_sym);
+        case ABS_expr: return make_abs_sym(e->abs_sym, rec_copy(e->abs_body));
+        case APP_expr: return make_application(rec_copy(e->app_fn), rec_copy(e->app_arg));
+        case NUM_expr: return make_num(e->num);
+    }
+
+    return NULL; // unreachable
+}
+
+static expr *rec_abstract(cexpr *e) {
+    if (is_church_numeral(e)) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long) count_applications(e));
+        return make_variable(buf);
+    }
+    if (e->type == ABS_expr) return make_abs_sym(e->abs_sym, rec_abstract(e->abs_body));
+    if (e->type == APP_expr) return make_application(rec_abstract(e->app_fn), rec_abstract(e->app_arg));
+
+    return make_var_sym(e->var_sym);
+}
+
+typedef struct rec_scope {
+    sym            name;
+    sym            bound;
+    const struct rec_scope *up;
+} rec_scope;
+
+static const rec_scope *rec_sc;
+
+static expr *rec_parse_expr(Parser *p);
+
+static expr *rec_parse_abs(Parser *p) {
+    p->i += 2;
+    const sym v = parse_varname(p);
+    skip_whitespace(p);
+    consume(p); // '.'
+    const rec_scope sc = {v, sym_alias(v), rec_sc};
+    rec_sc = &sc;
+    cexpr *body = rec_parse_expr(p);
+    rec_sc = sc.up;
+
+    return make_abs_sym(sc.bound, body);
+}
+
+static expr *rec_parse_atom(Parser *p) {
+    skip_whitespace(p);
+    if (is_lambda(p)) return rec_parse_abs(p);
+    const char c = peek(p);
+    if (c == '(') {
+        consume(p);
+        expr *e = rec_parse_expr(p);
+        skip_whitespace(p);
+        consume(p); // ')'
+        return e;
+    }
+    uint64 n;
+    if (c >= '0' && c <= '9') return parse_number(p, &n) ? church(n) : NULL;
+    const sym v = parse_varname(p);
+    for (const rec_scope *sc = rec_sc; sc; sc = sc->up) if (sc->name == v) return make_var_sym(sc->bound);
+
+    return make_var_sym(v);
+}
+
+static expr *rec_parse_expr(Parser *p) {
+    skip_whitespace(p);
+    if (is_lambda(p)) return rec_parse_abs(p);
+    expr *e = rec_parse_atom(p);
+    skip_whitespace(p);
+    char c = peek(p);
+    while (c && c != ')' && c != '.') {
+        e = make_application(e, rec_parse_atom(p));
+        skip_whitespace(p);
+        c = peek(p);
+    }
+
+    return e;
+}
+
+/* ---- Harness ------------------------------------------------------- */
+
+static expr  *terms[MAX_TERMS];
+static size_t n_terms;
+static size_t sink_count; /* keeps results observable */
+static char   printed[MAX_TERMS][512];
+
+/* What a β-step on each term would substitute: the body and binder of
+   the abstraction at its head, or else one of its free variables. */
+static expr  *sub_body[MAX_TERMS];
+static sym    sub_var[MAX_TERMS];
+static expr  *sub_val;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief              Collect every node the benchmarks have allocated,
+ *                     keeping the corpus.
+ */
+static void reclaim(void) {
+    static expr *roots[N_DEFS + 2 * MAX_TERMS + 1];
+    memcpy(roots, def_vals, sizeof def_vals);
+    memcpy(roots + N_DEFS, terms, sizeof *terms * n_terms);
+    memcpy(roots + N_DEFS + n_terms, sub_body, sizeof *sub_body * n_terms);
+    roots[N_DEFS + 2 * n_terms] = sub_val;
+    expr_collect(roots, N_DEFS + 2 * n_terms + 1);
+    memcpy(def_vals, roots, sizeof def_vals);
+    memcpy(terms, roots + N_DEFS, sizeof *terms * n_terms);
+    memcpy(sub_body, roots + N_DEFS + n_terms, sizeof *sub_body * n_terms);
+    sub_val = roots[N_DEFS + 2 * n_terms];
+}
+
+/**
+ * @brief              Time BENCH_PASSES passes over the corpus.
+ * @param  op          routine applied to the term at each index
+ * @return             nanoseconds per term
+ */
+static double run(void (*op)(size_t)) {
+    const double start = now();
+    for (int pass = 0; pass < BENCH_PASSES; pass++)
+        for (size_t i = 0; i < n_terms; i++) op(i);
+    const double elapsed = now() - start;
+    reclaim();
+
+    return elapsed * 1e9 / (double) (BENCH_PASSES * n_terms);
+}
+
+static void op_sub_rec(const size_t i)  { sink_count += rec_substitute(sub_body[i], sub_var[i], sub_val) != sub_val; }
+static void op_sub_iter(const size_t i) { sink_count += substitute_sym(sub_body[i], sub_var[i], sub_val) != sub_val; }
+
+static void op_red_rec(const size_t i) {
+    expr *ne;
+    cchar *rtype;
+    sink_count += rec_reduce_once(terms[i], &ne, &rtype);
+}
+
+static void op_red_iter(const size_t i) {
+    expr *ne;
+    cchar *rtype;
+    sink_count += reduce_once(terms[i], &ne, &rtype);
+}
+
+static void op_fv_rec(const size_t i) {
+    VarSet s;
+    vs_init(&s);
+    rec_free_vars(terms[i], &s);
+    sink_count += (size_t) s.c;
+    vs_free(&s);
+}
+
+static void op_fv_iter(const size_t i) {
+    VarSet s;
+    vs_init(&s);
+    free_vars_rec(terms[i], &s);
+    sink_count += (size_t) s.c;
+    vs_free(&s);
+}
+
+static void op_copy_rec(const size_t i)  { sink_count += rec_copy(terms[i]) != terms[i]; }
+static void op_copy_iter(const size_t i) { sink_count += copy_expr(terms[i]) != terms[i]; }
+static void op_abs_rec(const size_t i)   { sink_count += rec_abstract(terms[i]) != terms[i]; }
+static void op_abs_iter(const size_t i)  { sink_count += abstract_numerals(terms[i]) != terms[i]; }
+
+static void op_parse_rec(const size_t i) {
+    Parser p = {printed[i], 0, strlen(printed[i])};
+    sink_count += rec_parse_expr(&p) != NULL;
+}
+
+static void op_parse_iter(const size_t i) {
+    Parser p = {printed[i], 0, strlen(printed[i])};
+    sink_count += parse_expr(&p) != NULL;
+}
+
+/* ---- JSON output ------------------------------------------------ */
+
+static bool json_first; /* no item in the current array yet */
+
+/**
+ * @brief              Open a named array of the result document.
+ */
+static void json_array(cchar *name, const bool first) {
+    printf("%s  \"%s\": [\n", first ? "{\n" : ",\n", name);
+    json_first = true;
+}
+
+/**
+ * @brief              Separate the next item of an array from the last.
+ */
+static void json_next(void) {
+    if (!json_first) printf(",\n");
+    json_first = false;
+}
+
+static void json_close(void) {
+    printf("\n  ]");
+}
+
+/**
+ * @brief              Print a JSON string, escaped.
+ */
+static void json_string(FILE *f, cchar *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else if ((uchar) *s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/**
+ * @brief              Alternate the two versions, swapping which goes
+ *                     first each round, and keep the best pass of each,
+ *                     so that drift in the machine or in the heap does
+ *                     not favour either.
+ */
+static void report(cchar *name, void (*rec)(size_t), void (*iter)(size_t)) {
+    void (*op[2])(size_t) = {rec, iter};
+    double best[2] = {0, 0};
+    for (int k = 0; k < BENCH_ROUNDS; k++) {
+        for (int j = 0; j < 2; j++) {
+            const int which = (j + k) % 2;
+            const double t = run(op[which]);
+            if (!k || t < best[which]) best[which] = t;
+        }
+    }
+    fprintf(stderr, "%-20s %10.1f %10.1f %8.2fx\n", name, best[0], best[1], best[1] / best[0]);
+    json_next();
+    printf("    {\"routine\": \"%s\", \"recursive_ns\": %.1f, \"iterative_ns\": %.1f}",
+           name, best[0], best[1]);
+}
+
+/* ---- Parse throughput -------------------------------------------- */
+
+/**
+ * @brief              Generate a Church numeral spine, λf.λx.f (f (... x)),
+ *                     of about GEN_BYTES: one-letter tokens, deep nesting.
+ * @param  len         set to the length of the text
+ * @return             the text, to free
+ */
+static char *gen_spine(size_t *len) {
+    const size_t depth = GEN_BYTES / 4;
+    char *s = malloc(4 * depth + 16);
+    size_t n = 0;
+    memcpy(s, "λf.λx.", 8);
+    n += 8;
+    for (size_t i = 0; i < depth; i++, n += 3) memcpy(s + n, "f (", 3);
+    s[n++] = 'x';
+    memset(s + n, ')', depth);
+    n += depth;
+    s[n] = '\0';
+    *len = n;
+
+    return s;
+}
+
+/**
+ * @brief              Generate a long application of about GEN_BYTES
+ *                     whose arguments mix long identifiers, abstractions,
+ *                     numerals and runs of whitespace.
+ * @param  len         set to the length of the text
+ * @return             the text, to free
+ */
+static char *gen_wide(size_t *len) {
+    char *s = malloc(GEN_BYTES + 256);
+    size_t n = (size_t) sprintf(s, "head");
+    for (uint32 k = 0; n < GEN_BYTES; k = k * 1103515245u + 12345u) {
+        const uint32 a = (k >> 8) % 64, b = (k >> 16) % 64;
+        cchar *pad = (k >> 4) % 4 ? " " : "\n\t    ";
+        n += (size_t) sprintf(s + n, "%s(λvariable_%u.variable_%u constant_%u)%s%u",
+                              pad, a, a, b, pad, (k >> 24) % 100);
+    }
+    *len = n;
+
+    return s;
+}
+
+/**
+ * @brief              Time parse on a generated input and print its
+ *                     throughput.
+ * @param  name        the name of the input
+ * @param  gen         its generator
+ */
+static void report_parse(cchar *name, char *(*gen)(size_t *)) {
+    size_t len;
+    char *src = gen(&len);
+    double best = 0;
+    for (int k = 0; k < BENCH_ROUNDS; k++) {
+        Parser p = {src, 0, len};
+        const double start = now();
+        sink_count += parse(&p) != NULL;
+        const double t = now() - start;
+        if (!k || t < best) best = t;
+        reclaim();
+    }
+    fprintf(stderr, "%-20s %10.1f MB/s %7.1f ms\n", name, (double) len / best / 1e6, best * 1e3);
+    json_next();
+    printf("    {\"input\": \"%s\", \"bytes\": %zu, \"mb_per_s\": %.1f, \"ms\": %.2f}",
+           name, len, (double) len / best / 1e6, best * 1e3);
+    free(src);
+}
+
+/* ---- Workloads --------------------------------------------------- */
+
+/**
+ * @brief              What one workload measured, passed from the child
+ *                     that ran it to the parent.
+ */
+typedef struct bench_result {
+    size_t         steps;
+    double         seconds;
+    size_t         output_bytes;
+    stop_reason    stop;
+    bool           reduced;  /* false for workloads that do not reduce */
+    expr_heap_stats heap;    /* counters added by the workload */
+} bench_result;
+
+/**
+ * @brief              A workload: an input and how to run it.
+ */
+typedef struct workload {
+    cchar         *name;
+    cchar         *input;
+    size_t         max_steps; /* 0 for no limit */
+    void         (*run)(const struct workload *w, bench_result *r);
+} workload;
+
+static strategy bench_strategy; /* for run_reduce */
+
+/**
+ * @brief              Normalize the input with bench_strategy, printing
+ *                     only the step count and the final term, as a normal
+ *                     run with --final-only does. Other strategies than
+ *                     the normal one run under STRATEGY_STEPS and
+ *                     STRATEGY_SECONDS, as some diverge where it does not.
+ */
+static void run_reduce(const workload *w, bench_result *r) {
+    Parser p = {w->input, 0, strlen(w->input)};
+    expr *e = parse(&p);
+    sink out;
+    sink_init_mem(&out);
+    trace_config(TRACE_FINAL, 0);
+    trace_output(&out);
+    const bool capped = bench_strategy != STRATEGY_NORMAL;
+    governor_start(&(limits){w->max_steps || !capped ? w->max_steps : STRATEGY_STEPS,
+                             capped ? STRATEGY_SECONDS : 0, 0});
+
+    const double start = now();
+    r->stop = normalize_strategy(bench_strategy, e);
+    r->seconds = now() - start;
+    r->reduced = true;
+
+    trace_output(NULL);
+    r->output_bytes = out.bytes;
+    sink_putc(&out, '\0');
+    if (sscanf(out.buf.data, "Steps: %zu", &r->steps) != 1) r->steps = 0;
+    sink_destroy(&out);
+}
+
+/**
+ * @brief              Parse a generated numeral spine of GEN_BYTES.
+ */
+static void run_parse(const workload *w, bench_result *r) {
+    (void) w;
+    size_t len;
+    char *src = gen_spine(&len);
+    Parser p = {src, 0, len};
+
+    const double start = now();
+    sink_count += parse(&p) != NULL;
+    r->seconds = now() - start;
+
+    free(src);
+}
+
+static void discard(void *ctx, const char *data, const size_t len) {
+    (void) ctx, (void) data, (void) len;
+}
+
+/**
+ * @brief              Print the expanded numeral PRINT_NUMERAL to a sink
+ *                     that throws the text away.
+ */
+static void run_print(const workload *w, bench_result *r) {
+    (void) w;
+    expr *e = num_expand(make_num(PRINT_NUMERAL));
+    sink out;
+    sink_init_fn(&out, discard, NULL);
+
+    const double start = now();
+    expr_write(&out, e);
+    sink_flush(&out);
+    r->seconds = now() - start;
+
+    r->output_bytes = out.bytes;
+    sink_destroy(&out);
+}
+
+#define FACTORIAL(n) "(λn.n (λp.pair (inc (p true)) (* (inc (p true)) (p false))) (pair 0 1) false) " #n
+#define FIBONACCI(n) "(λn.n (λp.pair (p false) (+ (p true) (p false))) (pair 0 1) true) " #n
+
+static const workload workloads[] = {
+    {"mul 10 10",        "* 10 10",                     0,     run_reduce},
+    {"mul 20 20",        "* 20 20",                     0,     run_reduce},
+    {"mul 40 40",        "* 40 40",                     0,     run_reduce},
+    {"factorial 4",      FACTORIAL(4),                  0,     run_reduce},
+    {"factorial 5",      FACTORIAL(5),                  0,     run_reduce},
+    {"fibonacci 10",     FIBONACCI(10),                 0,     run_reduce},
+    {"ackermann 2 3",    "(λm.m (λf.λn.n f (f 1)) inc) 2 3", 0, run_reduce},
+    {"ackermann 3 2",    "(λm.m (λf.λn.n f (f 1)) inc) 3 2", 0, run_reduce},
+    {"exponent 2 2 2",   "2 2 2",                       0,     run_reduce},
+    {"deep numeral",     "λg.g (+ 1000 1000)",          0,     run_reduce},
+    {"omega",            "(λx.x x) (λx.x x)",           20000, run_reduce},
+    {"growing omega",    "(λx.x x x) (λx.x x x)",       300,   run_reduce},
+    {"parse only",       "numeral spine",               0,     run_parse},
+    {"print only",       "numeral 200000",              0,     run_print},
+};
+
+/**
+ * @brief              Run a workload in a child process, so that its
+ *                     peak RSS is its own and its heap does not carry
+ *                     over to the next.
+ * @param  w           the workload
+ * @param  r           set to what it measured
+ * @param  ru          set to the resource usage of the child
+ * @return             false if the child failed
+ */
+static bool spawn(const workload *w, bench_result *r, struct rusage *ru) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fd[0]);
+        bench_result r = {0};
+        const expr_heap_stats before = expr_heap_get_stats();
+        w->run(w, &r);
+        const expr_heap_stats after = expr_heap_get_stats();
+        r.heap.nodes_allocated = after.nodes_allocated - before.nodes_allocated;
+        r.heap.bytes_allocated = after.bytes_allocated - before.bytes_allocated;
+        r.heap.collections = after.collections - before.collections;
+        _exit(write(fd[1], &r, sizeof r) == sizeof r ? 0 : 1);
+    }
+
+    close(fd[1]);
+    const bool ok = read(fd[0], r, sizeof *r) == sizeof *r;
+    close(fd[0]);
+    int status;
+    if (wait4(pid, &status, 0, ru) < 0) {
+        perror("wait4");
+        exit(1);
+    }
+
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * @brief              Run a workload and print all its results.
+ * @param  w           the workload
+ */
+static void run_workload(const workload *w) {
+    bench_result r;
+    struct rusage ru;
+    if (!spawn(w, &r, &ru)) {
+        fprintf(stderr, "%-20s failed\n", w->name);
+        return;
+    }
+
+    cchar *stop = r.reduced ? governor_message(r.stop) : NULL;
+    const double per_sec = r.seconds > 0 ? (double) r.steps / r.seconds : 0;
+    const double ns_per_step = r.steps ? r.seconds * 1e9 / (double) r.steps : 0;
+    fprintf(stderr, "%-20s %8zu %9.2f %12.0f %10zu %9ld %s\n", w->name, r.steps, r.seconds * 1e3,
+            per_sec, r.heap.nodes_allocated, ru.ru_maxrss, stop ? stop : "-");
+
+    json_next();
+    printf("    {\"name\": ");
+    json_string(stdout, w->name);
+    printf(", \"input\": ");
+    json_string(stdout, w->input);
+    printf(", \"max_steps\": %zu, \"steps\": %zu, \"seconds\": %.6f, \"steps_per_sec\": %.1f,"
+           " \"ns_per_step\": %.1f, \"nodes_allocated\": %zu, \"bytes_allocated\": %zu,"
+           " \"collections\": %zu, \"peak_rss_kb\": %ld, \"output_bytes\": %zu, \"stop\": ",
+           w->max_steps, r.steps, r.seconds, per_sec, ns_per_step, r.heap.nodes_allocated,
+           r.heap.bytes_allocated, r.heap.collections, ru.ru_maxrss, r.output_bytes);
+    if (stop) json_string(stdout, stop);
+    else printf("null");
+    printf("}");
+}
+
+/**
+ * @brief              Run every reduction workload under every strategy
+ *                     and print the steps and time of each.
+ */
+static void run_strategies(void) {
+    fprintf(stderr, "\n%-20s", "steps, ms");
+    for (int k = 0; k < N_STRATEGIES; k++) fprintf(stderr, " %18s", strategy_name((strategy) k));
+    fprintf(stderr, "\n");
+
+    json_array("strategies", false);
+    for (size_t i = 0; i < sizeof workloads / sizeof *workloads; i++) {
+        const workload *w = &workloads[i];
+        if (w->run != run_reduce) continue;
+        fprintf(stderr, "%-20s", w->name);
+        for (int k = 0; k < N_STRATEGIES; k++) {
+            bench_result r;
+            struct rusage ru;
+            bench_strategy = (strategy) k;
+            if (!spawn(w, &r, &ru)) {
+                fprintf(stderr, " %18s", "failed");
+                continue;
+            }
+            fprintf(stderr, " %8zu%c%9.2f", r.steps, r.stop == STOP_NONE ? ' ' : '+', r.seconds * 1e3);
+
+            json_next();
+            printf("    {\"name\": ");
+            json_string(stdout, w->name);
+            printf(", \"strategy\": \"%s\", \"steps\": %zu, \"seconds\": %.6f, \"stop\": \"%s\"}",
+                   strategy_name((strategy) k), r.steps, r.seconds, governor_message(r.stop));
+        }
+        fprintf(stderr, "\n");
+    }
+    bench_strategy = STRATEGY_NORMAL;
+    json_close();
+}
+
+int main(void) {
+    for (int i = 0; i < N_DEFS; i++) {
+        Parser dp = {def_src[i], 0, strlen(def_src[i])};
+        def_vals[i] = parse(&dp);
+    }
+    expr_heap_seal();
+
+    // The workloads run before the corpus is built, so their children
+    // start from no more than the definitions
+    fprintf(stderr, "%-20s %8s %9s %12s %10s %9s %s\n", "workload", "steps", "ms", "steps/s", "nodes",
+            "rss KB", "stop");
+    json_array("workloads", true);
+    for (size_t i = 0; i < sizeof workloads / sizeof *workloads; i++) run_workload(&workloads[i]);
+    json_close();
+    run_strategies();
+
+    // The corpus: the definitions and every step of a few reductions
+    cchar *inputs[] = {"* 4 5", "- 6 2", "<= 3 4", "and true (not false)", "pair 1 2 (λa.λb.b)"};
+    for (size_t k = 0; k < sizeof inputs / sizeof *inputs; k++) {
+        Parser p = {inputs[k], 0, strlen(inputs[k])};
+        expr *e = parse(&p);
+        expr *next;
+        cchar *rtype;
+        while (n_terms < MAX_TERMS) {
+            terms[n_terms++] = e;
+            if (!reduce_once(e, &next, &rtype)) break;
+            e = next;
+        }
+    }
+    for (int i = 0; i < N_DEFS && n_terms < MAX_TERMS; i++) terms[n_terms++] = def_vals[i];
+    for (size_t i = 0; i < n_terms; i++) expr_to_buffer(terms[i], printed[i], sizeof printed[i]);
+    sub_val = make_abstraction("y", make_variable("y"));
+    for (size_t i = 0; i < n_terms; i++) {
+        expr *head = terms[i];
+        while (head->type == APP_expr) head = head->app_fn;
+        sub_body[i] = head->type == ABS_expr ? head->abs_body : terms[i];
+        sub_var[i] = head->type == ABS_expr ? head->abs_sym
+                   : terms[i]->fv->n ? terms[i]->fv->v[0] : SYM_NONE;
+    }
+
+    fprintf(stderr, "\n%zu shallow terms, ns per term\n", n_terms);
+    fprintf(stderr, "%-20s %10s %10s %9s\n", "routine", "recursive", "iterative", "ratio");
+    json_array("traversals", false);
+    report("substitute", op_sub_rec, op_sub_iter);
+    report("reduce_once", op_red_rec, op_red_iter);
+    report("free_vars_rec", op_fv_rec, op_fv_iter);
+    report("copy_expr", op_copy_rec, op_copy_iter);
+    report("abstract_numerals", op_abs_rec, op_abs_iter);
+    report("parse", op_parse_rec, op_parse_iter);
+
+    json_close();
+
+    fprintf(stderr, "\nparse throughput on %d MB inputs\n", GEN_BYTES >> 20);
+    json_array("parse_throughput", false);
+    report_parse("numeral spine", gen_spine);
+    report_parse("wide application", gen_wide);
+    json_close();
+    printf("\n}\n");
+
+    expr_heap_destroy();
+    sym_table_destroy();
+
+    return sink_count == 0; // never true, but the results are used
+}
@@ -0,0 +1,84 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "macros.h"
+#include "types.h"
+
+#include <stddef.h>
+
+#define ARENA_ALIGN(n) (((n) + 15) & ~(size_t) 15)
+
+/**
+ * @brief              A chunk of arena memory. Chunks are linked in
+ *                     allocation order so that a scan pointer can walk
+ *                     them front to back.
+ */
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t         used;
+    size_t         cap;
+    ALIGNED(16) byte data[];
+} arena_chunk;
+
+/**
+ * @brief              Bump allocator over a list of large chunks.
+ */
+typedef struct arena {
+    arena_chunk   *first;
+    arena_chunk   *last;
+    size_t         chunk_size;
+    size_t         bytes;    /* bytes handed out since init/reset */
+    size_t         reserved; /* bytes obtained from malloc         */
+} arena;
+
+/**
+ * @brief              Initialize an arena.
+ * @param  a           the arena to initialize
+ * @param  chunk_size  the minimum size of each chunk
+ */
+void arena_init(arena *a, size_t chunk_size);
+
+/**
+ * @brief              Allocate memory from an arena.
+ * @param  a           the arena to allocate from
+ * @param  size        the number of bytes to allocate
+ * @return             a pointer aligned to 16 bytes, never NULL
+ */
+HOT void *arena_alloc(arena *a, size_t size);
+
+/**
+ * @brief              Release every chunk of an arena.
+ * @param  a           the arena to destroy
+ */
+void arena_destroy(arena *a);
+
+/**
+ * @brief              Move every chunk of src to the end of dst. src is
+ *                     left empty.
+ * @param  dst         the arena receiving the chunks
+ * @param  src         the arena giving up its chunks
+ */
+void arena_append(arena *dst, arena *src);
+
+/**
+ * @brief              Stop counting an arena's chunks as this thread's,
+ *                     before handing them to another thread.
+ * @param  a           the arena to give away
+ */
+void arena_disown(arena *a);
+
+/**
+ * @brief              Count an arena's chunks as this thread's, after
+ *                     taking them from another thread.
+ * @param  a           the arena taken
+ */
+void arena_own(arena *a);
+
+/**
+ * @brief              Get the bytes the arenas this thread grew hold
+ *                     from malloc.
+ * @return             the byte count
+ */
+size_t arena_reserved_total(void);
+
+#endif /* ARENA_H */
@@ -0,0 +1,32 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "governor.h"
+#include "lambda.h"
+#include "types.h"
+
+#include <stddef.h>
+
+/**
+ * @brief              Normalize every expression of a file, one per line,
+ *                     on a pool of threads. Each line's output is what a
+ *                     run on that expression alone prints, after a
+ *                     "λ-expr> " line echoing it, and the outputs are
+ *                     written in input order as they become ready. Blank
+ *                     lines are skipped, and a line that does not parse
+ *                     gets a message in place of its output. The
+ *                     δ-definitions must be parsed and sealed already.
+ *                     The lines see the normal-form cache as it was
+ *                     before the batch; what they add to it shows once
+ *                     every line is done.
+ * @param  path        the file, or "-" for standard input
+ * @param  eng         the engine
+ * @param  lim         the limits, applied to each expression on its own
+ * @param  threads     the number of worker threads
+ * @return             0, or for the first line that failed, 1 if it
+ *                     does not parse or the stop reason of the limit
+ *                     that stopped it; 1 if the file cannot be read
+ */
+int batch_run(cchar *path, engine eng, const limits *lim, size_t threads);
+
+#endif /* BATCH_H */
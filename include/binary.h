@@ -0,0 +1,54 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include "macros.h"
+#include "strbuf.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Binary term images. A term is stored as a symbol table and its nodes
+   in post-order, one varint word each, so a reader builds it in a
+   single pass over the words with no parsing and no recursion. Images
+   are little-endian and carry a version; a loaded image maps back to
+   the term it was made from, names and all, so it prints exactly as
+   the original does.                                                 */
+
+#define BIN_VERSION        1
+
+/**
+ * @brief              Append the image of a term to a buffer.
+ * @param  e           the term
+ * @param  out         the buffer
+ * @return             false if the term holds a numeral too large for
+ *                     the format (2^62 or more)
+ */
+bool bin_encode(cexpr *e, strbuf *out);
+
+/**
+ * @brief              Build the term an image stands for.
+ * @param  p           the image
+ * @param  len         its length in bytes
+ * @return             the term, or NULL if the bytes are not an image
+ *                     of this version
+ */
+expr *bin_decode(const byte *p, size_t len);
+
+/**
+ * @brief              Write the image of a term to a file, replacing it.
+ * @param  e           the term
+ * @param  path        the file
+ * @return             false with errno set if it cannot be written
+ */
+bool bin_save(cexpr *e, cchar *path);
+
+/**
+ * @brief              Map an image file and build its term.
+ * @param  path        the file
+ * @return             the term, or NULL if the file cannot be read or
+ *                     is not an image
+ */
+expr *bin_load(cchar *path);
+
+#endif /* BINARY_H */
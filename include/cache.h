@@ -0,0 +1,124 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "macros.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* The normal-form cache maps closed terms to their normal forms. A
+   term's key is its De Bruijn form, so α-equivalent terms share an
+   entry. Entries are found by a 64-bit hash made in O(1) from the
+   shape, size and depth the term's root node carries and the names of
+   its free variables; the key is only encoded, and compared byte for
+   byte, once an entry with that hash turns up. Normal forms are kept
+   in the same form with the names of their binders, and rebuilt as
+   expressions on a hit. The entries can be loaded from and appended
+   to a file that any number of processes share: it is mapped into
+   memory, and appends are made under an exclusive lock. The cache
+   holds at most 64 MiB, file included; once full, new normal forms
+   are not recorded.                                                  */
+
+/**
+ * @brief              Counters of the normal-form cache.
+ */
+typedef struct nf_cache_stats {
+    size_t         hits;     /* lookups that found a normal form */
+    size_t         misses;   /* lookups that did not             */
+    size_t         entries;  /* normal forms held                */
+    size_t         bytes;    /* held by the table, the entries and
+                                the file mapping                 */
+} nf_cache_stats;
+
+/**
+ * @brief              The key of a term: its encoding in De Bruijn form,
+ *                     equal for α-equivalent terms, and a hash of it.
+ *                     The term must stay alive until it is encoded.
+ */
+typedef struct nf_key {
+    uint64         hash;
+    cexpr         *term;
+    char          *data;     /* owned, freed by nf_key_free; NULL until encoded */
+    size_t         len;
+} nf_key;
+
+/**
+ * @brief              Turn the cache on or off. It is off until turned on.
+ * @param  on          true to enable
+ */
+void nf_cache_enable(bool on);
+
+/**
+ * @brief              Check whether the cache is on.
+ * @return             true if enabled
+ */
+PURE bool nf_cache_enabled(void);
+
+/**
+ * @brief              Map a cache file and load its entries, creating
+ *                     the file if it does not exist. Entries added from
+ *                     now on are appended to it by nf_cache_close.
+ * @param  path        the file
+ * @return             false if the file cannot be opened or is not a
+ *                     cache file of this version
+ */
+bool nf_cache_open(cchar *path);
+
+/**
+ * @brief              Append the new entries to the cache file, if one is
+ *                     open, then drop every entry.
+ */
+void nf_cache_close(void);
+
+/**
+ * @brief              Hide the entries added from now on from lookups
+ *                     until the cache is thawed, so that concurrent
+ *                     reductions see the same cache whatever their order.
+ * @param  frozen      true to freeze, false to thaw
+ */
+void nf_cache_freeze(bool frozen);
+
+/**
+ * @brief              Get the key of a term, in O(1). It is not encoded
+ *                     yet.
+ * @param  e           the term
+ * @return             the key, to be freed with nf_key_free
+ */
+nf_key nf_cache_key(cexpr *e);
+
+/**
+ * @brief              Encode a key, if it is not already.
+ * @param  key         the key
+ */
+void nf_key_encode(nf_key *key);
+
+/**
+ * @brief              Free the encoding held by a key.
+ * @param  key         the key
+ */
+void nf_key_free(nf_key *key);
+
+/**
+ * @brief              Look up the normal form of a term. The key is
+ *                     encoded only if an entry has its hash.
+ * @param  key         the key of the term
+ * @return             a fresh copy of the normal form, or NULL on a miss
+ */
+expr *nf_cache_get(nf_key *key);
+
+/**
+ * @brief              Record the normal form of a term, encoding its key.
+ *                     A key already present keeps its normal form.
+ * @param  key         the key of the term
+ * @param  nf          its normal form, closed
+ */
+void nf_cache_put(nf_key *key, cexpr *nf);
+
+/**
+ * @brief              Get the counters.
+ * @return             a snapshot of the counters
+ */
+nf_cache_stats nf_cache_get_stats(void);
+
+#endif /* CACHE_H */
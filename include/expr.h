@@ -2,9 +2,57 @@
 #define EXPR_H
 
 #include "macros.h"
+#include "sink.h"
 #include "types.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief              Node heap counters.
+ */
+typedef struct expr_heap_stats {
+    size_t         nodes_allocated; /* nodes handed out since start      */
+    size_t         bytes_allocated; /* node and name bytes handed out    */
+    size_t         nodes_live;      /* nodes that survived the last GC   */
+    size_t         bytes_reserved;  /* bytes currently held from malloc  */
+    size_t         collections;
+    size_t         nodes_freed;     /* nodes reclaimed by collections    */
+    size_t         nodes_peak;      /* most nodes the nursery held       */
+    size_t         nodes_unique;    /* live hash-consed nodes            */
+    size_t         hashcons_hits;   /* constructor calls that shared     */
+} expr_heap_stats;
+
+/**
+ * @brief              Make a variable from an interned symbol.
+ * @param  s           the symbol
+ * @return             the variable
+ */
+HOT expr *make_var_sym(sym s);
+
+/**
+ * @brief              Make an abstraction from an interned symbol.
+ * @param  s           the parameter symbol
+ * @param  b           the body
+ * @return             the abstraction
+ */
+HOT expr *make_abs_sym(sym s, const expr *b);
+
+/**
+ * @brief              Make a Church numeral node. It stores n directly
+ *                     and stands for λf.λx.f (... (f x)) with n
+ *                     applications, which num_expand builds on demand.
+ * @param  n           the numeral
+ * @return             the numeral node
+ */
+HOT expr *make_num(uint64 n);
+
+/**
+ * @brief              Build the abstraction a numeral node stands for.
+ * @param  e           the numeral node
+ * @return             λf.λx.f (... (f x))
+ */
+expr *num_expand(const expr *e);
 
 expr *make_variable(const char *n);
 
@@ -14,17 +62,117 @@ expr *make_application(expr *f, expr *a);
 
 void free_expr(expr *e);
 
+/**
+ * @brief              Compact the node nursery, keeping only the nodes
+ *                     reachable from roots. Every other nursery node is
+ *                     released; the root slots are updated in place.
+ * @param  roots       the root slots
+ * @param  n           the number of roots
+ */
+void expr_collect(expr **roots, size_t n);
+
+/**
+ * @brief              Run expr_collect once the nursery has grown past
+ *                     twice the size that survived the last collection.
+ * @param  roots       the root slots
+ * @param  n           the number of roots
+ * @return             true if a collection ran
+ */
+bool expr_collect_maybe(expr **roots, size_t n);
+
+/**
+ * @brief              Make every node allocated so far permanent. Sealed
+ *                     nodes are never moved or released by expr_collect,
+ *                     and every thread may read them. Seal before other
+ *                     threads start using the heap.
+ */
+void expr_heap_seal(void);
+
+/**
+ * @brief              Release the nodes and caches of the calling thread,
+ *                     keeping the sealed nodes.
+ */
+void expr_heap_release(void);
+
+/**
+ * @brief              Release every node, sealed or not.
+ */
+void expr_heap_destroy(void);
+
+/**
+ * @brief              Get the generation of the calling thread's nursery,
+ *                     for threads that build nodes on its behalf.
+ * @return             the generation
+ */
+uint32 expr_heap_generation(void);
+
+/**
+ * @brief              Build nodes for another thread's heap until
+ *                     expr_heap_unlend: they get that heap's generation
+ *                     and a nursery of their own. Hash-consing must be
+ *                     off.
+ * @param  gen         the generation of the borrowing heap
+ */
+void expr_heap_lend(uint32 gen);
+
+/**
+ * @brief              Stop lending: hand the nodes built since
+ *                     expr_heap_lend over to expr_heap_adopt and go back
+ *                     to the calling thread's own nursery. The lending
+ *                     thread must keep its free-variable sets until the
+ *                     nodes are dead.
+ */
+void expr_heap_unlend(void);
+
+/**
+ * @brief              Append every node handed over by expr_heap_unlend
+ *                     to the calling thread's nursery, whose generation
+ *                     they were built with.
+ */
+void expr_heap_adopt(void);
+
+/**
+ * @brief              Turn hash-consing on or off. While on, constructors
+ *                     return an existing node whenever one with the same
+ *                     structure is live, so terms become maximally shared
+ *                     DAGs, copy_expr is O(1), and two terms are equal iff
+ *                     they are the same pointer. Nodes built while it was
+ *                     off are not shared.
+ * @param  on          true to enable
+ */
+void expr_hashcons(bool on);
+
+/**
+ * @brief              Check whether hash-consing is on.
+ * @return             true if enabled
+ */
+PURE bool expr_hashcons_enabled(void);
+
+/**
+ * @brief              Get the node heap counters.
+ * @return             a snapshot of the counters
+ */
+expr_heap_stats expr_heap_get_stats(void);
+
 PURE expr *copy_expr(expr *e);
 
-expr *church(int n);
+expr *church(uint64 n);
+
+/**
+ * @brief              Print an expression to a sink in one iterative
+ *                     pass, however large or deeply nested it is.
+ * @param  out         the sink
+ * @param  e           the expression
+ */
+HOT void expr_write(sink *out, const expr *e);
 
-HOT void expr_to_buffer_rec(const expr *e, char *buf, size_t *pos, size_t cap);
+void expr_to_buffer_rec(const expr *e, char *buf, size_t *pos, size_t cap);
 
 void expr_to_buffer(const expr *e, char *buf, size_t cap);
 
 PURE bool is_church_numeral(const expr *e);
 
-PURE int count_applications(const expr *e);
+PURE uint64 count_applications(const expr *e);
 
 expr *abstract_numerals(const expr *e);
 
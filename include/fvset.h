@@ -0,0 +1,151 @@
+#ifndef FVSET_H
+#define FVSET_H
+
+#include "macros.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Free-variable sets are sorted symbol arrays, interned so that equal
+   sets are one object. Every expression node points at the set of its
+   free variables, computed from its children when the node is built.
+
+   A set only lists its members up to FV_MAX of them. Past that it
+   keeps just a 64-bit Bloom filter of them, so a node costs a bounded
+   amount however many names its term mentions, and such an
+   approximate set only says which symbols may be free. fv_occurs
+   gives the exact answer, walking down the term to the exact sets.
+
+   Sets live in a per-thread arena that expr_collect, expr_heap_seal
+   and the lending calls in expr.c move along with the nodes.          */
+
+#define FV_MAX  32
+#define FV_MANY UINT32_MAX /* the n of an approximate set */
+
+/**
+ * @brief              Get the empty set.
+ * @return             the empty set
+ */
+PURE const fvset *fv_empty(void);
+
+/**
+ * @brief              Get the set holding one symbol.
+ * @param  s           the symbol
+ * @return             the set {s}
+ */
+HOT const fvset *fv_single(sym s);
+
+/**
+ * @brief              Get the union of two sets.
+ * @param  a           the first set
+ * @param  b           the second set
+ * @return             a ∪ b, which is a or b itself if one contains the
+ *                     other, approximate if it has more than FV_MAX members
+ */
+HOT const fvset *fv_union(const fvset *a, const fvset *b);
+
+/**
+ * @brief              Get a set without one symbol.
+ * @param  a           the set
+ * @param  s           the symbol to remove
+ * @return             a \ {s}, which is a itself if s is not in a or a
+ *                     is approximate
+ */
+HOT const fvset *fv_remove(const fvset *a, sym s);
+
+/**
+ * @brief              Check whether a set may hold a symbol.
+ * @param  a           the set
+ * @param  s           the symbol
+ * @return             true if s is in a; for an approximate set, true
+ *                     also for some symbols that are not
+ */
+PURE bool fv_has(const fvset *a, sym s);
+
+/**
+ * @brief              Check whether a set lists its members.
+ * @param  a           the set
+ * @return             true unless a is approximate
+ */
+PURE bool fv_exact(const fvset *a);
+
+/**
+ * @brief              Check whether a symbol is free in a term.
+ * @param  e           the term
+ * @param  s           the symbol
+ * @return             true if s occurs free in e
+ */
+HOT bool fv_occurs(cexpr *e, sym s);
+
+/**
+ * @brief              Call a function on every free variable of a term,
+ *                     in no particular order and possibly more than once.
+ * @param  e           the term
+ * @param  fn          the function, returning true to stop
+ * @param  ctx         passed to fn
+ * @return             true if fn stopped it
+ */
+bool fv_each(cexpr *e, bool (*fn)(void *, sym), void *ctx);
+
+/**
+ * @brief              Start moving the live sets to a fresh arena, for
+ *                     a collection. Sets from before stay readable
+ *                     until fv_move_end.
+ */
+void fv_move_begin(void);
+
+/**
+ * @brief              Move a set to the fresh arena.
+ * @param  a           a set made before fv_move_begin
+ * @return             the equal set in the fresh arena, or a itself if
+ *                     it is sealed
+ */
+HOT const fvset *fv_move(const fvset *a);
+
+/**
+ * @brief              Release the sets made before fv_move_begin.
+ */
+void fv_move_end(void);
+
+/**
+ * @brief              Make every set of this thread permanent, along
+ *                     with the nodes expr_heap_seal seals.
+ */
+void fv_seal(void);
+
+/**
+ * @brief              Park this thread's sets and make new ones apart,
+ *                     for nodes built for another thread's heap.
+ */
+void fv_lend(void);
+
+/**
+ * @brief              Hand the sets made since fv_lend over for
+ *                     fv_adopt and bring the parked ones back.
+ */
+void fv_unlend(void);
+
+/**
+ * @brief              Take the sets handed over by fv_unlend.
+ */
+void fv_adopt(void);
+
+/**
+ * @brief              Get the bytes the sets hold from malloc.
+ * @return             the byte count
+ */
+size_t fv_reserved(void);
+
+/**
+ * @brief              Release this thread's sets. Sets from fv_empty and
+ *                     sealed sets stay valid.
+ */
+void fv_table_destroy(void);
+
+/**
+ * @brief              Release every set, sealed ones too.
+ */
+void fv_destroy(void);
+
+#endif /* FVSET_H */
@@ -0,0 +1,85 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "macros.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define READBACK_NODES     ((size_t) 1 << 16) /* read back after a limit */
+
+/**
+ * @brief              Why a reduction stopped. The values double as the
+ *                     exit status of the interpreter.
+ */
+typedef enum {
+    STOP_NONE   = 0,   /* the normal form was reached  */
+    STOP_STEPS  = 3,   /* the step limit was hit       */
+    STOP_TIME   = 4,   /* the wall-clock limit was hit */
+    STOP_MEMORY = 5,   /* the memory limit was hit     */
+} stop_reason;
+
+/**
+ * @brief              Resource limits for one reduction. A zero field
+ *                     means no limit.
+ */
+typedef struct limits {
+    size_t         steps;    /* β/δ steps                          */
+    double         seconds;  /* wall-clock time                    */
+    size_t         bytes;    /* bytes held by this thread's arenas
+                                and the normal-form cache          */
+} limits;
+
+/**
+ * @brief              Set the limits for the reductions that follow on
+ *                     this thread and start their clock. Every engine
+ *                     checks them before each β or δ step.
+ * @param  l           the limits
+ */
+void governor_start(const limits *l);
+
+/**
+ * @brief              Check the limits before a step. Once a limit is
+ *                     hit, every later check fails too, until the next
+ *                     governor_start. The clock is read only every few
+ *                     hundred checks.
+ * @param  steps       the number of steps done so far
+ * @return             true if the reduction must stop
+ */
+HOT bool governor_exceeded(size_t steps);
+
+/**
+ * @brief              Start reading a result back. The engines that read
+ *                     back a term after their steps, or while taking
+ *                     them, check governor_readback for every node.
+ */
+void governor_readback_start(void);
+
+/**
+ * @brief              Check the limits while a result is read back. Steps
+ *                     are not counted, but until a limit is hit the
+ *                     wall-clock and memory limits are checked as before
+ *                     a step. Once one is, the readback may make
+ *                     READBACK_NODES more nodes, and the subterms it has
+ *                     not reached by then are left out, each read back as
+ *                     the free variable ELIDED.
+ * @param  made        the nodes made since governor_readback_start
+ * @return             true if the rest of the result must be left out
+ */
+HOT bool governor_readback(size_t made);
+
+/**
+ * @brief              Get the limit that stopped the last reduction.
+ * @return             the reason, STOP_NONE if no limit was hit
+ */
+stop_reason governor_reason(void);
+
+/**
+ * @brief              Describe how a reduction ended.
+ * @param  r           the reason
+ * @return             a message such as "step limit reached"
+ */
+cchar *governor_message(stop_reason r);
+
+#endif /* GOVERNOR_H */
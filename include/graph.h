@@ -0,0 +1,36 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "macros.h"
+#include "term.h"
+#include "types.h"
+
+#include <stddef.h>
+
+/**
+ * @brief              Graph reduction counters.
+ */
+typedef struct graph_stats {
+    size_t         beta;     /* β-contractions          */
+    size_t         delta;    /* δ-unfoldings            */
+    size_t         updates;  /* shared nodes overwritten */
+    size_t         nodes;    /* graph nodes allocated   */
+} graph_stats;
+
+/**
+ * @brief              Normalize a term by call-by-need graph reduction.
+ *                     A β-step points every occurrence of the bound
+ *                     variable at the one argument node instead of
+ *                     copying it, and the node is overwritten with its
+ *                     value the first time it is reduced, so each shared
+ *                     redex is contracted at most once. The head is
+ *                     reduced first and the arguments afterwards, which
+ *                     reaches the same normal form as normal order.
+ * @param  t           the term to normalize
+ * @param  resolve     the δ-definition lookup, or NULL for none
+ * @param  st          the counters to fill in, or NULL
+ * @return             the normal form, allocated on the term heap
+ */
+term *graph_normalize(cterm *t, term_resolver resolve, graph_stats *st);
+
+#endif /* GRAPH_H */
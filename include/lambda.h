@@ -9,53 +9,226 @@
 #ifndef LAMBDA_H
 #define LAMBDA_H
 
+#include "governor.h"
+#include "nbe.h"
+#include "sink.h"
 #include "types.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#define N_DEFS             21
+
 /**
- * @brief              Delta definitions.
- */
-static cchar *def_src[] = {
-    "λx.λy.x",                                     /* true   */
-    "λx.λy.y",                                     /* false  */
-    "λp.λq.p q p",                                 /* and    */
-    "λp.λq.p p q",                                 /* or     */
-    "λn.λf.λx.n (λg.λh.h (g f)) (λu.x) (λu.u)",    /* dec    */
-    "λn.λf.λx.f (n f x)",                          /* inc    */
-    "λm.λn.m inc n",                               /* +      */
-    "λm.λn.m (+ n) 0",                             /* times  */
-    "λn.n (λx.false) true",                        /* iszero */
-    "λm.λn.n dec m",                               /* minus  */
-    "λm.λn.iszero (- m n)",                        /* <=     */ /* Untested */
-    "λx.λy.λf.f x y",                              /* pair   */
-    "λm.λn.(<= m n) and (<= n m)",                 /* ==     */ /* Untested */
-    "λm.λn.not(<= m n)",                           /* >      */ /* Untested */
-    "λm.λn.(<= m n) and not(== m n)",              /* <      */ /* Untested */
-    "λm.λn.<= n m",                                /* >=     */ /* Untested */
-    "λp.p false true",                             /* not    */
-    "λp.λq.not(and p q)",                          /* nand   */ /* Untested */
-    "λp.λq.not(p or q)",                           /* nor    */ /* Untested */
-    "λp.λq.or (and p (not q)) (and (not p) q)",    /* xor    */ /* Untested */
-    "λp.λq.not((p and not q) or (not p and q))",   /* xnor   */ /* Untested */
-};
-
-#define N_DEFS ((int)(sizeof(def_src) / sizeof(def_src[0])))
+ * @brief              Delta definitions, defined in lambda.c.
+ */
+extern cchar *const def_src[N_DEFS];
 
 /**
  * @brief              Delta definition names.
  */
-static cchar *def_names[N_DEFS] = {"true", "false", "and", "or", "dec",
-                                        "inc", "+", "*", "iszero", "-", "<=",
-                                        "pair",
-                                        /* Untested */
-                                        "==", ">", "<", ">=", "not", "nand",
-                                        "nor", "xor", "xnor"};
+extern cchar *const def_names[N_DEFS];
+
+/**
+ * @brief              The parsed delta definitions, set by whoever loads
+ *                     them.
+ */
+extern expr *def_vals[N_DEFS];
+
+/**
+ * @brief              Reduction engines selectable from the command line.
+ */
+typedef enum {
+    ENGINE_REWRITE,    /* named terms, one rewrite per step      */
+    ENGINE_DEBRUIJN,   /* locally nameless terms, shared subterms */
+    ENGINE_GRAPH,      /* call-by-need graph reduction            */
+    ENGINE_MACHINE,    /* strong Krivine machine                  */
+    ENGINE_NBE,        /* normalization by evaluation             */
+} engine;
 
-expr *def_vals[N_DEFS];
+/**
+ * @brief              Reduction strategies of the rewrite engine.
+ */
+typedef enum {
+    STRATEGY_NORMAL,      /* leftmost-outermost, to normal form          */
+    STRATEGY_APPLICATIVE, /* leftmost-innermost, to normal form          */
+    STRATEGY_CBV,         /* call by value, to weak normal form          */
+    STRATEGY_CBN,         /* call by name, to weak normal form           */
+    STRATEGY_WHNF,        /* head redexes, to weak head normal form      */
+    STRATEGY_HNF,         /* head redexes under λ, to head normal form   */
+    N_STRATEGIES,
+} strategy;
+
+/**
+ * @brief              How much of a reduction the normalizers print.
+ */
+typedef enum {
+    TRACE_FULL,        /* every step                               */
+    TRACE_EVERY,       /* every Nth step and the last one          */
+    TRACE_LAST,        /* the last N steps only                    */
+    TRACE_FINAL,       /* the step count and the δ-abstracted form */
+    TRACE_QUIET,       /* nothing at all                           */
+} trace_mode;
+
+/**
+ * @brief              Choose how much of a reduction is printed. Outside
+ *                     TRACE_FULL and the chosen steps of TRACE_EVERY, the
+ *                     reduction loop renders nothing.
+ * @param  mode        the trace mode
+ * @param  n           N for TRACE_EVERY and TRACE_LAST, ignored otherwise
+ */
+void trace_config(trace_mode mode, size_t n);
+
+/**
+ * @brief              Send what the normalizers print on the calling
+ *                     thread to a sink instead of standard output.
+ * @param  out         the sink, or NULL for standard output
+ */
+void trace_output(sink *out);
+
+/**
+ * @brief              Hand the final term of every reduction on the
+ *                     calling thread to a function as its trace ends:
+ *                     the normal form, or the term a limit stopped at.
+ * @param  fn          the function, or NULL for none
+ */
+void trace_result(void (*fn)(cexpr *e));
+
+/**
+ * @brief              Turn native arithmetic on or off. When on, the
+ *                     rewrite engine contracts inc, dec, iszero, +, *, -
+ *                     and <= applied to Church numerals in one δ step,
+ *                     computing the normal form on integers.
+ * @param  on          true to compute numeral arithmetic natively
+ */
+void native_arith(bool on);
 
 /**
  * @brief              Normalize an expression by abstracting Church numerals.
+ *                     Every normalizer stops early at the limits set with
+ *                     governor_start and prints the term it got to.
+ * @param  e           the expression to normalize
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+stop_reason normalize(expr *e);
+
+/**
+ * @brief              Do one step of a strategy.
+ * @param  s           the strategy
+ * @param  e           the term
+ * @param  ne          set to the term after the step
+ * @param  rtype       set to the reduction type
+ * @return             false if e has no redex the strategy contracts
+ */
+bool reduce_once_with(strategy s, cexpr *e, expr **ne, cchar **rtype);
+
+/**
+ * @brief              Get the name of a strategy, as --strategy takes it.
+ * @param  s           the strategy
+ * @return             the name, such as "cbv"
+ */
+PURE cchar *strategy_name(strategy s);
+
+/**
+ * @brief              Look up a strategy by name.
+ * @param  name        the name
+ * @param  s           set to the strategy if found
+ * @return             false if no strategy has that name
+ */
+bool strategy_parse(cchar *name, strategy *s);
+
+/**
+ * @brief              Normalize an expression like normalize, contracting
+ *                     the redexes a strategy picks until it finds none. The
+ *                     weak and head strategies stop short of the normal
+ *                     form. Only the normal strategy uses the normal-form
+ *                     cache.
+ * @param  s           the strategy
+ * @param  e           the expression to normalize
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+stop_reason normalize_strategy(strategy s, expr *e);
+
+/**
+ * @brief              Contract every outermost redex of a term at once,
+ *                     handing large disjoint subterms to the pool of
+ *                     normalize_parallel. Without that pool, or with
+ *                     hash-consing on, the round runs on the calling
+ *                     thread.
+ * @param  e           the term
+ * @param  ne          set to the term after the round
+ * @param  count       set to the number of redexes contracted
+ * @return             false if e is in normal form
+ */
+bool reduce_parallel(cexpr *e, expr **ne, size_t *count);
+
+/**
+ * @brief              Normalize an expression like normalize, but in
+ *                     parallel rounds: each contracts every outermost
+ *                     redex, which never overlap, so the trace numbers
+ *                     rounds and the normal form is the one normalize
+ *                     reaches. The step limit counts rounds.
+ * @param  e           the expression to normalize
+ * @param  threads     the worker threads, 0 to run every round on the
+ *                     calling thread
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+stop_reason normalize_parallel(expr *e, size_t threads);
+
+/**
+ * @brief              Normalize an expression on the locally nameless core.
+ *                     Prints the same trace as normalize, up to the names
+ *                     chosen for renamed binders.
+ * @param  e           the expression to normalize
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+stop_reason normalize_db(expr *e);
+
+/**
+ * @brief              Normalize an expression by call-by-need graph
+ *                     reduction. Shared arguments are reduced at most
+ *                     once, so only the initial term and the normal form
+ *                     are printed, with the number of contractions done.
+ * @param  e           the expression to normalize
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+stop_reason normalize_graph(expr *e);
+
+/**
+ * @brief              Normalize an expression on the strong Krivine
+ *                     machine. Prints the initial term and the normal form
+ *                     with the number of β/δ steps, which is the same as
+ *                     the number of steps normalize would print.
+ * @param  e           the expression to normalize
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+stop_reason normalize_machine(expr *e);
+
+/**
+ * @brief              Compute the normal form of an expression by
+ *                     normalization by evaluation, without a trace. The
+ *                     δ-definitions are unfolded as needed.
+ * @param  e           the expression
+ * @param  st          the counters to fill in, or NULL
+ * @return             the normal form
+ */
+expr *normal_form(cexpr *e, nbe_stats *st);
+
+/**
+ * @brief              Normalize an expression by evaluation. Prints the
+ *                     initial term and the normal form with the number of
+ *                     β/δ steps the evaluator performed.
+ * @param  e           the expression to normalize
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+stop_reason normalize_nbe(expr *e);
+
+/**
+ * @brief              Normalize an expression with the given engine.
+ * @param  eng         the engine
  * @param  e           the expression to normalize
+ * @return             STOP_NONE, or the limit that stopped the reduction
  */
-void normalize(expr *e);
+stop_reason normalize_with(engine eng, expr *e);
 
 #endif /* LAMBDA_H */
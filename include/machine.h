@@ -0,0 +1,35 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "macros.h"
+#include "term.h"
+#include "types.h"
+
+#include <stddef.h>
+
+/**
+ * @brief              Abstract machine counters.
+ */
+typedef struct machine_stats {
+    size_t         beta;     /* closures popped into an environment */
+    size_t         delta;    /* δ-unfoldings                        */
+    size_t         lookups;  /* environment lookups                 */
+    size_t         closures; /* closures allocated                  */
+} machine_stats;
+
+/**
+ * @brief              Normalize a term on a strong Krivine machine. The
+ *                     machine evaluates closures (term, environment) to
+ *                     weak head normal form with an argument stack and no
+ *                     substitution; read-back then goes under binders by
+ *                     binding them to fresh neutral variables and
+ *                     normalizes the arguments of neutral heads. The β
+ *                     and δ counts match those of normal-order rewriting.
+ * @param  t           the term to normalize
+ * @param  resolve     the δ-definition lookup, or NULL for none
+ * @param  st          the counters to fill in, or NULL
+ * @return             the normal form, allocated on the term heap
+ */
+term *machine_normalize(cterm *t, term_resolver resolve, machine_stats *st);
+
+#endif /* MACHINE_H */
@@ -16,9 +16,10 @@
 #define UNUSED             __attribute__((unused))
 #define DEAD               __attribute__((unused))
 #define UNREACHABLE        __attribute__((unreachable))
+#define THREAD_LOCAL       _Thread_local
 
-#define MAX_PRINT_LEN      (32 * 1024 * 1024)
 #define INIT_ARENA_SIZE    (1024 * 1024)
+#define LEND_ARENA_SIZE    (64 * 1024)
 #define DEBUG              false
 #define PROFILE            false
 
@@ -0,0 +1,34 @@
+#ifndef NBE_H
+#define NBE_H
+
+#include "macros.h"
+#include "term.h"
+#include "types.h"
+
+#include <stddef.h>
+
+/**
+ * @brief              Normalization-by-evaluation counters.
+ */
+typedef struct nbe_stats {
+    size_t         beta;     /* closures applied          */
+    size_t         delta;    /* δ-unfoldings              */
+    size_t         forced;   /* suspended arguments forced */
+    size_t         values;   /* semantic values allocated  */
+} nbe_stats;
+
+/**
+ * @brief              Normalize a term by evaluation. The term is
+ *                     evaluated into semantic values, which are either
+ *                     closures or neutral terms stuck on a variable, and
+ *                     the value is quoted back into a term. Arguments are
+ *                     suspended and evaluated at most once, when first
+ *                     needed, so every term with a normal form reaches it.
+ * @param  t           the term to normalize
+ * @param  resolve     the δ-definition lookup, or NULL for none
+ * @param  st          the counters to fill in, or NULL
+ * @return             the normal form, allocated on the term heap
+ */
+term *nbe_normalize(cterm *t, term_resolver resolve, nbe_stats *st);
+
+#endif /* NBE_H */
@@ -51,52 +51,70 @@ HOT PURE INLINE bool is_lambda(const Parser *p);
 HOT PURE INLINE bool is_invalid_char(const Parser *p, char c);
 
 /**
- * @brief              Parse a lambda calculus expression.
+ * @brief              Parse a lambda calculus expression. What is wrong
+ *                     with malformed input is reported on stderr.
  * @param  p           the parser
- * @return             the parsed expression
+ * @return             the parsed expression, or NULL if the input is
+ *                     malformed
  */
 expr *parse(Parser *p);
 
+/**
+ * @brief              Parse the expression in a file, which is mapped
+ *                     into memory rather than read.
+ * @param  path        the file
+ * @return             the parsed expression, or NULL if the file cannot
+ *                     be mapped, is empty or is malformed
+ */
+expr *parse_file(cchar *path);
+
 /**
  * @brief              Parse an expression from the input.
  * @param  p           the parser
- * @return             the parsed expression
+ * @return             the parsed expression, or NULL if the input is
+ *                     malformed
  */
 expr *parse_expr(Parser *p);
 
 /**
  * @brief              Parse an abstraction from the input.
  * @param  p           the parser
- * @return             the parsed abstraction
+ * @return             the parsed abstraction, or NULL if the input is
+ *                     malformed
  */
 expr *parse_abs(Parser *p);
 
 /**
  * @brief              Parse an application from the input.
  * @param  p           the parser
- * @return             the parsed application
+ * @return             the parsed application, or NULL if the input is
+ *                     malformed
  */
 expr *parse_app(Parser *p);
 
 /**
  * @brief              Parse an atom from the input.
  * @param  p           the parser
- * @return             the parsed atom
+ * @return             the parsed atom, or NULL if the input is
+ *                     malformed
  */
 expr *parse_atom(Parser *p);
 
 /**
  * @brief              Parse a number from the input.
  * @param  p           the parser
- * @return             the parsed number
+ * @param  out         set to the parsed number
+ * @return             false if there is no digit or the number does not
+ *                     fit in 64 bits
  */
-int parse_number(Parser *p);
+bool parse_number(Parser *p, uint64 *out);
 
 /**
  * @brief              Parse a variable name from the input.
  * @param  p           the parser
- * @return             the parsed variable name (must be freed by caller)
+ * @return             the interned variable name, or SYM_NONE if there
+ *                     is none
  */
-char *parse_varname(Parser *p);
+sym parse_varname(Parser *p);
 
 #endif /* PARSER_H */
@@ -0,0 +1,59 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "macros.h"
+#include "types.h"
+
+#include <stddef.h>
+
+/**
+ * @brief              A fixed set of worker threads running indexed loops.
+ *                     Each worker starts on its own slice of the indices
+ *                     and, once that runs out, steals the upper half of
+ *                     what is left of another slice.
+ */
+typedef struct pool pool;
+
+/**
+ * @brief              The body of a loop, run once for every index.
+ */
+typedef void (*pool_fn)(void *ctx, size_t i);
+
+/**
+ * @brief              Get the number of processors online.
+ * @return             the count, at least 1
+ */
+size_t pool_cpus(void);
+
+/**
+ * @brief              Start the worker threads.
+ * @param  threads     the number of workers, at least 1
+ * @param  at_exit     run by each worker as it stops, or NULL
+ * @return             the pool
+ */
+pool *pool_create(size_t threads, void (*at_exit)(void));
+
+/**
+ * @brief              Start running fn for every index below n and return
+ *                     at once. The previous loop must have been waited for.
+ * @param  p           the pool
+ * @param  n           the number of indices
+ * @param  fn          the loop body
+ * @param  ctx         passed to fn unchanged
+ */
+void pool_submit(pool *p, size_t n, pool_fn fn, void *ctx);
+
+/**
+ * @brief              Help with the running loop, then wait until every
+ *                     index is done.
+ * @param  p           the pool
+ */
+void pool_wait(pool *p);
+
+/**
+ * @brief              Stop and join the worker threads.
+ * @param  p           the pool
+ */
+void pool_destroy(pool *p);
+
+#endif /* POOL_H */
@@ -0,0 +1,101 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "macros.h"
+#include "strbuf.h"
+#include "types.h"
+
+#include <stdio.h>
+
+#define SINK_FLUSH_AT      (64 * 1024)
+
+/**
+ * @brief              Receives the bytes a sink flushes.
+ */
+typedef void (*sink_fn)(void *ctx, const char *data, size_t len);
+
+/**
+ * @brief              Buffered output sink. Bytes collect in buf and are
+ *                     passed to write whenever SINK_FLUSH_AT of them have
+ *                     built up. A sink without a write function keeps
+ *                     everything in buf, which grows as needed.
+ */
+typedef struct sink {
+    strbuf         buf;
+    sink_fn        write;
+    void          *ctx;
+    int            fd;
+    size_t         bytes;    /* total bytes written to the sink */
+} sink;
+
+/**
+ * @brief              Make a sink that writes to a stdio stream.
+ * @param  s           the sink
+ * @param  f           the stream
+ */
+void sink_init_file(sink *s, FILE *f);
+
+/**
+ * @brief              Make a sink that writes to a file descriptor.
+ * @param  s           the sink
+ * @param  fd          the file descriptor
+ */
+void sink_init_fd(sink *s, int fd);
+
+/**
+ * @brief              Make a sink that passes its output to a callback.
+ * @param  s           the sink
+ * @param  fn          the callback
+ * @param  ctx         passed to fn unchanged
+ */
+void sink_init_fn(sink *s, sink_fn fn, void *ctx);
+
+/**
+ * @brief              Make a sink that keeps its output in memory, in
+ *                     s->buf.data.
+ * @param  s           the sink
+ */
+void sink_init_mem(sink *s);
+
+/**
+ * @brief              Write bytes to a sink.
+ * @param  s           the sink
+ * @param  p           the bytes
+ * @param  n           the number of bytes
+ */
+HOT void sink_write(sink *s, const char *p, size_t n);
+
+/**
+ * @brief              Write one byte to a sink.
+ * @param  s           the sink
+ * @param  c           the byte
+ */
+HOT void sink_putc(sink *s, char c);
+
+/**
+ * @brief              Write a NUL-terminated string to a sink.
+ * @param  s           the sink
+ * @param  str         the string
+ */
+void sink_puts(sink *s, const char *str);
+
+/**
+ * @brief              Write formatted text to a sink.
+ * @param  s           the sink
+ * @param  fmt         the printf format
+ */
+void sink_printf(sink *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief              Pass everything buffered to the output.
+ * @param  s           the sink
+ */
+void sink_flush(sink *s);
+
+/**
+ * @brief              Flush a sink and release its buffer.
+ * @param  s           the sink
+ */
+void sink_destroy(sink *s);
+
+#endif /* SINK_H */
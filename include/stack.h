@@ -0,0 +1,26 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include "macros.h"
+
+#include <stddef.h>
+
+/* Explicit stacks for traversals that must not recurse on term depth.
+   A traversal starts with a small local array and calls stack_grow
+   when it fills up, so shallow terms never touch the heap. Callers
+   free the stack at the end if it no longer is the local array.    */
+
+#define STACK_LOCAL        64
+
+/**
+ * @brief              Double the capacity of a traversal stack, moving
+ *                     it to the heap on the first growth.
+ * @param  stack       the stack
+ * @param  local       the local array the stack started in
+ * @param  cap         the capacity in elements, updated
+ * @param  size        the size of an element
+ * @return             the grown stack
+ */
+void *stack_grow(void *stack, const void *local, size_t *cap, size_t size);
+
+#endif /* STACK_H */
@@ -0,0 +1,130 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "macros.h"
+#include "sink.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Runtime statistics. Every thread keeps its own counters, always on;
+   the events are counted where they happen and cost an increment each.
+   Every node carries the size and depth of its term, computed when it
+   is built, so the rewrite and De Bruijn engines record them after
+   every step at no extra cost. The graph, machine and NbE engines run
+   to the end in one call and record the initial and final terms. Node
+   counts are those of the expression heap; the core terms of the
+   other engines are not counted.                                     */
+
+/**
+ * @brief              Phases of a run, timed separately.
+ */
+typedef enum {
+    PHASE_PARSE,       /* reading the input into a term      */
+    PHASE_REDUCE,      /* reduction, printing excluded        */
+    PHASE_PRINT,       /* writing terms to the trace          */
+    PHASE_ABSTRACT,    /* δ-abstracting the final term        */
+    N_PHASES,
+} stats_phase;
+
+/**
+ * @brief              Counters of the calling thread since the last
+ *                     stats_reset.
+ */
+typedef struct run_stats {
+    size_t         beta;            /* β-contractions                      */
+    size_t         delta;           /* δ-unfoldings and native arithmetic  */
+    size_t         substitutions;   /* rewrite engine: one per β-contraction */
+    size_t         renamings;       /* binders renamed to avoid capture    */
+    size_t         copied_bytes;    /* node bytes built by copy_expr       */
+    size_t         nodes_allocated;
+    size_t         bytes_allocated;
+    size_t         nodes_freed;     /* nodes reclaimed by collections      */
+    size_t         nodes_peak;      /* most nodes the heap held at once    */
+    size_t         collections;
+    size_t         max_size;        /* nodes of the largest term           */
+    size_t         max_depth;       /* depth of the deepest term           */
+    double         seconds[N_PHASES];
+} run_stats;
+
+/**
+ * @brief              Zero the counters of the calling thread.
+ */
+void stats_reset(void);
+
+/**
+ * @brief              Get the counters of the calling thread.
+ * @return             a snapshot of the counters
+ */
+run_stats stats_get(void);
+
+/**
+ * @brief              Add counters gathered on another thread to those of
+ *                     the calling thread.
+ * @param  s           the counters to add
+ */
+void stats_add(const run_stats *s);
+
+/**
+ * @brief              Count contractions.
+ * @param  beta        the β-contractions
+ * @param  delta       the δ steps
+ */
+HOT void stats_steps(size_t beta, size_t delta);
+
+/**
+ * @brief              Count a substitution, whether or not it changed
+ *                     the term.
+ */
+HOT void stats_substitution(void);
+
+/**
+ * @brief              Count a binder renamed to avoid capture.
+ */
+void stats_renaming(void);
+
+/**
+ * @brief              Count the bytes of nodes copy_expr built.
+ * @param  bytes       the bytes
+ */
+void stats_copied(size_t bytes);
+
+/**
+ * @brief              Keep a term's size and depth if they are the
+ *                     largest yet.
+ * @param  size        the nodes of the term
+ * @param  depth       the nodes on its longest path
+ */
+HOT void stats_size(size_t size, size_t depth);
+
+/**
+ * @brief              Keep the size and depth of an expression, counting
+ *                     a numeral as the term it stands for, if they are
+ *                     the largest yet.
+ * @param  e           the expression, or NULL
+ */
+HOT void stats_measure(cexpr *e);
+
+/**
+ * @brief              Start timing a phase, pausing the one under way
+ *                     until the matching stats_end.
+ * @param  p           the phase
+ */
+void stats_begin(stats_phase p);
+
+/**
+ * @brief              Stop timing the phase started last and resume the
+ *                     one it paused.
+ */
+void stats_end(void);
+
+/**
+ * @brief              Write counters as a JSON object, with the counters
+ *                     of the normal-form cache.
+ * @param  out         the sink
+ * @param  s           the counters
+ */
+void stats_write_json(sink *out, const run_stats *s);
+
+#endif /* STATS_H */
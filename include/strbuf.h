@@ -26,6 +26,15 @@ void sb_init(strbuf *sb, size_t init_cap);
  */
 void sb_ensure(strbuf *sb, size_t need);
 
+/**
+ * @brief              Append bytes to the string buffer, growing it as
+ *                     needed. The contents stay NUL-terminated.
+ * @param  sb          the string buffer to append to
+ * @param  p           the bytes
+ * @param  n           the number of bytes
+ */
+void sb_append(strbuf *sb, const char *p, size_t n);
+
 /**
  * @brief              Reset the string buffer.
  * @param  sb          the string buffer to reset
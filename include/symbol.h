@@ -0,0 +1,99 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include "macros.h"
+#include "types.h"
+
+#include <stddef.h>
+
+#define SYM_NONE           UINT32_MAX
+
+/**
+ * @brief              Intern an identifier.
+ * @param  s           the identifier (need not be NUL-terminated)
+ * @param  len         the length of the identifier in bytes
+ * @return             the dense symbol ID of the identifier
+ */
+HOT sym sym_intern_n(cchar *s, size_t len);
+
+/**
+ * @brief              Intern a NUL-terminated identifier.
+ * @param  s           the identifier
+ * @return             the dense symbol ID of the identifier
+ */
+HOT sym sym_intern(cchar *s);
+
+/**
+ * @brief              Look up an identifier without interning it.
+ * @param  s           the identifier
+ * @return             the symbol ID, or SYM_NONE if it was never interned
+ */
+sym sym_lookup(cchar *s);
+
+/**
+ * @brief              Make a new symbol with the same text as s. It is
+ *                     distinct from every other symbol, so a binder given
+ *                     it cannot capture or be captured by another x.
+ * @param  s           the symbol
+ * @return             the new symbol
+ */
+sym sym_alias(sym s);
+
+/**
+ * @brief              Get the symbol for binders named s at a depth,
+ *                     making it with sym_alias the first time. Binders
+ *                     nested in one another get distinct symbols, so a
+ *                     parse makes at most one per name and depth however
+ *                     many terms it is run on.
+ * @param  s           the symbol
+ * @param  depth       the number of binders around the binder
+ * @return             the generated symbol
+ */
+sym sym_binder(sym s, uint32 depth);
+
+/**
+ * @brief              Get the symbol named after s with a numeric suffix
+ *                     for an ordinal, making it the first time. Like
+ *                     sym_binder, one symbol serves every caller, so a
+ *                     renaming tries ordinals until one is unused where
+ *                     it is needed.
+ * @param  s           the symbol
+ * @param  ordinal     the suffix
+ * @return             the generated symbol
+ */
+sym sym_fresh(sym s, uint32 ordinal);
+
+/**
+ * @brief              Get the interned symbol a generated one was made
+ *                     from, or s itself if s was interned.
+ * @param  s           the symbol
+ * @return             the root symbol
+ */
+PURE sym sym_root(sym s);
+
+/**
+ * @brief              Get the text of a symbol.
+ * @param  s           the symbol
+ * @return             the NUL-terminated text, valid until sym_table_destroy
+ */
+PURE cchar *sym_name(sym s);
+
+/**
+ * @brief              Get the length of a symbol's text.
+ * @param  s           the symbol
+ * @return             the length in bytes
+ */
+PURE size_t sym_len(sym s);
+
+/**
+ * @brief              Get the number of interned symbols.
+ * @return             one past the largest symbol ID handed out
+ */
+uint32 sym_count(void);
+
+/**
+ * @brief              Release every symbol.
+ */
+void sym_table_destroy(void);
+
+#endif /* SYMBOL_H */
@@ -0,0 +1,167 @@
+#ifndef TERM_H
+#define TERM_H
+
+#include "macros.h"
+#include "types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ELIDED "…" /* the free variable standing for a subterm left out */
+
+/* Locally nameless core representation. Bound variables are De Bruijn
+   indices, free variables keep their symbol, and abstractions keep the
+   name they were written with only as a hint for printing. Terms are
+   immutable, so substitution shares every subterm it does not change. */
+
+typedef enum {
+    IDX_term, FREE_term, ABS_term, APP_term
+} termType;
+
+/**
+ * @brief              Core term node. Only the fields of its type are
+ *                     meaningful.
+ */
+typedef struct term {
+    termType       type;
+    uint32_t       gen;
+    uint32_t       loose;    /* 1 + largest index escaping the term, 0 if closed */
+    union {
+        uint32_t   idx;      /* IDX_term  */
+        sym        free_sym; /* FREE_term */
+        sym        abs_hint; /* ABS_term  */
+    };
+    uint32_t       depth;    /* nodes on the longest path */
+    uint32_t       open;     /* 1 if a free variable occurs in the term */
+    uint64_t       size;     /* nodes of the term         */
+    union {
+        struct term *abs_body;    /* ABS_term */
+        struct {
+            struct term *app_fn;  /* APP_term */
+            struct term *app_arg;
+        };
+    };
+} term;
+
+typedef const term cterm;
+
+/**
+ * @brief              Resolves a free symbol to a closed δ-definition,
+ *                     or NULL if the symbol is not defined.
+ */
+typedef term *(*term_resolver)(sym s);
+
+/**
+ * @brief              Make a bound variable.
+ * @param  i           the De Bruijn index
+ * @return             the variable
+ */
+HOT term *make_idx(uint32 i);
+
+/**
+ * @brief              Make a free variable.
+ * @param  s           the symbol
+ * @return             the variable
+ */
+HOT term *make_free(sym s);
+
+/**
+ * @brief              Make an abstraction.
+ * @param  hint        the parameter name used for printing
+ * @param  b           the body
+ * @return             the abstraction
+ */
+HOT term *make_tabs(sym hint, term *b);
+
+/**
+ * @brief              Make an application.
+ * @param  f           the function
+ * @param  a           the argument
+ * @return             the application
+ */
+HOT term *make_tapp(term *f, term *a);
+
+/**
+ * @brief              Shift the loose indices of a term.
+ * @param  t           the term
+ * @param  cutoff      indices below this are bound inside and left alone
+ * @param  d           the amount to add to each loose index
+ * @return             the shifted term, t itself when nothing changes
+ */
+HOT term *term_shift(term *t, uint32 cutoff, uint32 d);
+
+/**
+ * @brief              Instantiate index depth in t with val. Indices
+ *                     above depth drop by one, as the binder is gone.
+ * @param  t           the body of the abstraction being applied
+ * @param  depth       the index being replaced
+ * @param  val         the argument, relative to the binder's context
+ * @return             the substituted term
+ */
+HOT term *term_subst(term *t, uint32 depth, term *val);
+
+/**
+ * @brief              Contract a β-redex (λ.b) a.
+ * @param  b           the body of the abstraction
+ * @param  a           the argument
+ * @return             b with index 0 replaced by a
+ */
+HOT term *term_beta(term *b, term *a);
+
+/**
+ * @brief              Bound the size of a term, keeping its first nodes
+ *                     in preorder and eliding the subterms past them,
+ *                     each as the free variable ELIDED.
+ * @param  t           the term, shared as a DAG
+ * @param  nodes       the nodes to keep
+ * @return             the bounded term, t itself when it fits
+ */
+term *term_elide(term *t, uint64 nodes);
+
+/**
+ * @brief              Convert a named expression to a term.
+ * @param  e           the expression
+ * @return             the term
+ */
+term *term_from_expr(cexpr *e);
+
+/**
+ * @brief              Convert a term back to a named expression. Binders
+ *                     get their hint names unless that would capture a
+ *                     variable, in which case a numbered variant is used.
+ * @param  t           the term
+ * @return             the expression
+ */
+expr *term_to_expr(cterm *t);
+
+/**
+ * @brief              Check two terms for α-equivalence.
+ * @param  a           the first term
+ * @param  b           the second term
+ * @return             true if they are equal up to bound names
+ */
+PURE bool term_equal(cterm *a, cterm *b);
+
+/**
+ * @brief              Compact the term nursery, keeping only the terms
+ *                     reachable from roots, which are updated in place.
+ * @param  roots       the root slots
+ * @param  n           the number of roots
+ */
+void term_collect(term **roots, size_t n);
+
+/**
+ * @brief              Run term_collect once the nursery has doubled since
+ *                     the last collection.
+ * @param  roots       the root slots
+ * @param  n           the number of roots
+ * @return             true if a collection ran
+ */
+bool term_collect_maybe(term **roots, size_t n);
+
+/**
+ * @brief              Release every term.
+ */
+void term_heap_destroy(void);
+
+#endif /* TERM_H */
@@ -4,25 +4,58 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+/**
+ * @brief              Interned identifier, see symbol.h.
+ */
+typedef uint32_t sym;
+
 /**
  * @brief              Variable set structure.
  */
 typedef struct VarSet {
-    char         **v;
+    sym           *v;
     int            c;
 } VarSet;
 
+/**
+ * @brief              Interned free-variable set, see fvset.h.
+ */
+typedef struct fvset {
+    uint32_t       n;        /* members, or FV_MANY if approximate */
+    uint32_t       hash;
+    uint64_t       bloom;    /* one hashed bit per member          */
+    uint32_t       sealed;   /* never moved by a collection        */
+    sym            v[];      /* sorted, when exact                 */
+} fvset;
+
 typedef enum {
-    VAR_expr, ABS_expr, APP_expr
+    VAR_expr, ABS_expr, APP_expr, NUM_expr
 } exprType;
 
+/**
+ * @brief              Expression node. Only the fields of its type are
+ *                     meaningful; names are read through sym_name.
+ */
 typedef struct expr {
     exprType       type;
-    char          *var_name;
-    char          *abs_param;
-    struct expr   *abs_body;
-    struct expr   *app_fn;
-    struct expr   *app_arg;
+    uint32_t       gen;
+    uint32_t       hash;     /* structural, stable across collections */
+    union {
+        sym        var_sym;  /* VAR_expr */
+        sym        abs_sym;  /* ABS_expr */
+    };
+    union {
+        struct expr *abs_body;    /* ABS_expr */
+        struct {
+            struct expr *app_fn;  /* APP_expr */
+            struct expr *app_arg;
+        };
+        uint64_t   num;      /* NUM_expr: stands for λf.λx.f (... (f x)) */
+    };
+    const fvset   *fv;       /* free variables, shared */
+    uint64_t       size;     /* nodes of the term, numerals expanded */
+    uint32_t       depth;    /* nodes on its longest path, likewise  */
+    uint32_t       shape;    /* hash equal for α-equivalent terms    */
 } expr;
 
 typedef unsigned char          uchar;
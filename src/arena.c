@@ -0,0 +1,77 @@
+#include "../include/arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static THREAD_LOCAL size_t reserved_total; /* across this thread's arenas */
+
+void arena_init(arena *a, const size_t chunk_size) {
+    a->first = a->last = NULL;
+    a->chunk_size = chunk_size;
+    a->bytes = a->reserved = 0;
+}
+
+static arena_chunk *arena_grow(arena *a, const size_t need) {
+    const size_t cap = need > a->chunk_size ? need : a->chunk_size;
+    arena_chunk *c = malloc(sizeof *c + cap);
+    if (!c) {
+        perror("malloc for arena");
+        exit(1);
+    }
+    c->next = NULL;
+    c->used = 0;
+    c->cap = cap;
+    if (a->last) a->last->next = c;
+    else a->first = c;
+    a->last = c;
+    a->reserved += sizeof *c + cap;
+    reserved_total += sizeof *c + cap;
+
+    return c;
+}
+
+HOT void *arena_alloc(arena *a, size_t size) {
+    size = ARENA_ALIGN(size);
+    arena_chunk *c = a->last;
+    if (!c || c->cap - c->used < size) c = arena_grow(a, size);
+    void *p = c->data + c->used;
+    c->used += size;
+    a->bytes += size;
+
+    return p;
+}
+
+void arena_destroy(arena *a) {
+    reserved_total -= a->reserved;
+    arena_chunk *c = a->first;
+    while (c) {
+        arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->first = a->last = NULL;
+    a->bytes = a->reserved = 0;
+}
+
+void arena_append(arena *dst, arena *src) {
+    if (!src->first) return;
+    if (dst->last) dst->last->next = src->first;
+    else dst->first = src->first;
+    dst->last = src->last;
+    dst->bytes += src->bytes;
+    dst->reserved += src->reserved;
+    src->first = src->last = NULL;
+    src->bytes = src->reserved = 0;
+}
+
+void arena_disown(arena *a) {
+    reserved_total -= a->reserved;
+}
+
+void arena_own(arena *a) {
+    reserved_total += a->reserved;
+}
+
+size_t arena_reserved_total(void) {
+    return reserved_total;
+}
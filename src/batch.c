@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L /* getline */
+
+#include "../include/batch.h"
+
+#include "../include/cache.h"
+#include "../include/expr.h"
+#include "../include/parser.h"
+#include "../include/pool.h"
+#include "../include/sink.h"
+#include "../include/term.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief              One line of the batch and what normalizing it
+ *                     printed.
+ */
+typedef struct batch_item {
+    char          *src;
+    sink           out;      /* in memory, written out by the caller */
+    stop_reason    stop;
+    bool           malformed;
+    bool           done;
+} batch_item;
+
+typedef struct batch {
+    batch_item    *items;
+    size_t         n;
+    engine         eng;
+    limits         lim;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;    /* an item is done */
+} batch;
+
+/**
+ * @brief              Read the non-blank lines of a stream.
+ * @param  f           the stream
+ * @param  n           set to the number of lines
+ * @return             the lines, without their line ends
+ */
+static batch_item *read_items(FILE *f, size_t *n) {
+    batch_item *items = NULL;
+    size_t cap = 0;
+    *n = 0;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_cap, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        ssize_t k = 0;
+        while (k < len && isspace((uchar) line[k])) k++;
+        if (k == len) continue;
+
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 256;
+            items = realloc(items, sizeof *items * cap);
+            if (!items) {
+                perror("realloc for batch");
+                exit(1);
+            }
+        }
+        items[*n] = (batch_item){.src = strdup(line), .stop = STOP_NONE};
+        if (!items[*n].src) {
+            perror("strdup for batch");
+            exit(1);
+        }
+        (*n)++;
+    }
+    free(line);
+
+    return items;
+}
+
+/**
+ * @brief              Normalize one line on a worker thread, printing
+ *                     into the line's own sink, then drop everything the
+ *                     thread allocated for it.
+ */
+static void batch_eval(void *ctx, const size_t i) {
+    batch *b = ctx;
+    batch_item *it = &b->items[i];
+
+    sink_init_mem(&it->out);
+    sink_printf(&it->out, "λ-expr> %s\n", it->src);
+    trace_output(&it->out);
+    Parser p = {it->src, 0, strlen(it->src)};
+    expr *e = parse(&p);
+    if (e) {
+        governor_start(&b->lim);
+        it->stop = normalize_with(b->eng, e);
+    } else {
+        sink_printf(&it->out, "Malformed expression\n");
+        it->malformed = true;
+    }
+    sink_putc(&it->out, '\n');
+    trace_output(NULL);
+
+    expr_heap_release();
+    term_heap_destroy();
+
+    pthread_mutex_lock(&b->lock);
+    it->done = true;
+    pthread_cond_broadcast(&b->ready);
+    pthread_mutex_unlock(&b->lock);
+}
+
+int batch_run(cchar *path, const engine eng, const limits *lim, const size_t threads) {
+    FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    batch b = {NULL, 0, eng, *lim, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+    b.items = read_items(f, &b.n);
+    if (f != stdin) fclose(f);
+
+    // Every line sees the cache as it was before the batch, whatever
+    // the order the lines finish in
+    nf_cache_freeze(true);
+    pool *p = pool_create(threads, NULL);
+    pool_submit(p, b.n, batch_eval, &b);
+
+    // Write each output as soon as it and everything before it are done
+    int status = 0;
+    for (size_t i = 0; i < b.n; i++) {
+        batch_item *it = &b.items[i];
+        pthread_mutex_lock(&b.lock);
+        while (!it->done) pthread_cond_wait(&b.ready, &b.lock);
+        pthread_mutex_unlock(&b.lock);
+
+        fwrite(it->out.buf.data, 1, it->out.buf.len, stdout);
+        sink_destroy(&it->out);
+        free(it->src);
+        if (!status) status = it->malformed ? 1 : (int) it->stop;
+    }
+    fflush(stdout);
+
+    pool_wait(p);
+    pool_destroy(p);
+    nf_cache_freeze(false);
+    free(b.items);
+
+    return status;
+}
@@ -0,0 +1,321 @@
+#define _POSIX_C_SOURCE 200809L /* posix_madvise */
+
+#include "../include/binary.h"
+
+#include "../include/expr.h"
+#include "../include/stack.h"
+#include "../include/symbol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* An image is, with every fixed-size number little-endian:
+     header            "LCTB", then the version, the number of symbols
+                       and the size of the name area (32 bits each),
+                       then the number of nodes (64 bits)
+     symbol table      one 32-bit offset into the name area per symbol
+     name area         per symbol, 'I' for an interned symbol or 'G'
+                       for one the parser or reducer generated, then
+                       its text and a NUL
+     nodes             one LEB128 word per node in post-order, argument
+                       before function, with the tag in the low 2 bits
+                       and a payload above it:
+                         VAR  the symbol
+                         ABS  the symbol; the body is the previous node
+                         APP  how many nodes back the argument is; the
+                              function is the previous node
+                         NUM  the numeral
+   The root is the last node. Visiting the argument first keeps the
+   offsets of Church numeral spines, f (f (... x)), at 2, so most
+   words take one byte. Generated symbols come back as aliases, so
+   binders the original kept apart stay apart.                        */
+
+#define BIN_MAGIC          "LCTB"
+#define BIN_HEADER         24
+
+enum { TAG_VAR, TAG_ABS, TAG_APP, TAG_NUM };
+
+static inline uint32 le32(const uint32 v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(v);
+#else
+    return v;
+#endif
+}
+
+static inline uint64 le64(const uint64 v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(v);
+#else
+    return v;
+#endif
+}
+
+static void put32(strbuf *b, const uint32 v) {
+    const uint32 x = le32(v);
+    sb_append(b, (cchar *) &x, sizeof x);
+}
+
+static void put64(strbuf *b, const uint64 v) {
+    const uint64 x = le64(v);
+    sb_append(b, (cchar *) &x, sizeof x);
+}
+
+static void put_varint(strbuf *b, uint64 v) {
+    char t[10];
+    size_t n = 0;
+    do {
+        const byte c = v & 0x7f;
+        v >>= 7;
+        t[n++] = (char)(c | (v ? 0x80 : 0));
+    } while (v);
+    sb_append(b, t, n);
+}
+
+static uint32 get32(const byte *p) {
+    uint32 v;
+    memcpy(&v, p, sizeof v);
+    return le32(v);
+}
+
+static uint64 get64(const byte *p) {
+    uint64 v;
+    memcpy(&v, p, sizeof v);
+    return le64(v);
+}
+
+static bool get_varint(const byte **p, const byte *end, uint64 *v) {
+    *v = 0;
+    for (uint32 shift = 0; *p < end && shift < 64; shift += 7) {
+        const byte c = *(*p)++;
+        *v |= (uint64)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief              The symbol table of an image being written.
+ */
+typedef struct bin_syms {
+    uint32        *index;    /* by symbol ID, UINT32_MAX if not in the table */
+    uint32         n;
+    strbuf         offsets;
+    strbuf         names;
+} bin_syms;
+
+/**
+ * @brief              Get the table index of a symbol, adding it on its
+ *                     first use.
+ */
+static uint32 sym_ref(bin_syms *t, const sym s) {
+    if (t->index[s] != UINT32_MAX) return t->index[s];
+
+    put32(&t->offsets, (uint32) t->names.len);
+    sb_append(&t->names, sym_root(s) == s ? "I" : "G", 1);
+    sb_append(&t->names, sym_name(s), sym_len(s) + 1);
+
+    return t->index[s] = t->n++;
+}
+
+/**
+ * @brief              A node to write, before or after its children.
+ */
+typedef struct bin_item {
+    cexpr         *e;
+    bool           done;
+} bin_item;
+
+bool bin_encode(cexpr *e, strbuf *out) {
+    bin_syms t = {malloc(sym_count() * sizeof(uint32)), 0, {0}, {0}};
+    if (!t.index) {
+        perror("malloc for binary symbol table");
+        exit(1);
+    }
+    memset(t.index, 0xff, sym_count() * sizeof(uint32));
+    sb_init(&t.offsets, 256);
+    sb_init(&t.names, 256);
+    strbuf nodes;
+    sb_init(&nodes, 4096);
+
+    bin_item local[STACK_LOCAL];
+    uint64 ilocal[STACK_LOCAL];
+    bin_item *st = local;
+    uint64 *done = ilocal;     /* post-order numbers of nodes awaiting their parent */
+    size_t cap = STACK_LOCAL, dcap = STACK_LOCAL, sp = 0, dp = 0;
+    uint64 n = 0;
+    bool ok = true;
+
+    st[sp++] = (bin_item){e, false};
+    while (sp) {
+        const bin_item it = st[--sp];
+        cexpr *x = it.e;
+        uint64 w;
+        if (x->type == VAR_expr) w = TAG_VAR | (uint64) sym_ref(&t, x->var_sym) << 2;
+        else if (x->type == NUM_expr) {
+            if (x->num >> 62) {
+                ok = false;
+                break;
+            }
+            w = TAG_NUM | x->num << 2;
+        } else if (!it.done) {
+            if (sp + 3 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+            st[sp++] = (bin_item){x, true};
+            if (x->type == ABS_expr) st[sp++] = (bin_item){x->abs_body, false};
+            else {
+                st[sp++] = (bin_item){x->app_fn, false};
+                st[sp++] = (bin_item){x->app_arg, false};
+            }
+            continue;
+        } else if (x->type == ABS_expr) {
+            w = TAG_ABS | (uint64) sym_ref(&t, x->abs_sym) << 2;
+            dp--;
+        } else {
+            w = TAG_APP | (n - done[dp - 2]) << 2;
+            dp -= 2;
+        }
+        put_varint(&nodes, w);
+        if (dp == dcap) done = stack_grow(done, ilocal, &dcap, sizeof *done);
+        done[dp++] = n++;
+    }
+    if (st != local) free(st);
+    if (done != ilocal) free(done);
+
+    if (ok) {
+        sb_append(out, BIN_MAGIC, 4);
+        put32(out, BIN_VERSION);
+        put32(out, t.n);
+        put32(out, (uint32) t.names.len);
+        put64(out, n);
+        sb_append(out, t.offsets.data, t.offsets.len);
+        sb_append(out, t.names.data, t.names.len);
+        sb_append(out, nodes.data, nodes.len);
+    }
+    free(t.index);
+    sb_destroy(&t.offsets);
+    sb_destroy(&t.names);
+    sb_destroy(&nodes);
+
+    return ok;
+}
+
+/**
+ * @brief              A term built from the nodes read so far, with the
+ *                     post-order number of its root.
+ */
+typedef struct bin_frame {
+    expr          *e;
+    uint64         at;
+} bin_frame;
+
+expr *bin_decode(const byte *p, const size_t len) {
+    if (len < BIN_HEADER || memcmp(p, BIN_MAGIC, 4) != 0 || get32(p + 4) != BIN_VERSION) return NULL;
+
+    const uint64 n_syms = get32(p + 8), names_len = get32(p + 12), n = get64(p + 16);
+    if (4 * n_syms + names_len > len - BIN_HEADER) return NULL;
+    const byte *names = p + BIN_HEADER + 4 * n_syms, *q = names + names_len, *end = p + len;
+    if (n > (uint64)(end - q)) return NULL; // a node takes a byte at least
+
+    sym *syms = malloc((n_syms ? n_syms : 1) * sizeof *syms);
+    if (!syms) {
+        perror("malloc for binary symbols");
+        exit(1);
+    }
+    for (uint64 i = 0; i < n_syms; i++) {
+        const uint32 off = get32(p + BIN_HEADER + 4 * i);
+        const byte *nul = off < names_len ? memchr(names + off, '\0', names_len - off) : NULL;
+        if (!nul || (names[off] != 'I' && names[off] != 'G')) {
+            free(syms);
+            return NULL;
+        }
+        syms[i] = sym_intern_n((cchar *) names + off + 1, (size_t)(nul - names - off - 1));
+        if (names[off] == 'G') syms[i] = sym_alias(syms[i]);
+    }
+
+    bin_frame local[STACK_LOCAL];
+    bin_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    expr *r = NULL;
+
+    uint64 i = 0;
+    for (; i < n; i++) {
+        uint64 w;
+        if (!get_varint(&q, end, &w)) break;
+        const uint64 v = w >> 2;
+        expr *x;
+        switch (w & 3) {
+            case TAG_VAR:
+                if (v >= n_syms) goto done;
+                x = make_var_sym(syms[v]);
+                break;
+            case TAG_NUM:
+                x = make_num(v);
+                break;
+            case TAG_ABS:
+                if (!sp || v >= n_syms) goto done;
+                x = make_abs_sym(syms[v], st[--sp].e);
+                break;
+            default:
+                if (sp < 2 || st[sp - 2].at != i - v) goto done;
+                sp -= 2;
+                x = make_application(st[sp + 1].e, st[sp].e);
+                break;
+        }
+        if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+        st[sp++] = (bin_frame){x, i};
+    }
+    if (sp == 1 && q == end) r = st[0].e;
+
+    done:
+    if (st != local) free(st);
+    free(syms);
+
+    return i == n ? r : NULL;
+}
+
+bool bin_save(cexpr *e, cchar *path) {
+    strbuf b;
+    sb_init(&b, 4096);
+    if (!bin_encode(e, &b)) {
+        sb_destroy(&b);
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0;
+    for (size_t off = 0; ok && off < b.len;) {
+        const ssize_t k = write(fd, b.data + off, b.len - off);
+        if (k < 0 && errno == EINTR) continue;
+        ok = k > 0;
+        if (ok) off += (size_t) k;
+    }
+    if (fd >= 0 && close(fd) != 0) ok = false;
+    sb_destroy(&b);
+
+    return ok;
+}
+
+expr *bin_load(cchar *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat sb;
+    byte *m = fstat(fd, &sb) == 0 && sb.st_size >= BIN_HEADER
+        ? mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+
+    posix_madvise(m, (size_t) sb.st_size, POSIX_MADV_SEQUENTIAL);
+    expr *e = bin_decode(m, (size_t) sb.st_size);
+    munmap(m, (size_t) sb.st_size);
+
+    return e;
+}
@@ -0,0 +1,554 @@
+#include "../include/cache.h"
+
+#include "../include/expr.h"
+#include "../include/fvset.h"
+#include "../include/stack.h"
+#include "../include/strbuf.h"
+#include "../include/symbol.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Terms are encoded in prefix order, one tag byte per node:
+     'A'               application, followed by function and argument
+     'L' [name]        abstraction, followed by its body; the name of
+                       the binder's root symbol is kept in normal forms
+                       only, so keys do not depend on it
+     'V' index         bound variable, by De Bruijn index
+     'F' name          free variable
+     'N' n             numeral
+   Numbers and name lengths are LEB128 varints, names their raw bytes.
+
+   A cache file is NF_MAGIC and NF_VERSION (4 bytes) followed by
+   records: the hash of the key (8 bytes), the lengths of the key and
+   of the encoded normal form (4 bytes each), then the key and the
+   normal form. Fixed-size numbers are little-endian, whatever the
+   machine, and a file of another version is refused.
+
+   The table, the entries added since loading and the file mapping
+   together hold at most NF_CACHE_BYTES; once full, further normal
+   forms are not recorded, and neither the table nor the file grows. */
+
+#define NF_MAGIC           "LCNF"
+#define NF_VERSION         3
+#define NF_HEADER          8
+#define NF_RECORD_HEAD     16
+#define NF_CACHE_BYTES     ((size_t) 64 << 20)
+
+/**
+ * @brief              A cached normal form and the key it is found by,
+ *                     encoded. The bytes live in the file mapping, or
+ *                     in their own allocation for entries added since
+ *                     the file was loaded.
+ */
+typedef struct nf_entry {
+    uint64         hash;
+    const byte    *data;     /* the key, then the normal form; NULL for an empty slot */
+    uint32         key_len;
+    uint32         len;      /* of the normal form */
+    bool           fresh;    /* not in the file yet    */
+    bool           hidden;   /* added while frozen     */
+} nf_entry;
+
+static bool            cache_on;
+static bool            frozen;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static nf_entry       *slots;
+static size_t          n_slots;   /* power of two */
+static nf_cache_stats  stats;
+
+static int             cache_fd = -1;
+static byte           *map;
+static size_t          map_len;
+
+void nf_cache_enable(const bool on) {
+    cache_on = on;
+}
+
+PURE bool nf_cache_enabled(void) {
+    return cache_on;
+}
+
+static inline uint32 le32(const uint32 v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(v);
+#else
+    return v;
+#endif
+}
+
+static inline uint64 le64(const uint64 v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(v);
+#else
+    return v;
+#endif
+}
+
+static void put32(strbuf *b, const uint32 v) {
+    const uint32 x = le32(v);
+    sb_append(b, (cchar *) &x, sizeof x);
+}
+
+static void put64(strbuf *b, const uint64 v) {
+    const uint64 x = le64(v);
+    sb_append(b, (cchar *) &x, sizeof x);
+}
+
+static uint32 get32(const byte *p) {
+    uint32 v;
+    memcpy(&v, p, sizeof v);
+    return le32(v);
+}
+
+static uint64 get64(const byte *p) {
+    uint64 v;
+    memcpy(&v, p, sizeof v);
+    return le64(v);
+}
+
+static void put_varint(strbuf *b, uint64 v) {
+    char t[10];
+    size_t n = 0;
+    do {
+        const byte c = v & 0x7f;
+        v >>= 7;
+        t[n++] = (char)(c | (v ? 0x80 : 0));
+    } while (v);
+    sb_append(b, t, n);
+}
+
+static void put_name(strbuf *b, const sym s) {
+    put_varint(b, sym_len(s));
+    sb_append(b, sym_name(s), sym_len(s));
+}
+
+/**
+ * @brief              A node left to encode and the number of binders
+ *                     around it.
+ */
+typedef struct enc_item {
+    cexpr         *e;
+    uint32         depth;
+} enc_item;
+
+/**
+ * @brief              Encode a term in prefix order.
+ * @param  e           the term
+ * @param  out         the buffer to append to
+ * @param  names       true to keep the names of binders
+ */
+static void encode(cexpr *e, strbuf *out, const bool names) {
+    enc_item local[STACK_LOCAL];
+    sym blocal[STACK_LOCAL];
+    enc_item *st = local;
+    sym *binders = blocal;     /* binders[0..depth) enclose the node */
+    size_t cap = STACK_LOCAL, bcap = STACK_LOCAL, sp = 0;
+
+    st[sp++] = (enc_item){e, 0};
+    while (sp) {
+        const enc_item it = st[--sp];
+        cexpr *n = it.e;
+        switch (n->type) {
+            case VAR_expr: {
+                uint32 i = it.depth;
+                while (i && binders[i - 1] != n->var_sym) i--;
+                if (i) {
+                    sb_append(out, "V", 1);
+                    put_varint(out, it.depth - i);
+                } else {
+                    sb_append(out, "F", 1);
+                    put_name(out, n->var_sym);
+                }
+                break;
+            }
+            case NUM_expr:
+                sb_append(out, "N", 1);
+                put_varint(out, n->num);
+                break;
+            case ABS_expr:
+                sb_append(out, "L", 1);
+                if (names) put_name(out, sym_root(n->abs_sym));
+                if (it.depth == bcap) binders = stack_grow(binders, blocal, &bcap, sizeof *binders);
+                binders[it.depth] = n->abs_sym;
+                if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+                st[sp++] = (enc_item){n->abs_body, it.depth + 1};
+                break;
+            case APP_expr:
+                sb_append(out, "A", 1);
+                if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+                st[sp++] = (enc_item){n->app_arg, it.depth};
+                st[sp++] = (enc_item){n->app_fn, it.depth};
+                break;
+        }
+    }
+    if (st != local) free(st);
+    if (binders != blocal) free(binders);
+}
+
+static bool get_varint(const byte **p, const byte *end, uint64 *v) {
+    *v = 0;
+    for (uint32 shift = 0; *p < end && shift < 64; shift += 7) {
+        const byte c = *(*p)++;
+        *v |= (uint64)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief              An application or abstraction being decoded.
+ */
+typedef struct dec_frame {
+    expr          *fn;       /* APP: the function, once decoded */
+    sym            s;        /* ABS: the binder                 */
+    bool           app;
+} dec_frame;
+
+/**
+ * @brief              Rebuild a term encoded with names. A binder gets
+ *                     the symbol of its name unless an enclosing binder
+ *                     has it already, and then an alias of it.
+ * @return             the term, or NULL if the bytes are not a term
+ */
+static expr *decode(const byte *p, const size_t len) {
+    const byte *end = p + len;
+    dec_frame local[STACK_LOCAL];
+    sym blocal[STACK_LOCAL];
+    dec_frame *st = local;
+    sym *binders = blocal;
+    size_t cap = STACK_LOCAL, bcap = STACK_LOCAL, sp = 0, depth = 0;
+    expr *r = NULL;
+
+    while (p < end) {
+        const byte t = *p++;
+        uint64 v;
+        if (t == 'A' || t == 'L') {
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            if (t == 'A') {
+                st[sp++] = (dec_frame){NULL, 0, true};
+                continue;
+            }
+            if (!get_varint(&p, end, &v) || v > (uint64)(end - p)) break;
+            sym s = sym_intern_n((cchar *) p, (size_t) v);
+            p += v;
+            for (size_t i = 0; i < depth; i++) {
+                if (binders[i] == s) {
+                    s = sym_alias(s);
+                    break;
+                }
+            }
+            if (depth == bcap) binders = stack_grow(binders, blocal, &bcap, sizeof *binders);
+            binders[depth++] = s;
+            st[sp++] = (dec_frame){NULL, s, false};
+            continue;
+        }
+
+        expr *leaf;
+        if (!get_varint(&p, end, &v)) break;
+        if (t == 'V' && v < depth) leaf = make_var_sym(binders[depth - 1 - v]);
+        else if (t == 'N') leaf = make_num(v);
+        else if (t == 'F' && v <= (uint64)(end - p)) {
+            leaf = make_var_sym(sym_intern_n((cchar *) p, (size_t) v));
+            p += v;
+        } else break;
+
+        // Close every node this leaf completes
+        while (sp && (!st[sp - 1].app || st[sp - 1].fn)) {
+            if (st[sp - 1].app) leaf = make_application(st[sp - 1].fn, leaf);
+            else {
+                leaf = make_abs_sym(st[sp - 1].s, leaf);
+                depth--;
+            }
+            sp--;
+        }
+        if (!sp) {
+            r = p == end ? leaf : NULL;
+            break;
+        }
+        st[sp - 1].fn = leaf;
+    }
+    if (st != local) free(st);
+    if (binders != blocal) free(binders);
+
+    return r;
+}
+
+/**
+ * @brief              Hash bytes (FNV-1a, 64 bits).
+ */
+PURE static uint64 hash_bytes(const char *p, const size_t len) {
+    uint64 h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uchar) p[i];
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+/**
+ * @brief              Hash the names of the free variables of a term, in
+ *                     no particular order, so that the hash does not
+ *                     depend on the symbol numbers of this process. A
+ *                     set that does not list its members hashes to 0.
+ */
+PURE static uint64 hash_free(cexpr *e) {
+    if (!fv_exact(e->fv)) return 0;
+    uint64 h = 0;
+    for (uint32 i = 0; i < e->fv->n; i++) h += hash_bytes(sym_name(e->fv->v[i]), sym_len(e->fv->v[i]));
+
+    return h;
+}
+
+/**
+ * @brief              Mix 64 bits (the splitmix64 finalizer).
+ */
+CONST static uint64 mix64(uint64 x) {
+    x = (x ^ x >> 30) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ x >> 27) * 0x94D049BB133111EBull;
+
+    return x ^ x >> 31;
+}
+
+nf_key nf_cache_key(cexpr *e) {
+    // The shape, size and depth of a term are the same for its α-variants
+    const uint64 h = mix64(mix64((uint64) e->shape << 32 | e->depth) ^ e->size) ^ hash_free(e);
+
+    return (nf_key){mix64(h), e, NULL, 0};
+}
+
+void nf_key_encode(nf_key *key) {
+    if (key->data) return;
+    strbuf b;
+    sb_init(&b, 256);
+    encode(key->term, &b, false);
+    key->data = b.data;
+    key->len = b.len;
+}
+
+void nf_key_free(nf_key *key) {
+    free(key->data);
+    key->data = NULL;
+    key->len = 0;
+}
+
+/**
+ * @brief              Find the slot of a key: the entry holding it, or
+ *                     the empty slot it would go to. Entries whose key
+ *                     only has the same hash are passed over. Call with
+ *                     the lock held and the table allocated.
+ * @param  hash        the hash of the key
+ * @param  key         the key
+ * @param  len         its length
+ */
+static nf_entry *find(const uint64 hash, const void *key, const size_t len) {
+    size_t i = (size_t)(hash ^ hash >> 32) & (n_slots - 1);
+    while (slots[i].data && (slots[i].hash != hash || slots[i].key_len != len
+                             || memcmp(slots[i].data, key, len) != 0))
+        i = (i + 1) & (n_slots - 1);
+
+    return &slots[i];
+}
+
+/**
+ * @brief              Check whether an entry has a hash, so that a key
+ *                     with it is worth encoding. Call with the lock held.
+ */
+static bool hash_known(const uint64 hash) {
+    if (!n_slots) return false;
+    size_t i = (size_t)(hash ^ hash >> 32) & (n_slots - 1);
+    for (; slots[i].data; i = (i + 1) & (n_slots - 1))
+        if (slots[i].hash == hash && !slots[i].hidden) return true;
+
+    return false;
+}
+
+/**
+ * @brief              Check whether one more entry fits in NF_CACHE_BYTES,
+ *                     counting the growth of the table it may cause. Call
+ *                     with the lock held.
+ * @param  len         the bytes the entry adds besides its slot
+ */
+static bool fits(const size_t len) {
+    const size_t grow = 2 * (stats.entries + 1) > n_slots ? (n_slots ? n_slots : 1024) * sizeof *slots : 0;
+
+    return stats.bytes + grow + len <= NF_CACHE_BYTES;
+}
+
+/**
+ * @brief              Add an entry whose key is not in the table. Call
+ *                     with the lock held.
+ */
+static void insert(const nf_entry *x) {
+    if (2 * (stats.entries + 1) > n_slots) {
+        nf_entry *old = slots;
+        const size_t old_n = n_slots;
+        n_slots = n_slots ? 2 * n_slots : 1024;
+        slots = calloc(n_slots, sizeof *slots);
+        if (!slots) {
+            perror("calloc for normal-form cache");
+            exit(1);
+        }
+        stats.bytes += (n_slots - old_n) * sizeof *slots;
+        for (size_t i = 0; i < old_n; i++)
+            if (old[i].data) *find(old[i].hash, old[i].data, old[i].key_len) = old[i];
+        free(old);
+    }
+    *find(x->hash, x->data, x->key_len) = *x;
+    stats.entries++;
+}
+
+/**
+ * @brief              Check the header of a mapped cache file.
+ */
+static bool valid_header(const byte *m, const size_t len) {
+    return len >= NF_HEADER && memcmp(m, NF_MAGIC, 4) == 0 && get32(m + 4) == NF_VERSION;
+}
+
+bool nf_cache_open(cchar *path) {
+    const int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    struct stat sb;
+    flock(fd, LOCK_EX);
+    bool ok = fstat(fd, &sb) == 0;
+    if (ok && sb.st_size == 0) {
+        strbuf h;
+        sb_init(&h, NF_HEADER);
+        sb_append(&h, NF_MAGIC, 4);
+        put32(&h, NF_VERSION);
+        ok = write(fd, h.data, h.len) == (ssize_t) h.len && fstat(fd, &sb) == 0;
+        sb_destroy(&h);
+    }
+    byte *m = ok ? mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    flock(fd, LOCK_UN);
+    if (m == MAP_FAILED || !valid_header(m, (size_t) sb.st_size)) {
+        if (m != MAP_FAILED) munmap(m, (size_t) sb.st_size);
+        close(fd);
+        return false;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    cache_fd = fd;
+    map = m;
+    map_len = (size_t) sb.st_size;
+    stats.bytes += map_len;
+    // Index the records; a record cut short by a crash ends the file
+    for (size_t off = NF_HEADER; map_len - off >= NF_RECORD_HEAD && fits(0);) {
+        const byte *r = map + off;
+        nf_entry x = {get64(r), r + NF_RECORD_HEAD, get32(r + 8), get32(r + 12), false, false};
+        if ((uint64) x.key_len + x.len > map_len - off - NF_RECORD_HEAD) break;
+        if (!n_slots || !find(x.hash, x.data, x.key_len)->data) insert(&x);
+        off += NF_RECORD_HEAD + x.key_len + x.len;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return true;
+}
+
+void nf_cache_close(void) {
+    pthread_mutex_lock(&cache_lock);
+    if (cache_fd >= 0) {
+        strbuf b;
+        sb_init(&b, 4096);
+        struct stat sb;
+        flock(cache_fd, LOCK_EX);
+        // Other processes may have appended since the file was mapped
+        size_t room = fstat(cache_fd, &sb) == 0 && (size_t) sb.st_size < NF_CACHE_BYTES
+                          ? NF_CACHE_BYTES - (size_t) sb.st_size : 0;
+        for (size_t i = 0; i < n_slots; i++) {
+            if (!slots[i].data || !slots[i].fresh) continue;
+            const size_t n = NF_RECORD_HEAD + slots[i].key_len + slots[i].len;
+            if (n > room) continue;
+            room -= n;
+            put64(&b, slots[i].hash);
+            put32(&b, slots[i].key_len);
+            put32(&b, slots[i].len);
+            sb_append(&b, (cchar *) slots[i].data, slots[i].key_len + slots[i].len);
+        }
+        if (b.len && (lseek(cache_fd, 0, SEEK_END) < 0 || write(cache_fd, b.data, b.len) != (ssize_t) b.len))
+            perror("writing the normal-form cache");
+        flock(cache_fd, LOCK_UN);
+        sb_destroy(&b);
+        munmap(map, map_len);
+        close(cache_fd);
+        cache_fd = -1;
+        map = NULL;
+        map_len = 0;
+    }
+
+    for (size_t i = 0; i < n_slots; i++) if (slots[i].fresh) free((void *) slots[i].data);
+    free(slots);
+    slots = NULL;
+    n_slots = 0;
+    stats.entries = 0;
+    stats.bytes = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void nf_cache_freeze(const bool on) {
+    pthread_mutex_lock(&cache_lock);
+    frozen = on;
+    if (!on) for (size_t i = 0; i < n_slots; i++) slots[i].hidden = false;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+expr *nf_cache_get(nf_key *key) {
+    pthread_mutex_lock(&cache_lock);
+    bool known = hash_known(key->hash);
+    if (known && !key->data) {
+        // Encode unlocked; the table only grows meanwhile
+        pthread_mutex_unlock(&cache_lock);
+        nf_key_encode(key);
+        pthread_mutex_lock(&cache_lock);
+    }
+    const nf_entry *x = known ? find(key->hash, key->data, key->len) : NULL;
+    const bool hit = x && x->data && !x->hidden;
+    const byte *data = hit ? x->data + x->key_len : NULL;
+    const uint32 len = hit ? x->len : 0;
+    if (hit) stats.hits++;
+    else stats.misses++;
+    pthread_mutex_unlock(&cache_lock);
+
+    // The bytes stay put until nf_cache_close, so decode unlocked
+    return hit ? decode(data, len) : NULL;
+}
+
+void nf_cache_put(nf_key *key, cexpr *nf) {
+    nf_key_encode(key);
+    if (key->len > UINT32_MAX) return;
+    strbuf b;
+    sb_init(&b, key->len + 256);
+    sb_append(&b, key->data, key->len);
+    encode(nf, &b, true);
+    if (b.len - key->len > UINT32_MAX) {
+        sb_destroy(&b);
+        return;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    if ((n_slots && find(key->hash, key->data, key->len)->data) || !fits(b.len)) sb_destroy(&b);
+    else {
+        stats.bytes += b.len;
+        insert(&(nf_entry){key->hash, (const byte *) b.data, (uint32) key->len,
+                            (uint32)(b.len - key->len), true, frozen});
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+nf_cache_stats nf_cache_get_stats(void) {
+    pthread_mutex_lock(&cache_lock);
+    const nf_cache_stats s = stats;
+    pthread_mutex_unlock(&cache_lock);
+
+    return s;
+}
@@ -1,148 +1,762 @@
 #include "../include/expr.h"
 
+#include "../include/arena.h"
+#include "../include/fvset.h"
+#include "../include/sink.h"
+#include "../include/stack.h"
+#include "../include/stats.h"
+#include "../include/symbol.h"
 #include "../include/types.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-expr *make_variable(cchar *n) {
-    expr *e = malloc(sizeof *e);
-    if (!e) {
-        perror("malloc");
+#define GEN_FORWARDED UINT32_MAX
+#define GEN_SEALED    0
+#define NODE_SIZE     ARENA_ALIGN(sizeof(expr))
+#define SHAPE_WALK    16 /* nodes abs_shape follows the binder through */
+
+/* Nodes are bump-allocated from the nursery and never freed one by
+   one. expr_collect evacuates whatever the roots still reach into a
+   fresh to-space (Cheney's algorithm) and drops the old chunks whole.
+   Sealed nodes are permanent and never move. Names are interned, so
+   nodes only carry symbol IDs; the printer looks their text up.
+
+   Every thread has its own nursery and collects it on its own. The
+   sealed nodes are shared and read-only once sealed; they carry
+   GEN_SEALED, which no thread's nursery generation ever equals.     */
+static THREAD_LOCAL arena  nursery      = {NULL, NULL, INIT_ARENA_SIZE, 0, 0};
+static arena               sealed       = {NULL, NULL, INIT_ARENA_SIZE, 0, 0};
+static THREAD_LOCAL uint32 heap_gen     = 1;
+static THREAD_LOCAL size_t gc_threshold = INIT_ARENA_SIZE;
+static THREAD_LOCAL expr_heap_stats heap_stats;
+
+/* Lending: a thread building nodes for another thread's heap parks its
+   own nursery and generation, and hands what it built to handed,
+   which the borrowing thread then appends to its nursery.          */
+static THREAD_LOCAL arena  own_nursery;
+static THREAD_LOCAL uint32 own_gen;
+static arena               handed       = {NULL, NULL, INIT_ARENA_SIZE, 0, 0};
+static pthread_mutex_t     handed_lock  = PTHREAD_MUTEX_INITIALIZER;
+
+/* Hash-consing: when enabled, constructors return the existing node
+   for any (type, symbol, children) they have built before, so equal
+   subterms are one node. Children are already unique, so a lookup only
+   compares them by pointer. The table holds weak references and is
+   rebuilt after every collection. Each thread has its own table,
+   which starts out holding the sealed nodes.                         */
+static bool                hashcons_on;
+static THREAD_LOCAL expr **hc_slots;
+static THREAD_LOCAL size_t hc_cap;   /* power of two */
+static THREAD_LOCAL size_t hc_count;
+
+/* Binders carry generated symbols whose text repeats the name they
+   were written with, so two different variables can print alike. The
+   printer gives each binder its readable root name, adding a numeric
+   suffix only when that would capture a variable its body refers to.
+   shown[s] is the name printed for a binder s in scope, users[x]
+   counts the binders in scope printed as x, and outside[x] is the
+   current print_gen if a variable free in the whole term prints as x. */
+static THREAD_LOCAL sym    *shown;
+static THREAD_LOCAL uint32 *users;
+static THREAD_LOCAL uint32 *outside;
+static THREAD_LOCAL uint32  shown_cap;
+static THREAD_LOCAL uint32  print_gen;
+
+/**
+ * @brief              Pending printer work: a subterm to print, a single
+ *                     character, or a binder name to restore on leaving
+ *                     its scope.
+ */
+typedef struct pr_item {
+    enum { PR_EXPR, PR_CHAR, PR_RESTORE } op;
+    char           c;        /* the character, or a subterm's separator */
+    bool           wrap;     /* parenthesize the subterm                */
+    sym            s;
+    sym            outer;
+    cexpr         *e;
+} pr_item;
+
+static THREAD_LOCAL pr_item *pr_stack;
+static THREAD_LOCAL size_t   pr_cap;
+
+CONST static INLINE uint64 sat_add(const uint64 a, const uint64 b) {
+    return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+CONST static INLINE uint32 deeper(const uint64 d) {
+    return d >= UINT32_MAX ? UINT32_MAX : (uint32) d + 1;
+}
+
+CONST static INLINE uint32 hash_mix(const uint32 h, const uint32 v) {
+    return h ^ (v + 0x9E3779B9u + (h << 6) + (h >> 2));
+}
+
+/**
+ * @brief              Get the shape of an abstraction: that of its body
+ *                     and where in the body the binder occurs. The first
+ *                     SHAPE_WALK nodes on the paths down to its
+ *                     occurrences are mixed in, in preorder, each with
+ *                     the sides of it the binder occurs in, so that for
+ *                     a small body the shape fixes the position, and so
+ *                     the De Bruijn index, of every bound occurrence.
+ *                     Only exact sets are asked, and these answer the
+ *                     same for every α-variant of the term.
+ */
+HOT static INLINE uint32 abs_shape(const sym s, cexpr *b) {
+    uint32 h = hash_mix(ABS_expr + 1, b->shape);
+    cexpr *todo[SHAPE_WALK + 1];
+    size_t n = 0;
+    todo[n++] = b;
+
+    for (size_t seen = 0; n && seen < SHAPE_WALK; seen++) {
+        cexpr *e = todo[--n];
+        if (!fv_exact(e->fv)) {
+            h = hash_mix(h, 8);
+            continue;
+        }
+        if (!fv_has(e->fv, s)) {
+            h = hash_mix(h, 0); // only the body itself can lack it
+            continue;
+        }
+        if (e->type == VAR_expr) h = hash_mix(h, 1);
+        else if (e->type == ABS_expr) {
+            h = hash_mix(h, 2);
+            todo[n++] = e->abs_body;
+        } else {
+            const bool fn = fv_has(e->app_fn->fv, s), arg = fv_has(e->app_arg->fv, s);
+            h = hash_mix(h, 3 + (uint32) fn + 2 * (uint32) arg);
+            if (arg) todo[n++] = e->app_arg;
+            if (fn) todo[n++] = e->app_fn;
+        }
+    }
+
+    return h;
+}
+
+HOT static INLINE bool hc_match(cexpr *e, const exprType t, const sym s, cexpr *a, cexpr *b,
+                                const uint64 n) {
+    if (e->type != t) return false;
+
+    switch (t) {
+        case VAR_expr: return e->var_sym == s;
+        case ABS_expr: return e->abs_sym == s && e->abs_body == a;
+        case APP_expr: return e->app_fn == a && e->app_arg == b;
+        case NUM_expr: return e->num == n;
+    }
+
+    return false;
+}
+
+HOT static size_t hc_probe(const uint32 h, const exprType t, const sym s, cexpr *a, cexpr *b,
+                           const uint64 n) {
+    size_t j = h & (hc_cap - 1);
+    while (hc_slots[j]) {
+        if (hc_slots[j]->hash == h && hc_match(hc_slots[j], t, s, a, b, n)) return j;
+        j = (j + 1) & (hc_cap - 1);
+    }
+
+    return j;
+}
+
+static void hc_insert(expr *e) {
+    size_t j = e->hash & (hc_cap - 1);
+    while (hc_slots[j]) j = (j + 1) & (hc_cap - 1);
+    hc_slots[j] = e;
+    hc_count++;
+}
+
+/**
+ * @brief              Rebuild the table with the given capacity, keeping
+ *                     the entries keep() maps to a non-NULL node.
+ */
+static void hc_rebuild(const size_t cap, expr *(*keep)(expr *, uint32), const uint32 from) {
+    expr **old = hc_slots;
+    const size_t old_cap = hc_cap;
+    hc_slots = calloc(cap, sizeof *hc_slots);
+    if (!hc_slots) {
+        perror("calloc for hash-cons table");
         exit(1);
     }
-    e->type = VAR_expr;
-    e->var_name = strdup(n);
+    hc_cap = cap;
+    hc_count = 0;
+    for (size_t i = 0; i < old_cap; i++) {
+        expr *e = old[i] ? keep(old[i], from) : NULL;
+        if (e) hc_insert(e);
+    }
+    free(old);
+}
 
+static expr *hc_keep_all(expr *e, const uint32 from) {
+    (void) from;
     return e;
 }
 
-expr *make_abstraction(cchar *p, cexpr *b) {
-    expr *e = malloc(sizeof *e);
-    if (!e) {
-        perror("malloc");
-        exit(1);
+/**
+ * @brief              Start this thread's table with the sealed nodes,
+ *                     so that terms built here share them too.
+ */
+static void hc_seed(void) {
+    size_t cap = 1024;
+    while (cap < 2 * (sealed.bytes / NODE_SIZE + 1)) cap *= 2;
+    hc_rebuild(cap, hc_keep_all, 0);
+    for (const arena_chunk *c = sealed.first; c; c = c->next)
+        for (size_t off = 0; off < c->used; off += NODE_SIZE) hc_insert((expr *)(c->data + off));
+}
+
+static expr *hc_keep_live(expr *e, const uint32 from) {
+    if (e->gen == GEN_FORWARDED) return e->app_fn;
+
+    return e->gen == from ? NULL : e;
+}
+
+/**
+ * @brief              Find or allocate a node. The caller fills in the
+ *                     fields of a freshly allocated node.
+ * @param  fresh       set to true if the node is new
+ */
+HOT static INLINE expr *node_get(const exprType t, const uint32 h, const sym s,
+                                 cexpr *a, cexpr *b, const uint64 n, bool *fresh) {
+    size_t j = 0;
+    if (hashcons_on) {
+        if (!hc_cap) hc_seed();
+        if (2 * (hc_count + 1) > hc_cap) hc_rebuild(2 * hc_cap, hc_keep_all, 0);
+        j = hc_probe(h, t, s, a, b, n);
+        if (hc_slots[j]) {
+            heap_stats.hashcons_hits++;
+            *fresh = false;
+            return hc_slots[j];
+        }
+    }
+
+    expr *e = arena_alloc(&nursery, sizeof *e);
+    e->type = t;
+    e->gen = heap_gen;
+    e->hash = h;
+    heap_stats.nodes_allocated++;
+    heap_stats.bytes_allocated += NODE_SIZE;
+    if (hashcons_on) {
+        hc_slots[j] = e;
+        hc_count++;
     }
-    e->type = ABS_expr;
-    e->abs_param = strdup(p);
-    e->abs_body = (expr *)b;
+    *fresh = true;
 
     return e;
 }
 
+HOT expr *make_var_sym(const sym s) {
+    bool fresh;
+    expr *e = node_get(VAR_expr, hash_mix(VAR_expr + 1, s), s, NULL, NULL, 0, &fresh);
+    if (fresh) {
+        e->var_sym = s;
+        e->fv = fv_single(s);
+        e->size = e->depth = 1;
+        e->shape = VAR_expr + 1; // bound or free, a name is not part of it
+    }
+
+    return e;
+}
+
+HOT expr *make_abs_sym(const sym s, cexpr *b) {
+    bool fresh;
+    expr *e = node_get(ABS_expr, hash_mix(hash_mix(ABS_expr + 1, s), b->hash), s, b, NULL, 0, &fresh);
+    if (fresh) {
+        e->abs_sym = s;
+        e->abs_body = (expr *)b;
+        e->fv = fv_remove(b->fv, s);
+        e->size = sat_add(b->size, 1);
+        e->depth = deeper(b->depth);
+        e->shape = abs_shape(s, b);
+    }
+
+    return e;
+}
+
+HOT expr *make_num(const uint64 n) {
+    bool fresh;
+    const uint32 h = hash_mix(hash_mix(NUM_expr + 1, (uint32) n), (uint32)(n >> 32));
+    expr *e = node_get(NUM_expr, h, 0, NULL, NULL, n, &fresh);
+    if (fresh) {
+        e->num = n;
+        e->fv = fv_empty();
+        e->size = sat_add(sat_add(n, n), 3); // λf.λx.f (f (... x))
+        e->depth = deeper(sat_add(n, 2));
+        e->shape = h;
+    }
+
+    return e;
+}
+
+expr *num_expand(cexpr *e) {
+    const sym f = sym_intern("f");
+    const sym x = sym_intern("x");
+    expr *body = make_var_sym(x);
+    for (uint64 i = 0; i < e->num; i++) body = make_application(make_var_sym(f), body);
+    cexpr *abs_x = make_abs_sym(x, body);
+
+    return make_abs_sym(f, abs_x);
+}
+
+expr *make_variable(cchar *n) {
+    return make_var_sym(sym_intern(n));
+}
+
+expr *make_abstraction(cchar *p, cexpr *b) {
+    return make_abs_sym(sym_intern(p), b);
+}
+
 expr *make_application(expr *f, expr *a) {
-    expr *e = malloc(sizeof *e);
-    if (!e) {
-        perror("malloc");
-        exit(1);
+    bool fresh;
+    expr *e = node_get(APP_expr, hash_mix(hash_mix(APP_expr + 1, f->hash), a->hash), 0, f, a, 0, &fresh);
+    if (fresh) {
+        e->app_fn = f;
+        e->app_arg = a;
+        e->fv = fv_union(f->fv, a->fv);
+        e->size = sat_add(sat_add(f->size, a->size), 1);
+        e->depth = deeper(f->depth > a->depth ? f->depth : a->depth);
+        e->shape = hash_mix(hash_mix(APP_expr + 1, f->shape), a->shape);
     }
-    e->type = APP_expr;
-    e->app_fn = f;
-    e->app_arg = a;
 
     return e;
 }
 
+void expr_hashcons(const bool on) {
+    hashcons_on = on;
+    if (!on) {
+        free(hc_slots);
+        hc_slots = NULL;
+        hc_cap = hc_count = 0;
+    }
+}
+
+PURE bool expr_hashcons_enabled(void) {
+    return hashcons_on;
+}
+
 void free_expr(expr *e) {
-    if (!e) return;
-
-    switch (e->type) {
-        case VAR_expr:
-            free(e->var_name);
-            break;
-        case ABS_expr:
-            free(e->abs_param);
-            free_expr(e->abs_body);
-            break;
-        case APP_expr:
-            free_expr(e->app_fn);
-            free_expr(e->app_arg);
-            break;
-    }
-    free(e);
-}
-/* TODO: This is an inefficient implementation, as it does not handle
-         optimize for performance. Consider using a more efficient
-         algorithm for copying expressions, such as a hash table to
-         store already copied expressions. This is a simple
-         implementation that works for most cases but is not optimal
-         for large or complex expressions. */
+    /* Nodes belong to the node arena and are reclaimed wholesale by
+       expr_collect or expr_heap_destroy. */
+    (void) e;
+}
+
+static expr *evacuate(expr *e, const uint32 from, arena *to) {
+    if (!e) return NULL;
+    if (e->gen == GEN_FORWARDED) return e->app_fn;
+    if (e->gen != from) return e; // sealed
+
+    expr *c = arena_alloc(to, sizeof *c);
+    *c = *e;
+    c->gen = heap_gen;
+    e->gen = GEN_FORWARDED;
+    e->app_fn = c;
+
+    return c;
+}
+
+void expr_collect(expr **roots, const size_t n) {
+    const uint32 from = heap_gen++;
+    const size_t before = nursery.bytes / NODE_SIZE;
+    if (before > heap_stats.nodes_peak) heap_stats.nodes_peak = before;
+    arena to = {NULL, NULL, INIT_ARENA_SIZE, 0, 0};
+
+    for (size_t i = 0; i < n; i++) roots[i] = evacuate(roots[i], from, &to);
+
+    // Cheney scan: every node in to-space is fixed up exactly once, and
+    // its free-variable set moves with it
+    fv_move_begin();
+    for (const arena_chunk *c = to.first; c; c = c->next) {
+        for (size_t off = 0; off < c->used; off += NODE_SIZE) {
+            expr *e = (expr *)(c->data + off);
+            if (e->type == ABS_expr) e->abs_body = evacuate(e->abs_body, from, &to);
+            else if (e->type == APP_expr) {
+                e->app_fn = evacuate(e->app_fn, from, &to);
+                e->app_arg = evacuate(e->app_arg, from, &to);
+            }
+            e->fv = fv_move(e->fv);
+        }
+    }
+    fv_move_end();
+
+    if (hashcons_on) hc_rebuild(hc_cap, hc_keep_live, from);
+    arena_destroy(&nursery);
+    nursery = to;
+
+    heap_stats.collections++;
+    heap_stats.nodes_live = to.bytes / NODE_SIZE;
+    heap_stats.nodes_freed += before - heap_stats.nodes_live;
+    gc_threshold = 2 * to.bytes;
+    if (gc_threshold < INIT_ARENA_SIZE) gc_threshold = INIT_ARENA_SIZE;
+}
+
+bool expr_collect_maybe(expr **roots, const size_t n) {
+    if (nursery.bytes < gc_threshold) return false;
+    expr_collect(roots, n);
+
+    return true;
+}
+
+void expr_heap_seal(void) {
+    for (arena_chunk *c = nursery.first; c; c = c->next)
+        for (size_t off = 0; off < c->used; off += NODE_SIZE) ((expr *)(c->data + off))->gen = GEN_SEALED;
+    arena_append(&sealed, &nursery);
+    fv_seal();
+    heap_gen++;
+    gc_threshold = INIT_ARENA_SIZE;
+}
+
+void expr_heap_release(void) {
+    free(hc_slots);
+    hc_slots = NULL;
+    hc_cap = hc_count = 0;
+    heap_stats.nodes_freed += nursery.bytes / NODE_SIZE;
+    arena_destroy(&nursery);
+    fv_table_destroy();
+    free(shown);
+    free(users);
+    free(outside);
+    free(pr_stack);
+    shown = NULL;
+    users = NULL;
+    outside = NULL;
+    pr_stack = NULL;
+    shown_cap = pr_cap = 0;
+    heap_gen++;
+    gc_threshold = INIT_ARENA_SIZE;
+}
+
+void expr_heap_destroy(void) {
+    expr_heap_release();
+    arena_destroy(&sealed);
+    fv_destroy();
+}
+
+uint32 expr_heap_generation(void) {
+    return heap_gen;
+}
+
+void expr_heap_lend(const uint32 gen) {
+    own_nursery = nursery;
+    own_gen = heap_gen;
+    arena_init(&nursery, LEND_ARENA_SIZE);
+    heap_gen = gen;
+    fv_lend();
+}
+
+void expr_heap_unlend(void) {
+    arena_disown(&nursery);
+    pthread_mutex_lock(&handed_lock);
+    arena_append(&handed, &nursery);
+    pthread_mutex_unlock(&handed_lock);
+    nursery = own_nursery;
+    heap_gen = own_gen;
+    fv_unlend();
+}
+
+void expr_heap_adopt(void) {
+    pthread_mutex_lock(&handed_lock);
+    arena_own(&handed);
+    arena_append(&nursery, &handed);
+    pthread_mutex_unlock(&handed_lock);
+    fv_adopt();
+}
+
+expr_heap_stats expr_heap_get_stats(void) {
+    expr_heap_stats s = heap_stats;
+    s.bytes_reserved = nursery.reserved + sealed.reserved + fv_reserved();
+    s.nodes_unique = hc_count;
+    if (nursery.bytes / NODE_SIZE > s.nodes_peak) s.nodes_peak = nursery.bytes / NODE_SIZE;
+
+    return s;
+}
+/**
+ * @brief              A node being rebuilt and the function part of it
+ *                     done so far.
+ */
+typedef struct rb_frame {
+    cexpr         *e;
+    expr          *fn;       /* APP: the rebuilt function */
+    enum { RB_BODY, RB_FN, RB_ARG } stage;
+} rb_frame;
+
+/**
+ * @brief              Rebuild a term bottom-up with an explicit stack.
+ *                     leaf is asked first about every node; a result
+ *                     stands for the whole subterm, NULL means rebuild
+ *                     the node from its rebuilt children.
+ */
+static expr *rebuild(cexpr *e, expr *(*leaf)(cexpr *)) {
+    rb_frame local[STACK_LOCAL];
+    rb_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    cexpr *n = e;
+    expr *r;
+
+    while (true) {
+        // Down the leftmost path to a node leaf settles
+        while (!(r = leaf(n))) {
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            if (n->type == ABS_expr) {
+                st[sp++] = (rb_frame){n, NULL, RB_BODY};
+                n = n->abs_body;
+            } else {
+                st[sp++] = (rb_frame){n, NULL, RB_FN};
+                n = n->app_fn;
+            }
+        }
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            rb_frame *f = &st[sp - 1];
+            if (f->stage == RB_FN) {
+                f->fn = r;
+                f->stage = RB_ARG;
+                n = f->e->app_arg;
+                break;
+            }
+            r = f->stage == RB_ARG ? make_application(f->fn, r) : make_abs_sym(f->e->abs_sym, r);
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+
+    return r;
+}
+
+static expr *copy_leaf(cexpr *e) {
+    if (e->type == VAR_expr) return make_var_sym(e->var_sym);
+    if (e->type == NUM_expr) return make_num(e->num);
+
+    return NULL;
+}
+
 PURE expr *copy_expr(expr *e) {
     if (!e) return NULL;
+    if (hashcons_on) return e; // every node is already shared
+
+    const size_t before = heap_stats.bytes_allocated;
+    expr *r = rebuild(e, copy_leaf);
+    stats_copied(heap_stats.bytes_allocated - before);
+
+    return r;
+}
 
-    switch (e->type) {
-        case VAR_expr:
-            return make_variable(e->var_name);
-        case ABS_expr:
-            return make_abstraction(e->abs_param, copy_expr(e->abs_body));
-        case APP_expr:
-            return make_application(copy_expr(e->app_fn), copy_expr(e->app_arg));
+expr *church(const uint64 n) {
+    return make_num(n);
+}
+
+/**
+ * @brief              Get the name a variable prints as.
+ */
+HOT static INLINE sym shown_name(const sym s) {
+    if (s < shown_cap && shown[s] != SYM_NONE) return shown[s];
+    const sym r = sym_root(s);
+
+    return sym_name(s) == sym_name(r) ? r : sym_intern_n(sym_name(s), sym_len(s));
+}
+
+/**
+ * @brief              The question name_taken puts to every free
+ *                     variable of an approximate body.
+ */
+typedef struct taken_query {
+    sym            b;
+    sym            name;
+} taken_query;
+
+static bool prints_as(void *ctx, const sym v) {
+    const taken_query *q = ctx;
+
+    return v != q->b && shown_name(v) == q->name;
+}
+
+/**
+ * @brief              Check whether a variable free in a body other than
+ *                     b prints as name.
+ */
+static bool name_taken(cexpr *body, const sym b, const sym name) {
+    const fvset *fv = body->fv;
+    if (fv_exact(fv)) {
+        for (uint32 i = 0; i < fv->n; i++) if (fv->v[i] != b && shown_name(fv->v[i]) == name) return true;
+        return false;
     }
+    // Only a variable bound by a binder shown as name, or one free in
+    // the whole term that prints so, can; otherwise skip the walk
+    if (name >= shown_cap || (!users[name] && outside[name] != print_gen)) return false;
 
-    return NULL; // unreachable
+    taken_query q = {b, name};
+    return fv_each(body, prints_as, &q);
 }
 
-expr *church(const int n) {
-    expr *body = make_variable("x");
-    for (int i = 0; i < n; i++) {
-        expr *fv = make_variable("f");
-        body = make_application(fv, body);
+/**
+ * @brief              Pick the name a binder prints as.
+ */
+static sym binder_name(cexpr *e) {
+    const sym root = sym_root(e->abs_sym);
+    sym name = root;
+    for (int k = 1;; k++) {
+        if (!name_taken(e->abs_body, e->abs_sym, name)) return name;
+
+        char buf[64];
+        snprintf(buf, sizeof buf, "%s%d", sym_name(root), k);
+        name = sym_intern(buf);
     }
-    cexpr *abs_x = make_abstraction("x", body);
+}
 
-    return make_abstraction("f", abs_x);
+HOT static INLINE void put_name(sink *out, const sym s) {
+    sink_write(out, sym_name(s), sym_len(s));
 }
 
-HOT void expr_to_buffer_rec(cexpr *e, char *buf, size_t *pos, const size_t cap) {
-    if (*pos >= cap - 1) return;
+/**
+ * @brief              Print a numeral node as the abstraction it stands
+ *                     for, without building it.
+ */
+static void num_write(sink *out, const uint64 n) {
+    sink_puts(out, "λf.(λx.");
+    for (uint64 i = 1; i < n; i++) sink_write(out, "f (", 3);
+    if (n) sink_write(out, "f x", 3);
+    else sink_putc(out, 'x');
+    for (uint64 i = 1; i < n; i++) sink_putc(out, ')');
+    sink_putc(out, ')');
+}
 
-    switch (e->type) {
-        case VAR_expr: {
-            size_t L = strlen(e->var_name);
-            if (*pos + L > cap - 1) L = cap - 1 - *pos;
-            memcpy(buf + *pos, e->var_name, L);
-            *pos += L;
-            break;
+HOT static INLINE void pr_push(size_t *sp, const pr_item it) {
+    if (*sp == pr_cap) {
+        pr_cap = pr_cap ? 2 * pr_cap : 256;
+        pr_stack = realloc(pr_stack, sizeof *pr_stack * pr_cap);
+        if (!pr_stack) {
+            perror("realloc for printer stack");
+            exit(1);
         }
+    }
+    pr_stack[(*sp)++] = it;
+}
 
-        case ABS_expr: {
-            // UTF-8 'λ' = 0xCE 0xBB
-            if (*pos + 2 < cap - 1) {
-                buf[(*pos)++] = (char) 0xCE;
-                buf[(*pos)++] = (char) 0xBB;
-            }
-            size_t L = strlen(e->abs_param);
-            if (*pos + L > cap - 1) L = cap - 1 - *pos;
-            memcpy(buf + *pos, e->abs_param, L);
-            *pos += L;
-            if (*pos < cap - 1) buf[(*pos)++] = '.';
-            if (e->abs_body->type == ABS_expr) {
-                if (*pos < cap - 1) buf[(*pos)++] = '(';
-                expr_to_buffer_rec(e->abs_body, buf, pos, cap);
-                if (*pos < cap - 1) buf[(*pos)++] = ')';
-            } else expr_to_buffer_rec(e->abs_body, buf, pos, cap);
-            break;
+HOT static INLINE void pr_push_char(size_t *sp, const char c) {
+    pr_push(sp, (pr_item){PR_CHAR, c, false, 0, 0, NULL});
+}
+
+static void shown_reserve(const sym b) {
+    if (b < shown_cap) return;
+    const uint32 n = sym_count();
+    shown = realloc(shown, sizeof *shown * n);
+    users = realloc(users, sizeof *users * n);
+    outside = realloc(outside, sizeof *outside * n);
+    if (!shown || !users || !outside) {
+        perror("realloc for printer names");
+        exit(1);
+    }
+    memset(shown + shown_cap, 0xFF, sizeof *shown * (n - shown_cap));
+    memset(users + shown_cap, 0, sizeof *users * (n - shown_cap));
+    memset(outside + shown_cap, 0, sizeof *outside * (n - shown_cap));
+    shown_cap = n;
+}
+
+static bool mark_outside(void *ctx, const sym v) {
+    (void) ctx;
+    const sym name = shown_name(v);
+    shown_reserve(name);
+    outside[name] = print_gen;
+
+    return false;
+}
+
+HOT void expr_write(sink *out, cexpr *e) {
+    // An approximate body needs to know what the free variables print as
+    print_gen++;
+    if (!fv_exact(e->fv)) fv_each(e, mark_outside, NULL);
+
+    size_t sp = 0;
+    pr_push(&sp, (pr_item){PR_EXPR, 0, false, 0, 0, e});
+
+    while (sp) {
+        const pr_item it = pr_stack[--sp];
+        if (it.op == PR_CHAR) {
+            sink_putc(out, it.c);
+            continue;
+        }
+        if (it.op == PR_RESTORE) {
+            users[shown[it.s]]--;
+            shown[it.s] = it.outer;
+            continue;
         }
 
-        case APP_expr: {
-            if (e->app_fn->type == ABS_expr) {
-                if (*pos < cap - 1) buf[(*pos)++] = '(';
-                expr_to_buffer_rec(e->app_fn, buf, pos, cap);
-                if (*pos < cap - 1) buf[(*pos)++] = ')';
-            } else expr_to_buffer_rec(e->app_fn, buf, pos, cap);
-            if (*pos < cap - 1) buf[(*pos)++] = ' ';
-            if (e->app_arg->type != VAR_expr) {
-                if (*pos < cap - 1) buf[(*pos)++] = '(';
-                expr_to_buffer_rec(e->app_arg, buf, pos, cap);
-                if (*pos < cap - 1) buf[(*pos)++] = ')';
-            } else expr_to_buffer_rec(e->app_arg, buf, pos, cap);
-            break;
+        // Bodies and functions are printed in place; only arguments, closing
+        // parentheses and binder restores wait on the stack
+        if (it.c) sink_putc(out, it.c);
+        bool wrap = it.wrap;
+        for (e = it.e; e;) {
+            if (wrap) {
+                sink_putc(out, '(');
+                pr_push_char(&sp, ')');
+            }
+            switch (e->type) {
+                case VAR_expr:
+                    put_name(out, shown_name(e->var_sym));
+                    e = NULL;
+                    break;
+
+                case ABS_expr: {
+                    const sym b = e->abs_sym;
+                    shown_reserve(b);
+                    const sym name = binder_name(e);
+                    shown_reserve(name);
+                    pr_push(&sp, (pr_item){PR_RESTORE, 0, false, b, shown[b], NULL});
+                    shown[b] = name;
+                    users[name]++;
+
+                    sink_write(out, "λ", sizeof "λ" - 1); // UTF-8 0xCE 0xBB
+                    put_name(out, name);
+                    sink_putc(out, '.');
+                    e = e->abs_body;
+                    wrap = e->type == ABS_expr || e->type == NUM_expr;
+                    break;
+                }
+
+                case NUM_expr:
+                    num_write(out, e->num);
+                    e = NULL;
+                    break;
+
+                case APP_expr: {
+                    cexpr *arg = e->app_arg;
+                    pr_push(&sp, (pr_item){PR_EXPR, ' ', arg->type != VAR_expr, 0, 0, arg});
+                    e = e->app_fn;
+                    wrap = e->type == ABS_expr || e->type == NUM_expr;
+                    break;
+                }
+            }
         }
     }
 }
 
+/**
+ * @brief              A fixed buffer being filled by a sink, dropping
+ *                     whatever does not fit.
+ */
+typedef struct fixed_buf {
+    char          *buf;
+    size_t        *pos;
+    size_t         cap;
+} fixed_buf;
+
+static void write_fixed(void *ctx, cchar *data, size_t len) {
+    const fixed_buf *f = ctx;
+    if (*f->pos >= f->cap - 1) return;
+    if (*f->pos + len > f->cap - 1) len = f->cap - 1 - *f->pos;
+    memcpy(f->buf + *f->pos, data, len);
+    *f->pos += len;
+}
+
+void expr_to_buffer_rec(cexpr *e, char *buf, size_t *pos, const size_t cap) {
+    fixed_buf f = {buf, pos, cap};
+    sink out;
+    sink_init_fn(&out, write_fixed, &f);
+    expr_write(&out, e);
+    sink_destroy(&out);
+}
+
 void expr_to_buffer(cexpr *e, char *buf, const size_t cap) {
     size_t pos = 0;
     expr_to_buffer_rec(e, buf, &pos, cap);
@@ -150,28 +764,30 @@ void expr_to_buffer(cexpr *e, char *buf, const size_t cap) {
 }
 
 PURE bool is_church_numeral(cexpr *e) {
+    if (e->type == NUM_expr) return true;
     if (e->type != ABS_expr) return false;
     cexpr *e1 = e->abs_body;
     if (e1->type != ABS_expr) return false;
-    cchar *f = e->abs_param;
-    cchar *x = e1->abs_param;
+    const sym f = e->abs_sym;
+    const sym x = e1->abs_sym;
     cexpr *current_expr = e1->abs_body;
     
     while ((current_expr->type == APP_expr) &&
            (current_expr->app_fn->type == VAR_expr) &&
-           (!strcmp(current_expr->app_fn->var_name, f))) {
+           (current_expr->app_fn->var_sym == f)) {
         current_expr = current_expr->app_arg;
     }
 
-    return current_expr->type == VAR_expr && !strcmp(current_expr->var_name, x);
+    return current_expr->type == VAR_expr && current_expr->var_sym == x;
 }
 
-PURE int count_applications(cexpr *e) {
+PURE uint64 count_applications(cexpr *e) {
+    if (e->type == NUM_expr) return e->num;
     cexpr *cur = e->abs_body->abs_body;
-    cchar *f = e->abs_param;
-    int n = 0;
+    const sym f = e->abs_sym;
+    uint64 n = 0;
     while ((cur->type == APP_expr) && (cur->app_fn->type == VAR_expr)
-                                   && (!strcmp(cur->app_fn->var_name, f))) {
+                                   && (cur->app_fn->var_sym == f)) {
         n++;
         cur = cur->app_arg;
     }
@@ -179,17 +795,17 @@ PURE int count_applications(cexpr *e) {
     return n;
 }
 
-expr *abstract_numerals(cexpr *e) {
+static expr *numeral_leaf(cexpr *e) {
     if (is_church_numeral(e)) {
-        const int n = count_applications(e);
         char buf[32];
-        snprintf(buf, sizeof(buf), "%d", n);
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long) count_applications(e));
         return make_variable(buf);
     }
-    if (e->type == ABS_expr) 
-        return make_abstraction(e->abs_param, abstract_numerals(e->abs_body));
-    if (e->type == APP_expr) 
-        return make_application(abstract_numerals(e->app_fn), abstract_numerals(e->app_arg));
+    if (e->type == VAR_expr) return make_var_sym(e->var_sym);
 
-    return make_variable(e->var_name);
+    return NULL;
+}
+
+expr *abstract_numerals(cexpr *e) {
+    return rebuild(e, numeral_leaf);
 }
@@ -0,0 +1,400 @@
+#include "../include/fvset.h"
+
+#include "../include/arena.h"
+#include "../include/stack.h"
+#include "../include/symbol.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FV_CACHE_SIZE 4096 /* power of two */
+#define FV_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief              This thread's interned sets: the arena holding
+ *                     them and the table finding them.
+ */
+typedef struct fv_state {
+    arena          mem;
+    const fvset  **slots;    /* open addressing, NULL when empty */
+    uint32         n_slots;  /* power of two                     */
+    uint32         n_sets;
+} fv_state;
+
+/* Every thread interns its own sets. A set made on another thread,
+   such as those of the sealed definitions, is still a valid operand;
+   an equal set interned here is merely a different pointer. Sets are
+   only reclaimed by fv_move_end, when expr_collect has moved every
+   live one, and by fv_table_destroy.                                 */
+static const fvset               empty_set = {0, 0, 0, 1};
+static THREAD_LOCAL fv_state     cur       = {{NULL, NULL, FV_CHUNK_SIZE, 0, 0}, NULL, 0, 0};
+static THREAD_LOCAL arena        moving;   /* the sets fv_move copies from */
+static THREAD_LOCAL fv_state     own;      /* parked while lending         */
+static THREAD_LOCAL sym         *scratch;
+static THREAD_LOCAL uint32       scratch_cap;
+static THREAD_LOCAL uint32      *inner;    /* binders of each symbol on the path */
+static THREAD_LOCAL uint32       inner_cap;
+static arena                     sealed_mem = {NULL, NULL, FV_CHUNK_SIZE, 0, 0};
+static arena                     handed     = {NULL, NULL, FV_CHUNK_SIZE, 0, 0};
+static pthread_mutex_t           handed_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Most nodes are built from the same few sets over and over, so the
+   last results of union, remove and single are kept in direct-mapped
+   caches keyed by the operands. An entry only counts if it was made in
+   the current epoch, which moves on whenever sets are released or
+   swapped out, so the caches never need clearing.                    */
+static THREAD_LOCAL uint32 epoch = 1;
+static THREAD_LOCAL struct { const fvset *a, *b, *r; uint32 epoch; } union_cache[FV_CACHE_SIZE];
+static THREAD_LOCAL struct { const fvset *a; sym s; uint32 epoch; const fvset *r; } remove_cache[FV_CACHE_SIZE];
+static THREAD_LOCAL struct { sym s; uint32 epoch; const fvset *r; } single_cache[FV_CACHE_SIZE];
+
+CONST static INLINE uint32 ptr_hash(const void *p, const uint32 k) {
+    const uint64 x = ((uint64)(uintptr_t)p ^ (uint64)k * 0x9E3779B97F4A7C15u) * 0xBF58476D1CE4E5B9u;
+
+    return (uint32)(x >> 32) & (FV_CACHE_SIZE - 1);
+}
+
+CONST static INLINE uint64 bloom_bit(const sym s) {
+    return (uint64) 1 << ((s * 0x9E3779B9u) >> 26);
+}
+
+PURE static INLINE uint32 set_hash(const sym *v, const uint32 n) {
+    uint32 h = 2166136261u; // FNV-1a over the symbols
+    for (uint32 i = 0; i < n; i++) {
+        h ^= v[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+CONST static INLINE uint32 bloom_hash(const uint64 bloom) {
+    return (uint32)((bloom * 0x9E3779B97F4A7C15u) >> 32);
+}
+
+CONST static INLINE size_t set_bytes(const uint32 n) {
+    return sizeof(fvset) + (n == FV_MANY ? 0 : sizeof(sym) * n);
+}
+
+static void fv_rehash(const uint32 new_slots) {
+    const fvset **t = calloc(new_slots, sizeof *t);
+    if (!t) {
+        perror("calloc for free-variable sets");
+        exit(1);
+    }
+    for (uint32 i = 0; i < cur.n_slots; i++) {
+        if (!cur.slots[i]) continue;
+        uint32 j = cur.slots[i]->hash & (new_slots - 1);
+        while (t[j]) j = (j + 1) & (new_slots - 1);
+        t[j] = cur.slots[i];
+    }
+    free(cur.slots);
+    cur.slots = t;
+    cur.n_slots = new_slots;
+}
+
+/**
+ * @brief              Find or create the set with the given sorted
+ *                     members, or the approximate set with the given
+ *                     filter if n is FV_MANY.
+ */
+HOT static const fvset *fv_intern(const sym *v, const uint32 n, const uint64 bloom, const uint32 h) {
+    if (!n) return &empty_set;
+    if (2 * (cur.n_sets + 1) > cur.n_slots) fv_rehash(cur.n_slots ? 2 * cur.n_slots : 256);
+
+    uint32 j = h & (cur.n_slots - 1);
+    while (cur.slots[j]) {
+        const fvset *s = cur.slots[j];
+        if (s->hash == h && s->n == n && s->bloom == bloom
+            && (n == FV_MANY || !memcmp(s->v, v, sizeof *v * n))) return s;
+        j = (j + 1) & (cur.n_slots - 1);
+    }
+
+    fvset *s = arena_alloc(&cur.mem, set_bytes(n));
+    s->n = n;
+    s->hash = h;
+    s->bloom = bloom;
+    s->sealed = 0;
+    if (n != FV_MANY) memcpy(s->v, v, sizeof *v * n);
+    cur.slots[j] = s;
+    cur.n_sets++;
+
+    return s;
+}
+
+HOT static const fvset *fv_intern_exact(const sym *v, const uint32 n) {
+    uint64 bloom = 0;
+    for (uint32 i = 0; i < n; i++) bloom |= bloom_bit(v[i]);
+
+    return fv_intern(v, n, bloom, set_hash(v, n));
+}
+
+HOT static const fvset *fv_intern_many(const uint64 bloom) {
+    return fv_intern(NULL, FV_MANY, bloom, bloom_hash(bloom));
+}
+
+static sym *scratch_get(const uint32 n) {
+    if (n > scratch_cap) {
+        scratch_cap = n > 2 * scratch_cap ? n : 2 * scratch_cap;
+        scratch = realloc(scratch, sizeof *scratch * scratch_cap);
+        if (!scratch) {
+            perror("realloc for free-variable scratch");
+            exit(1);
+        }
+    }
+
+    return scratch;
+}
+
+PURE const fvset *fv_empty(void) {
+    return &empty_set;
+}
+
+HOT const fvset *fv_single(const sym s) {
+    const uint32 k = s & (FV_CACHE_SIZE - 1);
+    if (single_cache[k].epoch == epoch && single_cache[k].s == s) return single_cache[k].r;
+
+    single_cache[k].s = s;
+    single_cache[k].epoch = epoch;
+    return single_cache[k].r = fv_intern_exact(&s, 1);
+}
+
+HOT const fvset *fv_union(const fvset *a, const fvset *b) {
+    if (a == b || !b->n) return a;
+    if (!a->n) return b;
+
+    const uint32 k = ptr_hash(a, 0) ^ ptr_hash(b, 1);
+    if (union_cache[k].epoch == epoch && union_cache[k].a == a && union_cache[k].b == b)
+        return union_cache[k].r;
+
+    const fvset *r;
+    const uint64 bloom = a->bloom | b->bloom;
+    if (a->n == FV_MANY || b->n == FV_MANY) {
+        // An approximate operand only contributes its filter
+        r = a->n == FV_MANY && bloom == a->bloom ? a
+          : b->n == FV_MANY && bloom == b->bloom ? b : fv_intern_many(bloom);
+    } else {
+        sym *out = scratch_get(a->n + b->n);
+        uint32 i = 0, j = 0, n = 0;
+        while (i < a->n && j < b->n) {
+            if (a->v[i] < b->v[j]) out[n++] = a->v[i++];
+            else if (a->v[i] > b->v[j]) out[n++] = b->v[j++];
+            else {
+                out[n++] = a->v[i++];
+                j++;
+            }
+        }
+        while (i < a->n) out[n++] = a->v[i++];
+        while (j < b->n) out[n++] = b->v[j++];
+
+        r = n == a->n ? a : n == b->n ? b : n > FV_MAX ? fv_intern_many(bloom)
+          : fv_intern(out, n, bloom, set_hash(out, n));
+    }
+    union_cache[k].a = a;
+    union_cache[k].b = b;
+    union_cache[k].r = r;
+    union_cache[k].epoch = epoch;
+
+    return r;
+}
+
+HOT const fvset *fv_remove(const fvset *a, const sym s) {
+    // An approximate set cannot tell whether another member shares s's bit
+    if (a->n == FV_MANY || !fv_has(a, s)) return a;
+
+    const uint32 k = ptr_hash(a, s);
+    if (remove_cache[k].epoch == epoch && remove_cache[k].a == a && remove_cache[k].s == s)
+        return remove_cache[k].r;
+
+    sym *out = scratch_get(a->n);
+    uint32 n = 0;
+    for (uint32 i = 0; i < a->n; i++) if (a->v[i] != s) out[n++] = a->v[i];
+
+    const fvset *r = fv_intern_exact(out, n);
+    remove_cache[k].a = a;
+    remove_cache[k].s = s;
+    remove_cache[k].epoch = epoch;
+    remove_cache[k].r = r;
+
+    return r;
+}
+
+PURE bool fv_has(const fvset *a, const sym s) {
+    if (!(a->bloom & bloom_bit(s))) return false;
+    if (a->n == FV_MANY) return true;
+
+    uint32 lo = 0, hi = a->n;
+    while (lo < hi) {
+        const uint32 mid = (lo + hi) / 2;
+        if (a->v[mid] == s) return true;
+        if (a->v[mid] < s) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return false;
+}
+
+PURE bool fv_exact(const fvset *a) {
+    return a->n != FV_MANY;
+}
+
+HOT bool fv_occurs(cexpr *e, const sym s) {
+    if (fv_exact(e->fv)) return fv_has(e->fv, s);
+
+    // Down through the approximate sets to exact ones, skipping every
+    // subterm whose filter rules s out and every binder of s
+    cexpr *local[STACK_LOCAL];
+    cexpr **st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    bool found = false;
+    st[sp++] = e;
+    while (sp && !found) {
+        cexpr *n = st[--sp];
+        if (!fv_has(n->fv, s)) continue;
+        if (fv_exact(n->fv)) {
+            found = true;
+            continue;
+        }
+        if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+        if (n->type == ABS_expr) {
+            if (n->abs_sym != s) st[sp++] = n->abs_body;
+        } else {
+            st[sp++] = n->app_arg;
+            st[sp++] = n->app_fn;
+        }
+    }
+    if (st != local) free(st);
+
+    return found;
+}
+
+/**
+ * @brief              A term still to visit, or the binder to drop on
+ *                     leaving an abstraction.
+ */
+typedef struct each_item {
+    cexpr         *e;        /* NULL to leave the binder's scope */
+    sym            leave;
+} each_item;
+
+bool fv_each(cexpr *e, bool (*fn)(void *, const sym), void *ctx) {
+    const uint32 n_syms = sym_count();
+    if (n_syms > inner_cap) {
+        inner = realloc(inner, sizeof *inner * n_syms);
+        if (!inner) {
+            perror("realloc for free-variable scan");
+            exit(1);
+        }
+        memset(inner + inner_cap, 0, sizeof *inner * (n_syms - inner_cap));
+        inner_cap = n_syms;
+    }
+
+    // Down through the approximate sets; an exact one lists its
+    // subterm's free variables, less those bound on the way down
+    each_item local[STACK_LOCAL];
+    each_item *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    bool stop = false;
+    st[sp++] = (each_item){e, 0};
+    while (sp) {
+        const each_item it = st[--sp];
+        cexpr *n = it.e;
+        if (!n) {
+            inner[it.leave]--;
+            continue;
+        }
+        if (stop) continue;
+        if (fv_exact(n->fv)) {
+            for (uint32 i = 0; i < n->fv->n && !stop; i++)
+                if (!inner[n->fv->v[i]]) stop = fn(ctx, n->fv->v[i]);
+            continue;
+        }
+        if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+        if (n->type == ABS_expr) {
+            inner[n->abs_sym]++;
+            st[sp++] = (each_item){NULL, n->abs_sym};
+            st[sp++] = (each_item){n->abs_body, 0};
+        } else {
+            st[sp++] = (each_item){n->app_arg, 0};
+            st[sp++] = (each_item){n->app_fn, 0};
+        }
+    }
+    if (st != local) free(st);
+
+    return stop;
+}
+
+void fv_move_begin(void) {
+    moving = cur.mem;
+    arena_init(&cur.mem, FV_CHUNK_SIZE);
+    free(cur.slots);
+    cur.slots = NULL;
+    cur.n_slots = cur.n_sets = 0;
+    epoch++;
+}
+
+HOT const fvset *fv_move(const fvset *a) {
+    if (a->sealed) return a;
+
+    return fv_intern(a->v, a->n, a->bloom, a->hash);
+}
+
+void fv_move_end(void) {
+    arena_destroy(&moving);
+}
+
+void fv_seal(void) {
+    for (const arena_chunk *c = cur.mem.first; c; c = c->next)
+        for (size_t off = 0; off < c->used;) {
+            fvset *s = (fvset *)(c->data + off);
+            s->sealed = 1;
+            off += ARENA_ALIGN(set_bytes(s->n));
+        }
+    arena_append(&sealed_mem, &cur.mem);
+}
+
+void fv_lend(void) {
+    own = cur;
+    cur = (fv_state){{NULL, NULL, FV_CHUNK_SIZE, 0, 0}, NULL, 0, 0};
+    epoch++;
+}
+
+void fv_unlend(void) {
+    arena_disown(&cur.mem);
+    pthread_mutex_lock(&handed_lock);
+    arena_append(&handed, &cur.mem);
+    pthread_mutex_unlock(&handed_lock);
+    free(cur.slots);
+    cur = own;
+    epoch++;
+}
+
+void fv_adopt(void) {
+    pthread_mutex_lock(&handed_lock);
+    arena_own(&handed);
+    arena_append(&cur.mem, &handed);
+    pthread_mutex_unlock(&handed_lock);
+}
+
+size_t fv_reserved(void) {
+    return cur.mem.reserved + sealed_mem.reserved;
+}
+
+void fv_table_destroy(void) {
+    free(cur.slots);
+    free(scratch);
+    free(inner);
+    cur.slots = NULL;
+    scratch = NULL;
+    inner = NULL;
+    cur.n_slots = cur.n_sets = scratch_cap = inner_cap = 0;
+    arena_destroy(&cur.mem);
+    epoch++;
+}
+
+void fv_destroy(void) {
+    fv_table_destroy();
+    arena_destroy(&sealed_mem);
+}
@@ -0,0 +1,87 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include "../include/governor.h"
+
+#include "../include/arena.h"
+#include "../include/cache.h"
+
+#include <stdint.h>
+#include <time.h>
+
+#define GOVERNOR_POLL_EVERY 256
+
+/* Every thread governs its own reduction. */
+static THREAD_LOCAL limits      lim;
+static THREAD_LOCAL bool        active;   /* any limit set */
+static THREAD_LOCAL stop_reason reason;
+static THREAD_LOCAL double      started;
+static THREAD_LOCAL uint32      polls;
+static THREAD_LOCAL size_t      cache_held; /* sampled when polled */
+static THREAD_LOCAL size_t      readback_from; /* nodes made when the limit was first seen */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+void governor_start(const limits *l) {
+    lim = *l;
+    active = lim.steps || lim.seconds > 0 || lim.bytes;
+    reason = STOP_NONE;
+    started = now();
+    polls = 0;
+    readback_from = SIZE_MAX;
+    cache_held = lim.bytes ? nf_cache_get_stats().bytes : 0;
+}
+
+HOT bool governor_exceeded(const size_t steps) {
+    if (!active) return false;
+    if (reason != STOP_NONE) return true;
+
+    if (lim.steps && steps >= lim.steps) reason = STOP_STEPS;
+    else if (lim.bytes && arena_reserved_total() + cache_held > lim.bytes) reason = STOP_MEMORY;
+    else if (++polls % GOVERNOR_POLL_EVERY == 0) {
+        // The clock and the shared cache cost too much to read every step
+        if (lim.bytes) cache_held = nf_cache_get_stats().bytes;
+        if (lim.seconds > 0 && now() - started >= lim.seconds) reason = STOP_TIME;
+    }
+
+    return reason != STOP_NONE;
+}
+
+void governor_readback_start(void) {
+    readback_from = SIZE_MAX;
+}
+
+HOT bool governor_readback(const size_t made) {
+    if (!active) return false;
+
+    if (reason == STOP_NONE) {
+        if (lim.bytes && arena_reserved_total() + cache_held > lim.bytes) reason = STOP_MEMORY;
+        else if (++polls % GOVERNOR_POLL_EVERY == 0) {
+            if (lim.bytes) cache_held = nf_cache_get_stats().bytes;
+            if (lim.seconds > 0 && now() - started >= lim.seconds) reason = STOP_TIME;
+        }
+        if (reason == STOP_NONE) return false;
+    }
+    if (readback_from == SIZE_MAX) readback_from = made;
+
+    return made - readback_from >= READBACK_NODES;
+}
+
+stop_reason governor_reason(void) {
+    return reason;
+}
+
+cchar *governor_message(const stop_reason r) {
+    switch (r) {
+        case STOP_NONE:   return "normal form reached";
+        case STOP_STEPS:  return "step limit reached";
+        case STOP_TIME:   return "time limit reached";
+        case STOP_MEMORY: return "memory limit reached";
+    }
+
+    return "stopped"; // unreachable
+}
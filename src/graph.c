@@ -0,0 +1,526 @@
+#include "../include/graph.h"
+
+#include "../include/arena.h"
+#include "../include/governor.h"
+#include "../include/stack.h"
+#include "../include/symbol.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Graph nodes mirror terms, plus an indirection node. Reducing a shared
+   node overwrites it with an indirection to its value, so everything
+   pointing at it sees the result. Because terms use De Bruijn indices,
+   a node means the same thing wherever it is shared and is never
+   shifted or copied when its loose indices stay below the binder
+   being substituted, so closed arguments are always shared as is.
+   Open arguments moved under binders are wrapped in a lazy shift node
+   instead of being copied; the shift is pushed down one layer at a
+   time, after the shared argument itself has been reduced. Once a
+   limit stops the reduction, shifts are no longer pushed down: the
+   readback applies them to the indices it reaches instead.           */
+
+typedef enum {
+    IDX_g, FREE_g, ABS_g, APP_g, IND_g, SHIFT_g
+} gtag;
+
+typedef struct gnode {
+    gtag           tag;
+    uint32         loose;    /* upper bound, see term.h */
+    uint32         idx;      /* index, or shift amount */
+    uint32         cutoff;   /* shift cutoff           */
+    sym            name;     /* free symbol or binder hint */
+    bool           normal;   /* already in normal form     */
+    struct gnode  *body;
+    struct gnode  *fn;
+    struct gnode  *arg;
+    struct gnode  *ind;      /* indirection or shift target */
+    term          *out;      /* readback, shared like the node */
+} gnode;
+
+/**
+ * @brief              Cached δ-definition graph.
+ */
+typedef struct gdef {
+    sym            name;
+    gnode         *node;
+} gdef;
+
+/**
+ * @brief              State of one graph_normalize call.
+ */
+typedef struct gctx {
+    arena          nodes;
+    term_resolver  resolve;
+    graph_stats    st;
+    gdef          *defs;
+    size_t         n_defs;
+} gctx;
+
+HOT static INLINE gnode *g_alloc(gctx *c, const gtag tag, const uint32 loose) {
+    gnode *n = arena_alloc(&c->nodes, sizeof *n);
+    n->tag = tag;
+    n->loose = loose;
+    n->normal = false;
+    n->out = NULL;
+    c->st.nodes++;
+
+    return n;
+}
+
+HOT static gnode *g_idx(gctx *c, const uint32 i) {
+    gnode *n = g_alloc(c, IDX_g, i + 1);
+    n->idx = i;
+
+    return n;
+}
+
+HOT static gnode *g_abs(gctx *c, const sym hint, gnode *b) {
+    gnode *n = g_alloc(c, ABS_g, b->loose ? b->loose - 1 : 0);
+    n->name = hint;
+    n->body = b;
+
+    return n;
+}
+
+HOT static gnode *g_app(gctx *c, gnode *f, gnode *a) {
+    gnode *n = g_alloc(c, APP_g, f->loose > a->loose ? f->loose : a->loose);
+    n->fn = f;
+    n->arg = a;
+
+    return n;
+}
+
+HOT static INLINE gnode *follow(gnode *n) {
+    while (n->tag == IND_g) n = n->ind;
+
+    return n;
+}
+
+/**
+ * @brief              A term being converted, and the function part of it
+ *                     done so far.
+ */
+typedef struct ft_frame {
+    cterm         *t;
+    gnode         *fn;       /* APP: the converted function */
+    enum { FT_BODY, FT_FN, FT_ARG } stage;
+} ft_frame;
+
+static gnode *from_term(gctx *c, cterm *t) {
+    ft_frame local[STACK_LOCAL];
+    ft_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    gnode *r;
+
+    while (true) {
+        // Down the leftmost path to a variable
+        while (t->type == ABS_term || t->type == APP_term) {
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            const bool app = t->type == APP_term;
+            st[sp++] = (ft_frame){t, NULL, app ? FT_FN : FT_BODY};
+            t = app ? t->app_fn : t->abs_body;
+        }
+        if (t->type == IDX_term) r = g_idx(c, t->idx);
+        else {
+            r = g_alloc(c, FREE_g, 0);
+            r->name = t->free_sym;
+        }
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            ft_frame *f = &st[sp - 1];
+            if (f->stage == FT_FN) {
+                f->fn = r;
+                f->stage = FT_ARG;
+                t = f->t->app_arg;
+                break;
+            }
+            r = f->stage == FT_ARG ? g_app(c, f->fn, r) : g_abs(c, f->t->abs_hint, r);
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+
+    return r;
+}
+
+HOT static gnode *g_shift(gctx *c, gnode *n, const uint32 cutoff, uint32 d) {
+    n = follow(n);
+    if (d == 0 || n->loose <= cutoff) return n;
+    while (n->tag == SHIFT_g && n->cutoff == cutoff) { // one shift does for both
+        d += n->idx;
+        n = follow(n->ind);
+        if (n->loose <= cutoff) return n;
+    }
+
+    gnode *s = g_alloc(c, SHIFT_g, n->loose + d);
+    s->ind = n;
+    s->idx = d;
+    s->cutoff = cutoff;
+
+    return s;
+}
+
+/**
+ * @brief              Push a lazy shift down one layer, overwriting the
+ *                     shift node with the result. Shifts of shifts are
+ *                     exposed innermost first.
+ * @return             the exposed node, never a shift
+ */
+HOT static gnode *expose(gctx *c, gnode *s) {
+    gnode *local[STACK_LOCAL];
+    gnode **st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+
+    gnode *t = s;
+    do {
+        if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+        st[sp++] = t;
+        t = follow(t->ind);
+    } while (t->tag == SHIFT_g);
+
+    while (sp) {
+        s = st[--sp];
+        const uint32 d = s->idx, cut = s->cutoff;
+        gnode *r;
+        switch (t->tag) {
+            case IDX_g: r = t->idx >= cut ? g_idx(c, t->idx + d) : t; break;
+            case ABS_g: r = g_abs(c, t->name, g_shift(c, t->body, cut + 1, d)); break;
+            case APP_g: r = g_app(c, g_shift(c, t->fn, cut, d), g_shift(c, t->arg, cut, d)); break;
+            default:    r = t; break;
+        }
+        s->tag = IND_g;
+        s->ind = r;
+        t = r;
+    }
+    if (st != local) free(st);
+
+    return t;
+}
+
+/**
+ * @brief              A node being rebuilt by a substitution, with the
+ *                     binders above it and the function part of it done
+ *                     so far.
+ */
+typedef struct gs_frame {
+    gnode         *n;
+    gnode         *fn;       /* APP: the rebuilt function */
+    uint32         depth;
+    enum { GS_BODY, GS_FN, GS_ARG } stage;
+} gs_frame;
+
+HOT static gnode *g_subst(gctx *c, gnode *n, uint32 depth, gnode *val) {
+    gs_frame local[STACK_LOCAL];
+    gs_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    gnode *r;
+
+    while (true) {
+        // Down the leftmost path to a node settled without its children
+        while (true) {
+            n = follow(n);
+            r = n;
+            if (n->loose <= depth) break; // shared with the redex, never copied
+            if (n->tag == SHIFT_g) {
+                // a term shifted past depth cannot mention it: just shift one less
+                if (n->cutoff <= depth && depth < n->cutoff + n->idx) {
+                    r = g_shift(c, n->ind, n->cutoff, n->idx - 1);
+                    break;
+                }
+                n = r = expose(c, n);
+            }
+            if (n->tag == IDX_g) {
+                r = n->idx == depth ? g_shift(c, val, 0, depth) : g_idx(c, n->idx - 1);
+                break;
+            }
+            if (n->tag != ABS_g && n->tag != APP_g) break;
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            const bool app = n->tag == APP_g;
+            st[sp++] = (gs_frame){n, NULL, depth, app ? GS_FN : GS_BODY};
+            if (app) n = n->fn;
+            else {
+                n = n->body;
+                depth++;
+            }
+        }
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            gs_frame *f = &st[sp - 1];
+            if (f->stage == GS_FN) {
+                f->fn = r;
+                f->stage = GS_ARG;
+                n = f->n->arg;
+                depth = f->depth;
+                break;
+            }
+            r = f->stage == GS_ARG ? g_app(c, f->fn, r) : g_abs(c, f->n->name, r);
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+
+    return r;
+}
+
+static gnode *resolve_def(gctx *c, const sym s) {
+    for (size_t i = 0; i < c->n_defs; i++) if (c->defs[i].name == s) return c->defs[i].node;
+    if (!c->resolve) return NULL;
+    cterm *t = c->resolve(s);
+    if (!t) return NULL;
+
+    gdef *grown = realloc(c->defs, sizeof *grown * (c->n_defs + 1));
+    if (!grown) {
+        perror("realloc for graph definitions");
+        exit(1);
+    }
+    c->defs = grown;
+    c->defs[c->n_defs] = (gdef){s, from_term(c, t)};
+
+    return c->defs[c->n_defs++].node;
+}
+
+/**
+ * @brief              Overwrite a node with an indirection to its value.
+ */
+HOT static INLINE void update(gctx *c, gnode *n, gnode *v) {
+    n->tag = IND_g;
+    n->ind = v;
+    c->st.updates++;
+}
+
+/**
+ * @brief              A node waiting for the weak head normal form of a
+ *                     node below it: an application for its function, or
+ *                     a shift for its target.
+ */
+typedef struct w_frame {
+    gnode         *n;
+    bool           shift;
+} w_frame;
+
+/**
+ * @brief              Reduce a node to weak head normal form in place.
+ * @return             the node holding the value
+ */
+HOT static gnode *whnf(gctx *c, gnode *n) {
+    w_frame local[STACK_LOCAL];
+    w_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+
+    while (true) {
+        n = follow(n);
+        if (n->tag == FREE_g) {
+            gnode *d = governor_reason() == STOP_NONE ? resolve_def(c, n->name) : NULL;
+            if (d && !governor_exceeded(c->st.beta + c->st.delta)) {
+                c->st.delta++;
+                update(c, n, d);
+                continue;
+            }
+        } else if ((n->tag == SHIFT_g && governor_reason() == STOP_NONE) || n->tag == APP_g) {
+            // reduce the shared target of a shift once, then shift it
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            st[sp++] = (w_frame){n, n->tag == SHIFT_g};
+            n = n->tag == SHIFT_g ? n->ind : n->fn;
+            continue;
+        }
+
+        // n is a value: hand it to the node waiting for it
+        bool more = false;
+        while (sp && !more) {
+            const w_frame f = st[--sp];
+            if (f.shift) {
+                if (governor_reason() != STOP_NONE) n = f.n; // left to the readback
+                else {
+                    n = expose(c, f.n);
+                    more = true;
+                }
+            } else if (n->tag == ABS_g && !governor_exceeded(c->st.beta + c->st.delta)) {
+                c->st.beta++;
+                update(c, f.n, g_subst(c, n->body, 0, f.n->arg));
+                n = f.n;
+                more = true;
+            } else {
+                f.n->fn = n; // drop the indirections on the spine
+                n = f.n;
+            }
+        }
+        if (!more) break;
+    }
+    if (st != local) free(st);
+
+    return n;
+}
+
+/**
+ * @brief              A node whose children are being normalized.
+ */
+typedef struct nf_frame {
+    gnode         *n;
+    enum { NF_BODY, NF_FN, NF_ARG } stage;
+} nf_frame;
+
+/**
+ * @brief              Normalize a node in place. A limit leaves the nodes
+ *                     not reached yet as they are.
+ * @return             the node holding the normal form
+ */
+static gnode *nf(gctx *c, gnode *n) {
+    nf_frame local[STACK_LOCAL];
+    nf_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    gnode *root = n;
+
+    while (true) {
+        // Down the leftmost path to a node that is normal already
+        while (true) {
+            n = whnf(c, n);
+            if (governor_reason() != STOP_NONE) break;
+            if (n->normal || (n->tag != ABS_g && n->tag != APP_g)) break;
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            const bool app = n->tag == APP_g;
+            st[sp++] = (nf_frame){n, app ? NF_FN : NF_BODY};
+            n = app ? n->fn : n->body;
+        }
+        if (governor_reason() != STOP_NONE) {
+            n = root;
+            break;
+        }
+        n->normal = true;
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            nf_frame *f = &st[sp - 1];
+            if (f->stage == NF_FN) {
+                f->n->fn = n;
+                f->stage = NF_ARG;
+                n = f->n->arg;
+                break;
+            }
+            if (f->stage == NF_ARG) f->n->arg = n;
+            else f->n->body = n;
+            n = f->n;
+            n->normal = true;
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+
+    return n;
+}
+
+/**
+ * @brief              A shift node read through: the binders above it,
+ *                     its cutoff and amount, and the least cutoff less
+ *                     binders of it and the shifts around it.
+ */
+typedef struct rb_shift {
+    uint32         depth;
+    uint32         cutoff;
+    uint32         d;
+    int64          floor;
+} rb_shift;
+
+/**
+ * @brief              A node being read back, with the binders and shifts
+ *                     above it and the function part of it done so far.
+ */
+typedef struct rb_frame {
+    gnode         *n;
+    term          *fn;       /* APP: the function read back */
+    uint32         depth;
+    size_t         shifts;   /* the shifts it is read through */
+    bool           shared;   /* none of them moves its indices */
+    enum { RB_BODY, RB_FN, RB_ARG } stage;
+} rb_frame;
+
+/**
+ * @brief              Read a node back as a term. A node no shift above
+ *                     it moves reads back the same everywhere, so its
+ *                     term is kept in the node and shared. After a limit
+ *                     the readback is bounded by governor_readback, and
+ *                     the shifts left in the graph apply to the indices
+ *                     below them as they are read.
+ */
+static term *to_term(gnode *n) {
+    rb_frame local[STACK_LOCAL];
+    rb_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    rb_shift slocal[STACK_LOCAL];
+    rb_shift *sh = slocal;
+    size_t scap = STACK_LOCAL, ns = 0;
+    uint32 depth = 0;
+    size_t made = 0;
+    term *r, *elided = NULL;
+
+    governor_readback_start();
+    while (true) {
+        // Down the leftmost path to a node read back already or a variable
+        while (true) {
+            n = follow(n);
+            const bool shared = !ns || (int64) n->loose <= depth + sh[ns - 1].floor;
+            if (shared && (r = n->out)) break;
+            if (governor_readback(++made)) {
+                r = elided = elided ? elided : make_free(sym_intern(ELIDED));
+                break;
+            }
+            if (n->tag == SHIFT_g) {
+                if (ns == scap) sh = stack_grow(sh, slocal, &scap, sizeof *sh);
+                const int64 floor = (int64) n->cutoff - depth;
+                sh[ns] = (rb_shift){depth, n->cutoff, n->idx, ns && sh[ns - 1].floor < floor ? sh[ns - 1].floor : floor};
+                ns++;
+                n = n->ind;
+                continue;
+            }
+            if (n->tag == IDX_g) {
+                uint32 i = n->idx;
+                for (size_t k = ns; k--;) if (i >= depth - sh[k].depth + sh[k].cutoff) i += sh[k].d;
+                r = make_idx(i);
+            } else if (n->tag == FREE_g) r = make_free(n->name);
+            if (n->tag != ABS_g && n->tag != APP_g) {
+                if (shared) n->out = r;
+                break;
+            }
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            const bool app = n->tag == APP_g;
+            st[sp++] = (rb_frame){n, NULL, depth, ns, shared, app ? RB_FN : RB_BODY};
+            if (app) n = n->fn;
+            else {
+                n = n->body;
+                depth++;
+            }
+        }
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            rb_frame *f = &st[sp - 1];
+            if (f->stage == RB_FN) {
+                f->fn = r;
+                f->stage = RB_ARG;
+                n = f->n->arg;
+                depth = f->depth;
+                ns = f->shifts;
+                break;
+            }
+            if (f->stage == RB_BODY) r = make_tabs(f->n->name, r);
+            else if (f->fn != elided || r != elided) r = make_tapp(f->fn, r); // else elided as a whole
+            if (f->shared) f->n->out = r;
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+    if (sh != slocal) free(sh);
+
+    return r;
+}
+
+term *graph_normalize(cterm *t, const term_resolver resolve, graph_stats *st) {
+    gctx c = {{NULL, NULL, INIT_ARENA_SIZE, 0, 0}, resolve, {0, 0, 0, 0}, NULL, 0};
+
+    term *r = to_term(nf(&c, from_term(&c, t)));
+    if (st) *st = c.st;
+
+    free(c.defs);
+    arena_destroy(&c.nodes);
+
+    return r;
+}
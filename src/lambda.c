@@ -8,8 +8,19 @@
 
 #include "../include/lambda.h"
 
+#include "../include/cache.h"
 #include "../include/expr.h"
-#include "../include/strbuf.h"
+#include "../include/fvset.h"
+#include "../include/governor.h"
+#include "../include/graph.h"
+#include "../include/machine.h"
+#include "../include/nbe.h"
+#include "../include/pool.h"
+#include "../include/sink.h"
+#include "../include/stack.h"
+#include "../include/stats.h"
+#include "../include/symbol.h"
+#include "../include/term.h"
 
 #include <ctype.h>
 #include <stdbool.h>
@@ -17,59 +28,74 @@
 #include <stdlib.h>
 #include <string.h>
 
-strbuf sb;
-
 static bool CONFIG_SHOW_STEP_TYPE = true;
 static bool CONFIG_DELTA_ABSTRACT = true;
 
+#define PAR_CUTOFF 4096 /* nodes below which a subterm is not split */
+#define PAR_TASKS  4    /* tasks per thread in a parallel round     */
+#define MEMO_DEPTH 256  /* path positions the cache looks at        */
+
 INLINE void vs_init(VarSet *s) {
     s->v = NULL;
     s->c = 0;
 }
 
-bool vs_has(const VarSet *s, cchar *x) {
-    for (int i = 0; i < s->c; i++) if (!strcmp(s->v[i], x)) return true;
+HOT bool vs_has_sym(const VarSet *s, const sym x) {
+    for (int i = 0; i < s->c; i++) if (s->v[i] == x) return true;
 
     return false;
 }
 
+bool vs_has(const VarSet *s, cchar *x) {
+    const sym id = sym_lookup(x);
+
+    return id != SYM_NONE && vs_has_sym(s, id);
+}
+
 /* TODO: Consider using a hash table for better performance. This is a
          simple implementation that grows in chunks of 8 and uses
          linear search. */
-void vs_add(VarSet *s, cchar *x) {
-    if (vs_has(s, x)) return;
+HOT void vs_add_sym(VarSet *s, const sym x) {
+    if (vs_has_sym(s, x)) return;
     if (s->c % 8 == 0) { // Grow in chunks of 8
-        s->v = realloc(s->v, sizeof(char *) * (s->c + 8));
+        s->v = realloc(s->v, sizeof(sym) * (s->c + 8));
         if (!s->v) { perror("realloc"); exit(1); }
     }
-    s->v[s->c++] = strdup(x);
+    s->v[s->c++] = x;
 }
 
-void vs_rm(VarSet *s, cchar *x) {
+void vs_add(VarSet *s, cchar *x) {
+    vs_add_sym(s, sym_intern(x));
+}
+
+HOT void vs_rm_sym(VarSet *s, const sym x) {
     for (int i = 0; i < s->c; i++) {
-        if (!strcmp(s->v[i], x)) {
-            free(s->v[i]);
-            memmove(&s->v[i], &s->v[i + 1], sizeof(char *) * (s->c - i - 1));
+        if (s->v[i] == x) {
+            memmove(&s->v[i], &s->v[i + 1], sizeof(sym) * (s->c - i - 1));
             s->c--;
             return;
         }
     }
 }
 
+void vs_rm(VarSet *s, cchar *x) {
+    const sym id = sym_lookup(x);
+    if (id != SYM_NONE) vs_rm_sym(s, id);
+}
+
 void vs_free(const VarSet *s) {
-    for (int i = 0; i < s->c; i++) free(s->v[i]);
     free(s->v);
 }
 
+static bool add_free(void *ctx, const sym x) {
+    vs_add_sym(ctx, x);
+
+    return false;
+}
+
 void free_vars_rec(cexpr *e, VarSet *s) {
-    if (e->type == VAR_expr) vs_add(s, e->var_name);
-    else if (e->type == ABS_expr) {
-        free_vars_rec(e->abs_body, s);
-        vs_rm(s, e->abs_param);
-    } else {
-        free_vars_rec(e->app_fn, s);
-        free_vars_rec(e->app_arg, s);
-    }
+    // Every node carries its free variables; only approximate sets are walked
+    fv_each(e, add_free, s);
 }
 
 VarSet free_vars(cexpr *e) {
@@ -80,74 +106,167 @@ VarSet free_vars(cexpr *e) {
     return s;
 }
 
-char *fresh_var(const VarSet *s) {
-    for (char c = 'a'; (int)c <= 'z'; c++) {
-        cchar buf[2] = {c, '\0'};
-        if (!vs_has(s, buf)) return strdup(buf);
+/**
+ * @brief              A node whose substitution is under way. A renamed
+ *                     binder keeps the substitution it interrupted.
+ */
+typedef struct sub_frame {
+    expr          *e;
+    expr          *aux;      /* APP: the substituted function;
+                                RENAMED: the outer value          */
+    sym            binder;   /* ABS: the binder of the result     */
+    sym            outer;    /* RENAMED: the outer variable       */
+    enum { SUB_BODY, SUB_RENAMED, SUB_FN, SUB_ARG } stage;
+} sub_frame;
+
+/* Nodes are immutable and reclaimed by the collector, so the result
+   shares val and every subtree that does not mention v. Each node
+   carries its free variables, so finding those subtrees and checking
+   for capture rarely take a traversal; a subtree whose approximate set
+   only may hold v comes back as it was. The path down to the
+   occurrences of v is walked with an explicit stack, so its depth is
+   not bounded by the C stack. */
+HOT expr *substitute_sym(expr *e, sym v, expr *val) {
+    if (!fv_has(e->fv, v)) {
+        stats_substitution();
+        return e;
     }
-    int idx = 1;
+
+    sub_frame local[STACK_LOCAL];
+    sub_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    expr *n = e, *r;
+
     while (true) {
-        for (int c = 'a'; c <= 'z'; c++) {
-            char buf[8];
-            snprintf(buf, sizeof(buf), "%c%d", c, idx);
-            if (!vs_has(s, buf)) return strdup(buf);
+        // Down to a subterm that settles at once: v itself or one without v
+        while (true) {
+            if (!fv_has(n->fv, v) || (n->type == ABS_expr && n->abs_sym == v)) {
+                r = n;
+                break;
+            }
+            if (n->type == VAR_expr) {
+                r = val;
+                break;
+            }
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            if (n->type == APP_expr) {
+                st[sp++] = (sub_frame){n, NULL, SYM_NONE, SYM_NONE, SUB_FN};
+                n = n->app_fn;
+            } else if (fv_occurs(val, n->abs_sym) && fv_occurs(n->abs_body, v)) {
+                // Rename the binder in the body first, to the first
+                // generated symbol free in neither the body nor val
+                sym fresh;
+                for (uint32 k = 1;; k++) {
+                    fresh = sym_fresh(n->abs_sym, k);
+                    if (!fv_occurs(val, fresh) && !fv_occurs(n->abs_body, fresh)) break;
+                }
+                stats_renaming();
+                st[sp++] = (sub_frame){n, val, fresh, v, SUB_RENAMED};
+                v = n->abs_sym;
+                val = make_var_sym(fresh);
+                n = n->abs_body;
+            } else {
+                st[sp++] = (sub_frame){n, NULL, n->abs_sym, SYM_NONE, SUB_BODY};
+                n = n->abs_body;
+            }
+        }
+
+        // Back up to the first frame with more to substitute
+        for (; sp; sp--) {
+            sub_frame *f = &st[sp - 1];
+            if (f->stage == SUB_FN) {
+                f->aux = r;
+                f->stage = SUB_ARG;
+                n = f->e->app_arg;
+                break;
+            }
+            if (f->stage == SUB_RENAMED) {
+                v = f->outer;
+                val = f->aux;
+                f->stage = SUB_BODY;
+                n = r;
+                break;
+            }
+            if (f->stage == SUB_ARG)
+                r = f->aux == f->e->app_fn && r == f->e->app_arg ? f->e : make_application(f->aux, r);
+            else r = f->binder == f->e->abs_sym && r == f->e->abs_body ? f->e : make_abs_sym(f->binder, r);
         }
-        idx++;
+        if (!sp) break;
     }
+    if (st != local) free(st);
+    stats_substitution();
+
+    return r;
 }
 
-/* TODO: This is inefficient because of recursive copying. Consider
-         using a more efficient copying method, or using an arena. */
 expr *substitute(expr *e, cchar *v, expr *val) {
-    if (e->type == VAR_expr) return copy_expr(strcmp(e->var_name, v) == 0 ? val : e);
+    return substitute_sym(e, sym_intern(v), val);
+}
 
-    if (e->type == ABS_expr) {
-        if (strcmp(e->abs_param, v) == 0) return copy_expr(e);
-        const VarSet fv_val = free_vars(val);
-        if (vs_has(&fv_val, e->abs_param)) {
-            VarSet forbidden_vars = free_vars(e);
-            vs_add(&forbidden_vars, e->abs_param);
-            for (int i = 0; i < fv_val.c; i++) vs_add(&forbidden_vars, fv_val.v[i]);
+/**
+ * @brief              Delta definitions. The arrays are sized by their
+ *                     initializers, so a count that does not match
+ *                     N_DEFS conflicts with the declarations.
+ */
+cchar *const def_src[] = {
+    "λx.λy.x",                                     /* true   */
+    "λx.λy.y",                                     /* false  */
+    "λp.λq.p q p",                                 /* and    */
+    "λp.λq.p p q",                                 /* or     */
+    "λn.λf.λx.n (λg.λh.h (g f)) (λu.x) (λu.u)",    /* dec    */
+    "λn.λf.λx.f (n f x)",                          /* inc    */
+    "λm.λn.m inc n",                               /* +      */
+    "λm.λn.m (+ n) 0",                             /* times  */
+    "λn.n (λx.false) true",                        /* iszero */
+    "λm.λn.n dec m",                               /* minus  */
+    "λm.λn.iszero (- m n)",                        /* <=     */ /* Untested */
+    "λx.λy.λf.f x y",                              /* pair   */
+    "λm.λn.(<= m n) and (<= n m)",                 /* ==     */ /* Untested */
+    "λm.λn.not(<= m n)",                           /* >      */ /* Untested */
+    "λm.λn.(<= m n) and not(== m n)",              /* <      */ /* Untested */
+    "λm.λn.<= n m",                                /* >=     */ /* Untested */
+    "λp.p false true",                             /* not    */
+    "λp.λq.not(and p q)",                          /* nand   */ /* Untested */
+    "λp.λq.not(p or q)",                           /* nor    */ /* Untested */
+    "λp.λq.or (and p (not q)) (and (not p) q)",    /* xor    */ /* Untested */
+    "λp.λq.not((p and not q) or (not p and q))",   /* xnor   */ /* Untested */
+};
 
-            char *nv_name = fresh_var(&forbidden_vars);
-            expr *nv_expr = make_variable(nv_name);
-            expr *renamed_body = substitute(e->abs_body, e->abs_param, nv_expr);
-            cexpr *substituted_renamed_body = substitute(renamed_body, v, val);
-            expr *result_expr = make_abstraction(nv_name, substituted_renamed_body);
+/**
+ * @brief              Delta definition names.
+ */
+cchar *const def_names[] = {"true", "false", "and", "or", "dec",
+                            "inc", "+", "*", "iszero", "-", "<=",
+                            "pair",
+                            /* Untested */
+                            "==", ">", "<", ">=", "not", "nand",
+                            "nor", "xor", "xnor"};
 
-            free_expr(nv_expr);
-            free(nv_name);
-            free_expr(renamed_body);
-            vs_free(&forbidden_vars);
-            vs_free(&fv_val);
+expr *def_vals[N_DEFS];
 
-            return result_expr;
-        }
-        cexpr *new_body = substitute(e->abs_body, v, val);
-        expr *result_expr = make_abstraction(e->abs_param, new_body);
-        vs_free(&fv_val);
+static THREAD_LOCAL sym def_syms[N_DEFS];
+static THREAD_LOCAL uint32 n_def_syms;
 
-        return result_expr;
+/**
+ * @brief              Find the δ-definition bound to a symbol.
+ * @param  s           the symbol
+ * @return             the definition index, or -1 if there is none
+ */
+HOT int find_def(const sym s) {
+    if (!n_def_syms) {
+        for (int i = 0; i < N_DEFS; i++) def_syms[i] = sym_intern(def_names[i]);
+        n_def_syms = N_DEFS;
     }
-    expr *substituted_fn = substitute(e->app_fn, v, val);
-    expr *substituted_arg = substitute(e->app_arg, v, val);
-
-    return make_application(substituted_fn, substituted_arg);
-}
-
-/* TODO: This is a hacky way to find definitions. Consider using a
-         different structure for better performance. */
-CONST int find_def(cchar *s) {
-    for (int i = 0; i < N_DEFS; i++) if (!strcmp(def_names[i], s)) return i;
+    for (int i = 0; i < N_DEFS; i++) if (def_syms[i] == s) return i;
 
     return -1;
 }
 
 HOT bool delta_reduce(cexpr *e, expr **out) {
     if (e->type == VAR_expr) {
-        const int i = find_def(e->var_name);
+        const int i = find_def(e->var_sym);
         if (i >= 0) {
-            *out = copy_expr(def_vals[i]);
+            *out = def_vals[i]; // sealed, so shared by every unfolding
             return true;
         }
     }
@@ -155,73 +274,1401 @@ HOT bool delta_reduce(cexpr *e, expr **out) {
     return false;
 }
 
+/* Native arithmetic: with it on, a saturated application of one of
+   these definitions to Church numerals is computed on integers and
+   replaced by its normal form in a single δ step.                   */
+static bool native_on;
+
+typedef enum {
+    OP_INC, OP_DEC, OP_ISZERO, OP_ADD, OP_MUL, OP_SUB, OP_LE, N_OPS
+} native_op;
+
+static cchar *op_names[N_OPS] = {"inc", "dec", "iszero", "+", "*", "-", "<="};
+static THREAD_LOCAL sym op_syms[N_OPS];
+static THREAD_LOCAL bool op_syms_ready;
+
+void native_arith(const bool on) {
+    native_on = on;
+}
+
+/**
+ * @brief              Find the native operation bound to a symbol.
+ * @return             the operation, or N_OPS if there is none
+ */
+static native_op find_op(const sym s) {
+    if (!op_syms_ready) {
+        for (int i = 0; i < N_OPS; i++) op_syms[i] = sym_intern(op_names[i]);
+        op_syms_ready = true;
+    }
+    for (int i = 0; i < N_OPS; i++) if (op_syms[i] == s) return (native_op)i;
+
+    return N_OPS;
+}
+
+/**
+ * @brief              Get the normal form of a Church boolean.
+ */
+static expr *native_bool(const bool b) {
+    return def_vals[find_def(sym_intern(b ? "true" : "false"))];
+}
+
+HOT bool native_reduce(cexpr *e, expr **out) {
+    if (e->type != APP_expr || !is_church_numeral(e->app_arg)) return false;
+    const uint64 n = count_applications(e->app_arg);
+    cexpr *f = e->app_fn;
+
+    if (f->type == VAR_expr) {
+        switch (find_op(f->var_sym)) {
+            case OP_INC:
+                if (n == UINT64_MAX) return false;
+                *out = church(n + 1);
+                return true;
+            case OP_DEC:
+                *out = church(n ? n - 1 : 0);
+                return true;
+            case OP_ISZERO:
+                *out = native_bool(n == 0);
+                return true;
+            default:
+                return false;
+        }
+    }
+    if (f->type != APP_expr || f->app_fn->type != VAR_expr || !is_church_numeral(f->app_arg)) return false;
+
+    const uint64 m = count_applications(f->app_arg);
+    uint64 r;
+    switch (find_op(f->app_fn->var_sym)) {
+        case OP_ADD: r = m + n; if (r < m) return false; break;
+        case OP_MUL: r = m * n; if (m && r / m != n) return false; break;
+        case OP_SUB: r = m > n ? m - n : 0; break;
+        case OP_LE:  *out = native_bool(m <= n); return true;
+        default:     return false;
+    }
+    *out = church(r); // overflow is left to ordinary reduction
+
+    return true;
+}
+
 HOT bool beta_reduce(cexpr *e, expr **out) {
+    if ((e->type == APP_expr) && (e->app_fn->type == NUM_expr)) {
+        // The one place a numeral has to be looked inside
+        cexpr *fn = num_expand(e->app_fn);
+        *out = substitute_sym(fn->abs_body, fn->abs_sym, e->app_arg);
+        return true;
+    }
     if ((e->type == APP_expr) && (e->app_fn->type == ABS_expr)) {
-        expr *argcp = copy_expr(e->app_arg);
-        *out = substitute(e->app_fn->abs_body, e->app_fn->abs_param, argcp);
-        free_expr(argcp);
+        *out = substitute_sym(e->app_fn->abs_body, e->app_fn->abs_sym, e->app_arg);
         return true;
     }
 
     return false;
 }
 
-HOT bool reduce_once(cexpr *e, expr **ne, cchar **rtype) {
-    expr *tmp;
-    if (delta_reduce(e, &tmp)) {
-        *ne = tmp;
-        *rtype = "δ";
+/* Reduction types. Steps are counted by comparing them by address. */
+static cchar RTYPE_BETA[]  = "β";
+static cchar RTYPE_DELTA[] = "δ";
+
+/**
+ * @brief              Count a step in the runtime statistics.
+ */
+static void count_step(cchar *rtype) {
+    stats_steps(rtype == RTYPE_BETA, rtype == RTYPE_DELTA);
+}
+
+/**
+ * @brief              Contract e itself if it is a redex.
+ */
+HOT static INLINE bool contract(cexpr *e, expr **out, cchar **rtype) {
+    if (native_on && native_reduce(e, out)) {
+        *rtype = RTYPE_DELTA;
+        return true;
+    }
+    if (delta_reduce(e, out)) {
+        *rtype = RTYPE_DELTA;
         return true;
     }
-    if (beta_reduce(e, &tmp)) {
-        *ne = tmp;
-        *rtype = "β";
+    if (beta_reduce(e, out)) {
+        *rtype = RTYPE_BETA;
         return true;
     }
-    if (e->type == APP_expr) {
-        if (reduce_once(e->app_fn, &tmp, rtype)) {
-            *ne = make_application(tmp, copy_expr(e->app_arg));
+
+    return false;
+}
+
+/**
+ * @brief              A node on the path to the redex being looked for,
+ *                     and which of its children the path goes through.
+ */
+typedef struct red_frame {
+    cexpr         *e;
+    enum { RED_FN, RED_ARG, RED_BODY } stage;
+} red_frame;
+
+/**
+ * @brief              The path from the root of a term to a redex.
+ */
+typedef struct red_path {
+    red_frame      local[STACK_LOCAL];
+    red_frame     *st;
+    size_t         cap;
+    size_t         sp;
+} red_path;
+
+/**
+ * @brief              Go on with the leftmost-outermost search from a
+ *                     node, below the frames already on the path.
+ * @param  p           the path to n, extended to lead to the redex
+ * @param  n           the node to search from
+ * @param  at          set to the redex
+ * @param  r           set to its contractum
+ * @param  rtype       set to the reduction type
+ * @return             false if no redex is left from n on
+ */
+HOT static INLINE bool search_redex(red_path *p, cexpr *n, cexpr **at, expr **r, cchar **rtype) {
+    // Leftmost-outermost: a node before its function, its function before
+    // its argument
+    while (true) {
+        if (contract(n, r, rtype)) {
+            *at = n;
             return true;
         }
-        if (reduce_once(e->app_arg, &tmp, rtype)) {
-            *ne = make_application(copy_expr(e->app_fn), tmp);
+        if (n->type == APP_expr || n->type == ABS_expr) {
+            if (p->sp == p->cap) p->st = stack_grow(p->st, p->local, &p->cap, sizeof *p->st);
+            const bool app = n->type == APP_expr;
+            p->st[p->sp++] = (red_frame){n, app ? RED_FN : RED_BODY};
+            n = app ? n->app_fn : n->abs_body;
+            continue;
+        }
+        // Nothing to contract below: go on with the nearest argument left
+        while (p->sp && p->st[p->sp - 1].stage != RED_FN) p->sp--;
+        if (!p->sp) return false;
+        p->st[p->sp - 1].stage = RED_ARG;
+        n = p->st[p->sp - 1].e->app_arg;
+    }
+}
+
+/**
+ * @brief              Find and contract the leftmost-outermost redex.
+ * @param  e           the term
+ * @param  p           the path, set to lead from e to the redex
+ * @param  at          set to the redex
+ * @param  r           set to its contractum
+ * @param  rtype       set to the reduction type
+ * @return             false if e is in normal form
+ */
+HOT static INLINE bool find_redex(cexpr *e, red_path *p, cexpr **at, expr **r, cchar **rtype) {
+    p->st = p->local;
+    p->cap = STACK_LOCAL;
+    p->sp = 0;
+
+    return search_redex(p, e, at, r, rtype);
+}
+
+/**
+ * @brief              Put a new subterm in place of the node at some depth
+ *                     of a path, rebuilding the nodes above it and sharing
+ *                     everything off the path.
+ * @param  p           the path
+ * @param  depth       the number of frames above the subterm
+ * @param  r           the new subterm
+ * @return             the new root
+ */
+HOT static INLINE expr *rebuild_path(const red_path *p, size_t depth, expr *r) {
+    while (depth--) {
+        cexpr *n = p->st[depth].e;
+        if (p->st[depth].stage == RED_FN) r = make_application(r, n->app_arg);
+        else if (p->st[depth].stage == RED_ARG) r = make_application(n->app_fn, r);
+        else r = make_abs_sym(n->abs_sym, r);
+    }
+
+    return r;
+}
+
+HOT bool reduce_once(cexpr *e, expr **ne, cchar **rtype) {
+    red_path p;
+    cexpr *at;
+    expr *r;
+    const bool found = find_redex(e, &p, &at, &r, rtype);
+    if (found) *ne = rebuild_path(&p, p.sp, r);
+    if (p.st != p.local) free(p.st);
+
+    return found;
+}
+
+/* Normalizing, the search for the next redex goes on from the position
+   the last step replaced instead of starting over at the root. The
+   path to that position is kept, holding the nodes of the term the
+   step built. Every node left of the position, in the order the search
+   visits them, was looked at and held no redex; those off the path are
+   shared by the new term, so they still hold none. Of the nodes on the
+   path, which the step rebuilt, the parent alone can have become a
+   β-redex, when the position is its function. Native arithmetic looks
+   into the arguments as far as a numeral goes, so with it on the whole
+   path is looked at again, from the root down. The first redex found
+   that way is the one a search from the root would find, so traces do
+   not change, and a step costs the depth of its position rather than
+   the size of the term. Any other term, such as one a collection has
+   moved, is searched from the root.                                  */
+static THREAD_LOCAL red_path zip;
+static THREAD_LOCAL size_t   zip_depth; /* frames above the position replaced last */
+static THREAD_LOCAL cexpr   *zip_root;  /* the term that step built, NULL for none */
+
+/**
+ * @brief              Forget the kept path, so that the next search starts
+ *                     from the root.
+ */
+static void zip_reset(void) {
+    if (zip.st && zip.st != zip.local) free(zip.st);
+    zip.st = zip.local;
+    zip.cap = STACK_LOCAL;
+    zip.sp = 0;
+    zip_root = NULL;
+}
+
+/**
+ * @brief              Find the leftmost-outermost redex, going on from the
+ *                     position the last step replaced if e is the term it
+ *                     built, and leave the path to it in zip.
+ * @param  e           the term
+ * @param  at          set to the redex
+ * @param  r           set to its contractum
+ * @param  rtype       set to the reduction type
+ * @return             false if e is in normal form
+ */
+HOT static bool zip_find(cexpr *e, cexpr **at, expr **r, cchar **rtype) {
+    if (e != zip_root) {
+        zip_reset();
+        return find_redex(e, &zip, at, r, rtype);
+    }
+
+    size_t k = zip_depth;
+    if (native_on) k = 0;
+    else if (k && zip.st[k - 1].stage == RED_FN) k--;
+    for (; k < zip_depth; k++) {
+        if (contract(zip.st[k].e, r, rtype)) {
+            zip.sp = k;
+            *at = zip.st[k].e;
             return true;
         }
     }
-    if ((e->type == ABS_expr) && (reduce_once(e->abs_body, &tmp, rtype))) {
-        *ne = make_abstraction(e->abs_param, tmp);
-        return true;
+
+    cexpr *n = e;
+    if (zip_depth) {
+        const red_frame *f = &zip.st[zip_depth - 1];
+        n = f->stage == RED_FN ? f->e->app_fn : f->stage == RED_ARG ? f->e->app_arg : f->e->abs_body;
+    }
+    zip.sp = zip_depth;
+
+    return search_redex(&zip, n, at, r, rtype);
+}
+
+/**
+ * @brief              Put a new subterm in place of the node at some depth
+ *                     of the kept path, like rebuild_path, and keep the
+ *                     rebuilt nodes on the path for the next search.
+ * @param  depth       the number of frames above the subterm
+ * @param  r           the new subterm
+ * @return             the new root
+ */
+HOT static expr *zip_rebuild(const size_t depth, expr *r) {
+    for (size_t k = depth; k--;) {
+        red_frame *f = &zip.st[k];
+        if (f->stage == RED_FN) r = make_application(r, f->e->app_arg);
+        else if (f->stage == RED_ARG) r = make_application(f->e->app_fn, r);
+        else r = make_abs_sym(f->e->abs_sym, r);
+        f->e = r;
+    }
+    zip_depth = depth;
+    zip_root = r;
+
+    return r;
+}
+
+/**
+ * @brief              Contract the leftmost-outermost redex like
+ *                     reduce_once, searching from where the last step
+ *                     left off.
+ */
+HOT static bool zip_step(cexpr *e, expr **ne, cchar **rtype) {
+    cexpr *at;
+    expr *r;
+    if (!zip_find(e, &at, &r, rtype)) return false;
+    *ne = zip_rebuild(zip.sp, r);
+
+    return true;
+}
+
+/* The other strategies. Each has a traversal of its own that looks only
+   where its redexes can be, and leaves the path to the redex it finds
+   in p, with p->sp the number of frames above it, for rebuild_path.  */
+
+/**
+ * @brief              Find the leftmost-innermost redex: the first, left to
+ *                     right, whose subterms have no redex, under
+ *                     abstractions too. Native arithmetic is taken as soon
+ *                     as it applies, before its arguments are unfolded.
+ */
+HOT static INLINE bool find_innermost(cexpr *e, red_path *p, cexpr **at, expr **r, cchar **rtype) {
+    cexpr *n = e;
+    p->st = p->local;
+    p->cap = STACK_LOCAL;
+    p->sp = 0;
+
+    while (true) {
+        // Down the leftmost path to a leaf
+        while (n->type == APP_expr || n->type == ABS_expr) {
+            if (native_on && native_reduce(n, r)) {
+                *at = n;
+                *rtype = RTYPE_DELTA;
+                return true;
+            }
+            if (p->sp == p->cap) p->st = stack_grow(p->st, p->local, &p->cap, sizeof *p->st);
+            const bool app = n->type == APP_expr;
+            p->st[p->sp++] = (red_frame){n, app ? RED_FN : RED_BODY};
+            n = app ? n->app_fn : n->abs_body;
+        }
+        if (delta_reduce(n, r)) {
+            *at = n;
+            *rtype = RTYPE_DELTA;
+            return true;
+        }
+        // Up past the subterms found normal: an application whose two
+        // sides are is the redex if any is left
+        while (true) {
+            if (!p->sp) return false;
+            red_frame *f = &p->st[p->sp - 1];
+            if (f->stage == RED_FN) {
+                f->stage = RED_ARG;
+                n = f->e->app_arg;
+                break;
+            }
+            p->sp--;
+            if (f->stage == RED_ARG && beta_reduce(f->e, r)) {
+                *at = f->e;
+                *rtype = RTYPE_BETA;
+                return true;
+            }
+        }
+    }
+}
+
+/**
+ * @brief              Find the call-by-value redex: function, then
+ *                     argument, then the application itself, never under
+ *                     an abstraction. A β-redex is contracted once its
+ *                     argument has no redex left, which for a closed term
+ *                     makes it a value. The arguments of a variable head
+ *                     are reduced too, so it stops at weak normal form.
+ */
+HOT static INLINE bool find_cbv(cexpr *e, red_path *p, cexpr **at, expr **r, cchar **rtype) {
+    cexpr *n = e;
+    p->st = p->local;
+    p->cap = STACK_LOCAL;
+    p->sp = 0;
+
+    while (true) {
+        while (n->type == APP_expr) {
+            if (native_on && native_reduce(n, r)) {
+                *at = n;
+                *rtype = RTYPE_DELTA;
+                return true;
+            }
+            if (p->sp == p->cap) p->st = stack_grow(p->st, p->local, &p->cap, sizeof *p->st);
+            p->st[p->sp++] = (red_frame){n, RED_FN};
+            n = n->app_fn;
+        }
+        if (delta_reduce(n, r)) {
+            *at = n;
+            *rtype = RTYPE_DELTA;
+            return true;
+        }
+        while (true) {
+            if (!p->sp) return false;
+            red_frame *f = &p->st[p->sp - 1];
+            if (f->stage == RED_FN) {
+                f->stage = RED_ARG;
+                n = f->e->app_arg;
+                break;
+            }
+            p->sp--;
+            if (beta_reduce(f->e, r)) {
+                *at = f->e;
+                *rtype = RTYPE_BETA;
+                return true;
+            }
+        }
+    }
+}
+
+/**
+ * @brief              Find the call-by-name redex: leftmost-outermost,
+ *                     never under an abstraction. The arguments of a
+ *                     variable head are reduced too, so it stops at weak
+ *                     normal form.
+ */
+HOT static INLINE bool find_cbn(cexpr *e, red_path *p, cexpr **at, expr **r, cchar **rtype) {
+    cexpr *n = e;
+    p->st = p->local;
+    p->cap = STACK_LOCAL;
+    p->sp = 0;
+
+    while (true) {
+        if (contract(n, r, rtype)) {
+            *at = n;
+            return true;
+        }
+        if (n->type == APP_expr) {
+            if (p->sp == p->cap) p->st = stack_grow(p->st, p->local, &p->cap, sizeof *p->st);
+            p->st[p->sp++] = (red_frame){n, RED_FN};
+            n = n->app_fn;
+            continue;
+        }
+        while (p->sp && p->st[p->sp - 1].stage != RED_FN) p->sp--;
+        if (!p->sp) return false;
+        p->st[p->sp - 1].stage = RED_ARG;
+        n = p->st[p->sp - 1].e->app_arg;
+    }
+}
+
+/**
+ * @brief              Find the head redex of a term not in weak head normal
+ *                     form: down the spine of applications only.
+ */
+HOT static INLINE bool find_whnf(cexpr *e, red_path *p, cexpr **at, expr **r, cchar **rtype) {
+    cexpr *n = e;
+    p->st = p->local;
+    p->cap = STACK_LOCAL;
+    p->sp = 0;
+
+    while (!contract(n, r, rtype)) {
+        if (n->type != APP_expr) return false;
+        if (p->sp == p->cap) p->st = stack_grow(p->st, p->local, &p->cap, sizeof *p->st);
+        p->st[p->sp++] = (red_frame){n, RED_FN};
+        n = n->app_fn;
+    }
+    *at = n;
+
+    return true;
+}
+
+/**
+ * @brief              Find the head redex of a term not in head normal
+ *                     form: through the leading abstractions, then down
+ *                     the spine.
+ */
+HOT static INLINE bool find_hnf(cexpr *e, red_path *p, cexpr **at, expr **r, cchar **rtype) {
+    cexpr *n = e;
+    p->st = p->local;
+    p->cap = STACK_LOCAL;
+    p->sp = 0;
+
+    while (!contract(n, r, rtype)) {
+        if (n->type != APP_expr && n->type != ABS_expr) return false;
+        if (p->sp == p->cap) p->st = stack_grow(p->st, p->local, &p->cap, sizeof *p->st);
+        const bool app = n->type == APP_expr;
+        p->st[p->sp++] = (red_frame){n, app ? RED_FN : RED_BODY};
+        n = app ? n->app_fn : n->abs_body;
+    }
+    *at = n;
+
+    return true;
+}
+
+/**
+ * @brief              Do one step with a strategy's redex search.
+ */
+HOT static INLINE bool step_with(bool (*find)(cexpr *, red_path *, cexpr **, expr **, cchar **),
+                                 cexpr *e, expr **ne, cchar **rtype) {
+    red_path p;
+    cexpr *at;
+    expr *r;
+    const bool found = find(e, &p, &at, &r, rtype);
+    if (found) *ne = rebuild_path(&p, p.sp, r);
+    if (p.st != p.local) free(p.st);
+
+    return found;
+}
+
+static bool applicative_once(cexpr *e, expr **ne, cchar **rtype) { return step_with(find_innermost, e, ne, rtype); }
+static bool cbv_once(cexpr *e, expr **ne, cchar **rtype)         { return step_with(find_cbv, e, ne, rtype); }
+static bool cbn_once(cexpr *e, expr **ne, cchar **rtype)         { return step_with(find_cbn, e, ne, rtype); }
+static bool whnf_once(cexpr *e, expr **ne, cchar **rtype)        { return step_with(find_whnf, e, ne, rtype); }
+static bool hnf_once(cexpr *e, expr **ne, cchar **rtype)         { return step_with(find_hnf, e, ne, rtype); }
+
+static bool (*const strategy_steps[N_STRATEGIES])(cexpr *, expr **, cchar **) = {
+    reduce_once, applicative_once, cbv_once, cbn_once, whnf_once, hnf_once,
+};
+
+static cchar *const strategy_names[N_STRATEGIES] = {"normal", "applicative", "cbv", "cbn", "whnf", "hnf"};
+
+/* The form a term is in once a strategy finds no redex */
+static cchar *const strategy_forms[N_STRATEGIES] = {
+    "normal form", "normal form", "weak normal form", "weak normal form",
+    "weak head normal form", "head normal form",
+};
+
+bool reduce_once_with(const strategy s, cexpr *e, expr **ne, cchar **rtype) {
+    return strategy_steps[s](e, ne, rtype);
+}
+
+cchar *strategy_name(const strategy s) {
+    return strategy_names[s];
+}
+
+bool strategy_parse(cchar *name, strategy *s) {
+    for (int i = 0; i < N_STRATEGIES; i++) {
+        if (!strcmp(name, strategy_names[i])) {
+            *s = (strategy) i;
+            return true;
+        }
     }
 
     return false;
 }
 
-void normalize(expr *e) {
-    sb_reset(&sb);
-    expr_to_buffer(e, sb.data, sb.cap);
-    printf("Step 0: %s\n", sb.data);
-    int step = 1;
+/* Normal-form memoization. A position on the path to the redex is
+   stable when nothing around it can change while it reduces: every
+   step down to it enters an abstraction body, an argument, or the
+   function of an application headed by a variable that is not a
+   definition. Leftmost-outermost reduction then reduces a term at a
+   stable position to its normal form before leaving it, exactly as it
+   would the term alone. So each term first met at a stable position
+   with no free variables but definitions is looked up in the cache:
+   a hit replaces it with its normal form in one step, a miss keeps it
+   pending, and the normal form found at its position once the path
+   leaves it is recorded. Only the first MEMO_DEPTH positions of the
+   path are looked at, and looking one up costs O(1) unless the cache
+   has an entry with its hash. A pending term is kept alive by the
+   collector until its key is encoded along with its normal form.  */
+typedef struct memo_pending {
+    size_t         depth;    /* position on the path */
+    nf_key         key;
+} memo_pending;
+
+static THREAD_LOCAL memo_pending pending[MEMO_DEPTH + 1]; /* at most one per position */
+static THREAD_LOCAL size_t       n_pending;
+static THREAD_LOCAL uint8        moves[MEMO_DEPTH]; /* from the root to the last position examined */
+static THREAD_LOCAL size_t       examined;  /* positions of the path looked at */
+static THREAD_LOCAL size_t       last_step; /* position the last step replaced */
+
+/**
+ * @brief              Check whether the head of an application spine is a
+ *                     variable that no step can replace.
+ */
+static bool rigid_head(cexpr *e) {
+    while (e->type == APP_expr) e = e->app_fn;
+
+    return e->type == VAR_expr && find_def(e->var_sym) < 0;
+}
+
+/**
+ * @brief              Check whether every free variable of a term is a
+ *                     definition, so that its normal form is the same
+ *                     wherever it occurs.
+ */
+static bool not_def(void *ctx, const sym x) {
+    (void) ctx;
+
+    return find_def(x) < 0;
+}
+
+static bool closed(cexpr *e) {
+    // A set too large to list its members holds more than the definitions
+    return fv_exact(e->fv) && !fv_each(e, not_def, NULL);
+}
+
+/**
+ * @brief              Record the normal forms of the pending terms from
+ *                     depth on, found in e along the examined moves.
+ */
+static void memo_finish(cexpr *e, const size_t depth) {
+    while (n_pending && pending[n_pending - 1].depth >= depth) {
+        memo_pending *x = &pending[--n_pending];
+        cexpr *n = e;
+        for (size_t i = 0; i < x->depth; i++)
+            n = moves[i] == RED_FN ? n->app_fn : moves[i] == RED_ARG ? n->app_arg : n->abs_body;
+        nf_cache_put(&x->key, n);
+        nf_key_free(&x->key);
+    }
+}
+
+static bool memo_step(cexpr *e, expr **ne, cchar **rtype) {
+    cexpr *at;
+    expr *r;
+    if (!zip_find(e, &at, &r, rtype)) {
+        memo_finish(e, 0);
+        examined = 0;
+        return false;
+    }
+
+    // The stable positions are 0..k; the moves to the first same of them
+    // are those of positions examined before, whose state stays
+    const size_t top = zip.sp < MEMO_DEPTH ? zip.sp : MEMO_DEPTH;
+    size_t k = 0, same = 0;
+    bool rigid = false;
+    for (; k < top; k++) {
+        const red_frame *f = &zip.st[k];
+        if (f->stage != RED_FN) rigid = false;
+        else if (!rigid && !(rigid = rigid_head(f->e->app_fn))) break; // one spine, one head
+        if (same == k && k + 1 < examined && moves[k] == f->stage) same++;
+    }
+
+    // Pending terms the path left are normal now. The position the last
+    // step replaced is looked at again, unless its term is pending.
+    memo_finish(e, examined ? same + 1 : 0);
+    for (size_t i = same; i < k; i++) moves[i] = (uint8) zip.st[i].stage;
+    if (examined > same + 1) examined = same + 1;
+    if (examined > last_step) examined = last_step;
+    if (n_pending && pending[n_pending - 1].depth == examined) examined++;
+
+    for (; examined <= k; examined++) {
+        cexpr *n = examined < zip.sp ? zip.st[examined].e : at;
+        if (n->type == NUM_expr || !closed(n)) continue;
+        nf_key key = nf_cache_key(n);
+        expr *nf = nf_cache_get(&key);
+        if (nf) {
+            nf_key_free(&key);
+            last_step = examined;
+            *ne = zip_rebuild(examined, nf);
+            *rtype = "cache";
+            return true;
+        }
+        pending[n_pending++] = (memo_pending){examined, key};
+    }
+
+    last_step = zip.sp;
+    *ne = zip_rebuild(zip.sp, r);
+
+    return true;
+}
+
+/**
+ * @brief              A node on the way down to the outermost redexes,
+ *                     with its function once that is done.
+ */
+typedef struct out_frame {
+    cexpr         *e;
+    expr          *fn;       /* APP: the function after the round */
+    enum { OUT_FN, OUT_ARG, OUT_BODY } stage;
+} out_frame;
+
+/**
+ * @brief              Contract every outermost redex of a term, the ones
+ *                     no other redex contains. They never overlap, and the
+ *                     leftmost-outermost one is among them.
+ * @param  e           the term
+ * @param  count       increased by the number of redexes contracted
+ * @return             the term after the round, e itself if it had none
+ */
+HOT static expr *contract_outermost(cexpr *e, size_t *count) {
+    out_frame local[STACK_LOCAL];
+    out_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    cexpr *n = e;
+    expr *r;
+    cchar *kind;
+
     while (true) {
+        while (true) {
+            if (contract(n, &r, &kind)) {
+                (*count)++;
+                count_step(kind);
+                break;
+            }
+            if (n->type != APP_expr && n->type != ABS_expr) {
+                r = (expr *) n;
+                break;
+            }
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            const bool app = n->type == APP_expr;
+            st[sp++] = (out_frame){n, NULL, app ? OUT_FN : OUT_BODY};
+            n = app ? n->app_fn : n->abs_body;
+        }
+        // Rebuild upwards until a function is done, sharing what did not change
+        while (sp) {
+            out_frame *f = &st[sp - 1];
+            if (f->stage == OUT_FN) {
+                f->fn = r;
+                f->stage = OUT_ARG;
+                break;
+            }
+            cexpr *p = f->e;
+            if (f->stage == OUT_ARG)
+                r = f->fn == p->app_fn && r == p->app_arg ? (expr *) p : make_application(f->fn, r);
+            else r = r == p->abs_body ? (expr *) p : make_abs_sym(p->abs_sym, r);
+            sp--;
+        }
+        if (!sp) break;
+        n = st[sp - 1].e->app_arg;
+    }
+    if (st != local) free(st);
+
+    return r;
+}
+
+/**
+ * @brief              Check whether a term has at least k nodes, looking
+ *                     at no more than k of them.
+ */
+static bool size_at_least(cexpr *e, const size_t k) {
+    cexpr *local[STACK_LOCAL];
+    cexpr **st = local;
+    size_t cap = STACK_LOCAL, sp = 0, seen = 0;
+
+    st[sp++] = e;
+    while (sp && seen < k) {
+        cexpr *n = st[--sp];
+        seen++;
+        if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+        if (n->type == ABS_expr) st[sp++] = n->abs_body;
+        else if (n->type == APP_expr) {
+            st[sp++] = n->app_arg;
+            st[sp++] = n->app_fn;
+        }
+    }
+    if (st != local) free(st);
+
+    return seen >= k;
+}
+
+/**
+ * @brief              Check whether a term is a redex, without building
+ *                     its contractum unless native arithmetic applies.
+ */
+static bool is_redex(cexpr *e) {
+    expr *r;
+
+    if (e->type == VAR_expr) return find_def(e->var_sym) >= 0;
+    if (e->type != APP_expr) return false;
+    if (e->app_fn->type == ABS_expr || e->app_fn->type == NUM_expr) return true;
+
+    return native_on && native_reduce(e, &r);
+}
+
+/**
+ * @brief              A subterm of a parallel round: either split, with
+ *                     its children at kids, or a task contracted whole.
+ */
+typedef struct par_node {
+    cexpr         *e;
+    expr          *r;        /* the subterm after the round */
+    size_t         kids;     /* index of the first child, 0 for a task */
+    size_t         count;    /* redexes the task contracted */
+    run_stats      stats;    /* counted by the task's thread */
+} par_node;
+
+typedef struct par_round {
+    par_node      *nodes;
+    size_t        *tasks;
+    uint32         gen;      /* of the heap the round builds into */
+} par_round;
+
+static THREAD_LOCAL pool  *par_pool;
+static THREAD_LOCAL size_t par_threads;
+
+static void par_task(void *ctx, const size_t i) {
+    const par_round *pr = ctx;
+    par_node *t = &pr->nodes[pr->tasks[i]];
+    expr_heap_lend(pr->gen);
+    stats_reset();
+    t->r = contract_outermost(t->e, &t->count);
+    t->stats = stats_get();
+    expr_heap_unlend();
+}
+
+bool reduce_parallel(cexpr *e, expr **ne, size_t *count) {
+    *count = 0;
+    if (!par_pool || expr_hashcons_enabled() || !size_at_least(e, PAR_CUTOFF)) {
+        *ne = contract_outermost(e, count);
+        return *count > 0;
+    }
+
+    // Split the top of the term breadth-first into large enough subterms,
+    // never inside a redex, and hand those to the pool
+    const size_t want = PAR_TASKS * (par_threads + 1);
+    size_t cap = 4 * want, n = 1, split = 0;
+    par_round pr = {malloc(sizeof *pr.nodes * cap), NULL, expr_heap_generation()};
+    if (!pr.nodes) {
+        perror("malloc for parallel round");
+        exit(1);
+    }
+    pr.nodes[0] = (par_node){e, NULL, 0, 0, {0}};
+    for (size_t i = 0; i < n && n - split < want; i++) {
+        cexpr *x = pr.nodes[i].e;
+        if ((x->type != APP_expr && x->type != ABS_expr) || is_redex(x) || !size_at_least(x, PAR_CUTOFF)) continue;
+        if (n + 2 > cap) {
+            cap *= 2;
+            pr.nodes = realloc(pr.nodes, sizeof *pr.nodes * cap);
+            if (!pr.nodes) {
+                perror("realloc for parallel round");
+                exit(1);
+            }
+        }
+        pr.nodes[i].kids = n;
+        split++;
+        if (x->type == ABS_expr) pr.nodes[n++] = (par_node){x->abs_body, NULL, 0, 0, {0}};
+        else {
+            pr.nodes[n++] = (par_node){x->app_fn, NULL, 0, 0, {0}};
+            pr.nodes[n++] = (par_node){x->app_arg, NULL, 0, 0, {0}};
+        }
+    }
+    pr.tasks = malloc(sizeof *pr.tasks * (n - split));
+    if (!pr.tasks) {
+        perror("malloc for parallel round");
+        exit(1);
+    }
+    size_t n_tasks = 0;
+    for (size_t i = 0; i < n; i++) if (!pr.nodes[i].kids) pr.tasks[n_tasks++] = i;
+
+    pool_submit(par_pool, n_tasks, par_task, &pr);
+    pool_wait(par_pool);
+    expr_heap_adopt();
+
+    // Children come after their parents, so rebuild back to front
+    for (size_t i = n; i--;) {
+        par_node *x = &pr.nodes[i];
+        if (!x->kids) {
+            *count += x->count;
+            stats_add(&x->stats);
+            continue;
+        }
+        cexpr *p = x->e;
+        expr *a = pr.nodes[x->kids].r;
+        if (p->type == ABS_expr) x->r = a == p->abs_body ? (expr *) p : make_abs_sym(p->abs_sym, a);
+        else {
+            expr *b = pr.nodes[x->kids + 1].r;
+            x->r = a == p->app_fn && b == p->app_arg ? (expr *) p : make_application(a, b);
+        }
+    }
+    *ne = pr.nodes[0].r;
+    free(pr.tasks);
+    free(pr.nodes);
+
+    return *count > 0;
+}
+
+static trace_mode trace = TRACE_FULL;
+static size_t     trace_n = 1;
+static THREAD_LOCAL sink *trace_sink; /* NULL for standard output */
+static THREAD_LOCAL bool   in_rounds;  /* trace lines are parallel rounds */
+static THREAD_LOCAL size_t contracted; /* redexes those rounds contracted */
+static THREAD_LOCAL strategy running; /* the strategy rewrite() follows */
+
+void trace_config(const trace_mode mode, const size_t n) {
+    trace = mode;
+    trace_n = n ? n : 1;
+}
+
+void trace_output(sink *out) {
+    trace_sink = out;
+}
+
+static THREAD_LOCAL void (*result_fn)(cexpr *e); /* NULL for none */
+
+void trace_result(void (*fn)(cexpr *e)) {
+    result_fn = fn;
+}
+
+/**
+ * @brief              Get the sink a normalizer prints to: the one set
+ *                     with trace_output, or local made to write to
+ *                     standard output.
+ */
+static sink *trace_open(sink *local) {
+    if (trace_sink) return trace_sink;
+    sink_init_file(local, stdout);
+
+    return local;
+}
+
+/**
+ * @brief              Finish with the sink trace_open returned.
+ */
+static void trace_close(sink *out, sink *local) {
+    stats_begin(PHASE_PRINT);
+    if (out == local) sink_destroy(local);
+    else sink_flush(out);
+    stats_end();
+}
+
+/**
+ * @brief              The last trace_n steps of a TRACE_LAST reduction,
+ *                     kept unrendered until the reduction ends. The terms
+ *                     sit at the end of a collector root array, after the
+ *                     δ-definitions and the current term, so they survive
+ *                     collections without being copied out each step.
+ */
+typedef struct step_ring {
+    size_t         cap;      /* 0 when no steps are kept      */
+    size_t         count;    /* steps pushed so far           */
+    int           *step;
+    cchar        **rtype;
+    expr         **roots;    /* for the rewrite engine, or NULL */
+    term         **troots;   /* for the De Bruijn engine, or NULL */
+} step_ring;
+
+/**
+ * @brief              Set up the ring for the current trace mode.
+ * @param  r           the ring
+ * @param  terms       true to keep core terms, false for expressions
+ */
+static void ring_init(step_ring *r, const bool terms) {
+    *r = (step_ring){0, 0, NULL, NULL, NULL, NULL};
+    if (trace != TRACE_LAST) return;
+
+    r->cap = trace_n;
+    r->step = malloc(sizeof *r->step * r->cap);
+    r->rtype = malloc(sizeof *r->rtype * r->cap);
+    if (terms) r->troots = calloc(N_DEFS + 1 + r->cap, sizeof *r->troots);
+    else r->roots = calloc(N_DEFS + 1 + r->cap + MEMO_DEPTH + 1, sizeof *r->roots);
+    if (!r->step || !r->rtype || (!r->roots && !r->troots)) {
+        perror("malloc for trace ring");
+        exit(1);
+    }
+}
+
+/**
+ * @brief              Keep a step, dropping the oldest one when full.
+ * @return             the index of the slot the step went to
+ */
+static size_t ring_push(step_ring *r, const int step, cchar *rtype) {
+    const size_t i = r->count++ % r->cap;
+    r->step[i] = step;
+    r->rtype[i] = rtype;
+
+    return i;
+}
+
+static void ring_destroy(step_ring *r) {
+    free(r->step);
+    free(r->rtype);
+    free(r->roots);
+    free(r->troots);
+}
+
+/**
+ * @brief              Reclaim the nodes of previous steps once enough
+ *                     garbage has built up. The δ-definitions are roots,
+ *                     and so are the steps kept in the ring and the
+ *                     terms pending in the normal-form cache.
+ * @param  e           the current term, updated in place
+ * @param  r           the step ring, or NULL
+ * @return             true if a collection ran
+ */
+static bool collect(expr **e, const step_ring *r) {
+    expr *local[N_DEFS + 1 + MEMO_DEPTH + 1];
+    expr **roots = r && r->roots ? r->roots : local;
+    const size_t memo = N_DEFS + 1 + (roots == local ? 0 : r->cap);
+    memcpy(roots, def_vals, sizeof def_vals);
+    roots[N_DEFS] = *e;
+    for (size_t i = 0; i < n_pending; i++) roots[memo + i] = (expr *) pending[i].key.term;
+    if (!expr_collect_maybe(roots, memo + n_pending)) return false;
+    memcpy(def_vals, roots, sizeof def_vals);
+    *e = roots[N_DEFS];
+    for (size_t i = 0; i < n_pending; i++) pending[i].key.term = roots[memo + i];
+
+    return true;
+}
+
+/**
+ * @brief              Check whether a step is printed as it happens.
+ */
+static INLINE bool trace_now(const int step) {
+    return trace == TRACE_FULL || (trace == TRACE_EVERY && (size_t) step % trace_n == 0);
+}
+
+/**
+ * @brief              Print one line of the reduction trace.
+ * @param  out         the trace sink
+ * @param  step        the step number
+ * @param  rtype       the reduction type, NULL for the initial term
+ * @param  e           the term after the step
+ */
+static void print_step(sink *out, const int step, cchar *rtype, cexpr *e) {
+    cchar *word = in_rounds ? "Round" : "Step";
+    stats_begin(PHASE_PRINT);
+    if (rtype && CONFIG_SHOW_STEP_TYPE) sink_printf(out, "%s %d (%s): ", word, step, rtype);
+    else sink_printf(out, "%s %d: ", word, step);
+    expr_write(out, e);
+    sink_putc(out, '\n');
+    stats_end();
+}
+
+/**
+ * @brief              Print the δ-abstracted form of a normal form.
+ * @param  out         the trace sink
+ * @param  e           the normal form
+ */
+static void print_abstracted(sink *out, cexpr *e) {
+    if (!CONFIG_DELTA_ABSTRACT) return;
+    stats_begin(PHASE_ABSTRACT);
+    expr *abs = abstract_numerals(e);
+    stats_end();
+    stats_begin(PHASE_PRINT);
+    sink_puts(out, "\nδ-abstracted: ");
+    expr_write(out, abs);
+    sink_putc(out, '\n');
+    stats_end();
+    free_expr(abs);
+}
+
+/**
+ * @brief              Print the end of a trace: the final step if the
+ *                     mode has not shown it yet, how the reduction ended,
+ *                     with the form the strategy reached, then the
+ *                     δ-abstracted final term, which is partial if a limit
+ *                     stopped it. The final term goes to
+ *                     the trace_result function first.
+ * @param  out         the trace sink
+ * @param  last        the number of the final step
+ * @param  rtype       the reduction type of the final step
+ * @param  e           the final term
+ */
+static void print_end(sink *out, const int last, cchar *rtype, cexpr *e) {
+    const stop_reason r = governor_reason();
+    if (result_fn) result_fn(e);
+    switch (trace) {
+        case TRACE_QUIET:
+            return;
+        case TRACE_FINAL:
+            if (in_rounds) sink_printf(out, "Rounds: %d\nContractions: %zu\n", last, contracted);
+            else sink_printf(out, "Steps: %d\n", last);
+            if (r != STOP_NONE) sink_printf(out, "→ %s.\n", governor_message(r));
+            break;
+        case TRACE_EVERY:
+            if (!trace_now(last)) print_step(out, last, rtype, e);
+            // fall through
+        case TRACE_FULL:
+        case TRACE_LAST:
+            if (r == STOP_NONE) sink_printf(out, "\n→ %s reached.\n", strategy_forms[running]);
+            else sink_printf(out, "\n→ %s.\n", governor_message(r));
+            break;
+    }
+    print_abstracted(out, e);
+}
+
+/**
+ * @brief              Normalize with the rewrite engine, one call of step
+ *                     per trace line.
+ * @param  e           the expression to normalize
+ * @param  step_fn     a normal-order step, or a whole parallel round
+ * @return             STOP_NONE, or the limit that stopped the reduction
+ */
+static stop_reason rewrite(expr *e, bool (*step_fn)(cexpr *, expr **, cchar **)) {
+    sink local, *out = trace_open(&local);
+    step_ring ring;
+    ring_init(&ring, false);
+
+    int step = 0;
+    cchar *rtype = NULL;
+    stats_measure(e);
+    while (true) {
+        if (trace_now(step)) print_step(out, step, rtype, e);
+        else if (ring.cap) ring.roots[N_DEFS + 1 + ring_push(&ring, step, rtype)] = e;
+
         expr *next;
-        cchar *rtype;
-        if (!reduce_once(e, &next, &rtype)) {
-            printf("\n→ normal form reached.\n");
+        cchar *kind;
+        if (governor_exceeded((size_t) step) || !step_fn(e, &next, &kind)) break;
+        e = next;
+        rtype = kind;
+        step++;
+        count_step(kind);
+        stats_measure(e);
+        if (collect(&e, &ring)) zip_reset(); // the term moved
+    }
+
+    for (size_t k = ring.count > ring.cap ? ring.count - ring.cap : 0; k < ring.count; k++) {
+        const size_t i = k % ring.cap;
+        print_step(out, ring.step[i], ring.rtype[i], ring.roots[N_DEFS + 1 + i]);
+    }
+    print_end(out, step, rtype, e);
+
+    ring_destroy(&ring);
+    trace_close(out, &local);
+    free_expr(e);
+
+    return governor_reason();
+}
+
+stop_reason normalize(expr *e) {
+    zip_reset();
+    if (!nf_cache_enabled()) {
+        const stop_reason r = rewrite(e, zip_step);
+        zip_reset();
+        return r;
+    }
+    n_pending = examined = last_step = 0;
+    const stop_reason r = rewrite(e, memo_step);
+    while (n_pending) nf_key_free(&pending[--n_pending].key); // left by a limit
+    zip_reset();
+
+    return r;
+}
+
+stop_reason normalize_strategy(const strategy s, expr *e) {
+    if (s == STRATEGY_NORMAL) return normalize(e);
+    running = s;
+    const stop_reason r = rewrite(e, strategy_steps[s]);
+    running = STRATEGY_NORMAL;
+
+    return r;
+}
+
+static bool round_step(cexpr *e, expr **ne, cchar **rtype) {
+    size_t n;
+    if (!reduce_parallel(e, ne, &n)) return false;
+    contracted += n;
+    *rtype = "∥";
+
+    return true;
+}
+
+stop_reason normalize_parallel(expr *e, const size_t threads) {
+    par_threads = threads;
+    par_pool = threads ? pool_create(threads, expr_heap_release) : NULL;
+    in_rounds = true;
+    contracted = 0;
+    const stop_reason r = rewrite(e, round_step);
+    in_rounds = false;
+    if (par_pool) pool_destroy(par_pool);
+    par_pool = NULL;
+
+    return r;
+}
+
+static THREAD_LOCAL term *def_terms[N_DEFS];
+
+/**
+ * @brief              Get the core term of a δ-definition, converting it
+ *                     on first use.
+ * @param  s           the symbol
+ * @return             the closed definition, or NULL if s is not defined
+ */
+static term *def_term(const sym s) {
+    const int i = find_def(s);
+    if (i < 0) return NULL;
+    if (!def_terms[i]) def_terms[i] = term_from_expr(def_vals[i]);
+
+    return def_terms[i];
+}
+
+/**
+ * @brief              A node on the path to the next redex of the De
+ *                     Bruijn engine, and which of its children the path
+ *                     goes through.
+ */
+typedef struct tred_frame {
+    term          *t;
+    enum { TRED_FN, TRED_ARG, TRED_BODY } stage;
+} tred_frame;
+
+HOT bool term_reduce_once(term *t, term **out, cchar **rtype) {
+    tred_frame local[STACK_LOCAL];
+    tred_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    term *n = t, *r = NULL;
+
+    // Leftmost-outermost, as find_redex
+    while (true) {
+        if (n->type == FREE_term && (r = def_term(n->free_sym))) { // closed and immutable, so shared as is
+            *rtype = RTYPE_DELTA;
             break;
         }
-        free_expr(e);
-        e = next;
-        sb_reset(&sb);
-        expr_to_buffer(e, sb.data, sb.cap);
+        if (n->type == APP_term && n->app_fn->type == ABS_term) {
+            r = term_beta(n->app_fn->abs_body, n->app_arg);
+            *rtype = RTYPE_BETA;
+            break;
+        }
+        if (n->type == APP_term || n->type == ABS_term) {
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            const bool app = n->type == APP_term;
+            st[sp++] = (tred_frame){n, app ? TRED_FN : TRED_BODY};
+            n = app ? n->app_fn : n->abs_body;
+            continue;
+        }
+        // Nothing to contract below: go on with the nearest argument left
+        while (sp && st[sp - 1].stage != TRED_FN) sp--;
+        if (!sp) break;
+        st[sp - 1].stage = TRED_ARG;
+        n = st[sp - 1].t->app_arg;
+    }
+
+    if (r) {
+        while (sp--) {
+            term *p = st[sp].t;
+            if (st[sp].stage == TRED_FN) r = make_tapp(r, p->app_arg);
+            else if (st[sp].stage == TRED_ARG) r = make_tapp(p->app_fn, r);
+            else r = make_tabs(p->abs_hint, r);
+        }
+        *out = r;
+    }
+    if (st != local) free(st);
 
-        if (CONFIG_SHOW_STEP_TYPE) printf("Step %d (%s): %s\n", step++, rtype, sb.data);
-        else printf("Step %d: %s\n", step++, sb.data);
+    return r != NULL;
+}
+
+/**
+ * @brief              Reclaim dead terms. The cached δ-definitions are
+ *                     roots along with the current term and the steps
+ *                     kept in the ring.
+ * @param  t           the current term, updated in place
+ * @param  r           the step ring, or NULL
+ */
+static void collect_terms(term **t, const step_ring *r) {
+    term *local[N_DEFS + 1];
+    term **roots = r && r->troots ? r->troots : local;
+    const size_t n = N_DEFS + 1 + (roots == local ? 0 : r->cap);
+    memcpy(roots, def_terms, sizeof def_terms);
+    roots[N_DEFS] = *t;
+    if (!term_collect_maybe(roots, n)) return;
+    memcpy(def_terms, roots, sizeof def_terms);
+    *t = roots[N_DEFS];
+}
+
+/**
+ * @brief              Print a step of the De Bruijn engine, converting it
+ *                     back to a named expression first.
+ */
+static void print_term_step(sink *out, const int step, cchar *rtype, cterm *t) {
+    expr *shown = term_to_expr(t);
+    print_step(out, step, rtype, shown);
+    shown = NULL;
+    collect(&shown, NULL);
+}
+
+/**
+ * @brief              Convert the final term of an engine back to a named
+ *                     expression. A term a limit stopped the engine on may
+ *                     share subterms without bound, so it is cut to
+ *                     READBACK_NODES nodes first.
+ */
+static expr *final_expr(term *t) {
+    return term_to_expr(governor_reason() == STOP_NONE ? t : term_elide(t, READBACK_NODES));
+}
+
+stop_reason normalize_db(expr *e) {
+    sink local, *out = trace_open(&local);
+    step_ring ring;
+    ring_init(&ring, true);
+    term *t = term_from_expr(e);
+    stats_size(t->size, t->depth);
+
+    int step = 0;
+    cchar *rtype = NULL;
+    while (true) {
+        if (!step && trace_now(step)) print_step(out, step, rtype, e);
+        else if (trace_now(step)) print_term_step(out, step, rtype, t);
+        else if (ring.cap) ring.troots[N_DEFS + 1 + ring_push(&ring, step, rtype)] = t;
+
+        term *next;
+        cchar *kind;
+        if (governor_exceeded((size_t) step) || !term_reduce_once(t, &next, &kind)) break;
+        t = next;
+        rtype = kind;
+        step++;
+        count_step(kind);
+        stats_size(t->size, t->depth);
+        collect_terms(&t, &ring);
     }
-    if (CONFIG_DELTA_ABSTRACT) {
-        expr *abs = abstract_numerals(e);
-        sb_reset(&sb);
-        expr_to_buffer(abs, sb.data, sb.cap);
-        printf("\nδ-abstracted: %s\n", sb.data);
-        free_expr(abs);
+
+    for (size_t k = ring.count > ring.cap ? ring.count - ring.cap : 0; k < ring.count; k++) {
+        const size_t i = k % ring.cap;
+        print_term_step(out, ring.step[i], ring.rtype[i], ring.troots[N_DEFS + 1 + i]);
     }
-    free_expr(e);
+    expr *r = trace == TRACE_QUIET && !result_fn ? NULL : final_expr(t);
+    print_end(out, step, rtype, r);
+
+    ring_destroy(&ring);
+    trace_close(out, &local);
+
+    term_heap_destroy();
+    memset(def_terms, 0, sizeof def_terms);
+
+    return governor_reason();
+}
+
+/**
+ * @brief              Print the trace of an engine that does not stop
+ *                     between steps: the initial term and the normal form,
+ *                     or the partial term if a limit stopped the engine.
+ * @param  out         the trace sink
+ * @param  e           the initial term
+ * @param  steps       the number of β/δ steps the engine performed
+ * @param  name        the engine name, shown as the reduction type
+ * @param  r           the final term
+ */
+static void print_run(sink *out, cexpr *e, const int steps, cchar *name, cexpr *r) {
+    stats_measure(e);
+    stats_measure(r);
+    if (trace == TRACE_QUIET || trace == TRACE_FINAL) {
+        print_end(out, steps, name, r);
+        return;
+    }
+    print_step(out, 0, NULL, e);
+    print_step(out, steps, name, r);
+    sink_printf(out, "\n→ %s.\n", governor_message(governor_reason()));
+    print_abstracted(out, r);
+}
+
+stop_reason normalize_graph(expr *e) {
+    sink local, *out = trace_open(&local);
+
+    graph_stats st;
+    expr *r = final_expr(graph_normalize(term_from_expr(e), def_term, &st));
+    stats_steps(st.beta, st.delta);
+    print_run(out, e, (int)(st.beta + st.delta), "graph", r);
+    trace_close(out, &local);
+
+    term_heap_destroy();
+    memset(def_terms, 0, sizeof def_terms);
+
+    return governor_reason();
+}
+
+stop_reason normalize_machine(expr *e) {
+    sink local, *out = trace_open(&local);
+
+    machine_stats st;
+    expr *r = final_expr(machine_normalize(term_from_expr(e), def_term, &st));
+    stats_steps(st.beta, st.delta);
+    print_run(out, e, (int)(st.beta + st.delta), "machine", r);
+    trace_close(out, &local);
+
+    term_heap_destroy();
+    memset(def_terms, 0, sizeof def_terms);
+
+    return governor_reason();
+}
+
+expr *normal_form(cexpr *e, nbe_stats *st) {
+    expr *r = final_expr(nbe_normalize(term_from_expr(e), def_term, st));
+
+    term_heap_destroy();
+    memset(def_terms, 0, sizeof def_terms);
+
+    return r;
+}
+
+stop_reason normalize_nbe(expr *e) {
+    sink local, *out = trace_open(&local);
+
+    nbe_stats st;
+    expr *r = normal_form(e, &st);
+    stats_steps(st.beta, st.delta);
+    print_run(out, e, (int)(st.beta + st.delta), "nbe", r);
+    trace_close(out, &local);
+
+    return governor_reason();
+}
+
+stop_reason normalize_with(const engine eng, expr *e) {
+    switch (eng) {
+        case ENGINE_REWRITE:  return normalize(e);
+        case ENGINE_DEBRUIJN: return normalize_db(e);
+        case ENGINE_GRAPH:    return normalize_graph(e);
+        case ENGINE_MACHINE:  return normalize_machine(e);
+        case ENGINE_NBE:      return normalize_nbe(e);
+    }
+
+    return STOP_NONE; // unreachable
 }
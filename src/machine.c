@@ -0,0 +1,205 @@
+#include "../include/machine.h"
+
+#include "../include/arena.h"
+#include "../include/governor.h"
+#include "../include/stack.h"
+#include "../include/symbol.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A closure pairs a term with the environment its loose indices refer
+   to. Environments are immutable linked lists, so pushing a binding
+   shares the rest. A closure without a term is a neutral variable
+   introduced when read-back goes under a binder; its level counts
+   binders from the root, and becomes an index again at read-back.    */
+
+typedef struct env env;
+
+typedef struct closure {
+    cterm         *t;        /* NULL for a neutral variable */
+    env           *env;
+    uint32         level;
+} closure;
+
+struct env {
+    closure       *c;
+    env           *next;
+};
+
+/**
+ * @brief              State of one machine_normalize call.
+ */
+typedef struct kctx {
+    arena          mem;
+    term_resolver  resolve;
+    machine_stats  st;
+    closure      **stack;    /* arguments, innermost application on top */
+    size_t         sp;
+    size_t         cap;
+} kctx;
+
+HOT static INLINE closure *k_closure(kctx *k, cterm *t, env *e, const uint32 level) {
+    closure *c = arena_alloc(&k->mem, sizeof *c);
+    c->t = t;
+    c->env = e;
+    c->level = level;
+    k->st.closures++;
+
+    return c;
+}
+
+HOT static INLINE env *k_bind(kctx *k, closure *c, env *next) {
+    env *e = arena_alloc(&k->mem, sizeof *e);
+    e->c = c;
+    e->next = next;
+
+    return e;
+}
+
+HOT static INLINE void k_push(kctx *k, closure *c) {
+    if (k->sp == k->cap) {
+        k->cap = k->cap ? 2 * k->cap : 1024;
+        k->stack = realloc(k->stack, sizeof *k->stack * k->cap);
+        if (!k->stack) {
+            perror("realloc for machine stack");
+            exit(1);
+        }
+    }
+    k->stack[k->sp++] = c;
+}
+
+/**
+ * @brief              A read-back waiting for a normal form: the body of
+ *                     a binder gone under, or the next argument of a
+ *                     head applied to those on the stack above base.
+ */
+typedef struct k_frame {
+    term          *head;     /* K_SPINE: the head applied so far */
+    sym            hint;     /* K_BODY: the binder */
+    size_t         base;
+    size_t         next;     /* K_SPINE: 1 + the argument read back next */
+    uint32         depth;    /* binders read back above the head */
+    enum { K_BODY, K_SPINE } kind;
+} k_frame;
+
+/**
+ * @brief              Run the machine on a closure to full normal form.
+ *                     Every run reduces its closure to a head and reads
+ *                     back the arguments left on the stack above its
+ *                     base, the last pushed, the innermost, first; the
+ *                     bodies and arguments read back wait on an explicit
+ *                     stack of frames rather than on the C stack. The
+ *                     bodies, arguments and variables left when
+ *                     governor_readback runs out are elided.
+ * @param  depth       the number of binders read back so far
+ */
+static term *k_run(kctx *k, cterm *t, env *e, uint32 depth) {
+    k_frame local[STACK_LOCAL];
+    k_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    size_t base = k->sp;
+    term *head, *r = NULL, *elided = NULL;
+    size_t made = 0;
+
+    governor_readback_start();
+    while (true) {
+        head = NULL;
+        switch (t->type) {
+            case IDX_term: {
+                k->st.lookups++;
+                const env *x = e;
+                for (uint32 i = t->idx; i; i--) x = x->next;
+                const closure *c = x->c;
+                if (!c->t) head = make_idx(depth - 1 - c->level);
+                else if (governor_readback(++made)) head = elided = elided ? elided : make_free(sym_intern(ELIDED));
+                else {
+                    t = c->t;
+                    e = c->env;
+                }
+                break;
+            }
+            case FREE_term: {
+                cterm *d = k->resolve ? k->resolve(t->free_sym) : NULL;
+                if (!d || governor_exceeded(k->st.beta + k->st.delta)) head = make_free(t->free_sym);
+                else {
+                    k->st.delta++;
+                    t = d;
+                    e = NULL;
+                }
+                break;
+            }
+            case APP_term:
+                k_push(k, k_closure(k, t->app_arg, e, 0));
+                t = t->app_fn;
+                break;
+            case ABS_term:
+                if (k->sp > base && !governor_exceeded(k->st.beta + k->st.delta)) {
+                    k->st.beta++;
+                    e = k_bind(k, k->stack[--k->sp], e);
+                    t = t->abs_body;
+                    break;
+                }
+                // No argument left, or out of budget: go under the binder
+                // with a neutral variable and leave any arguments applied
+                if (governor_readback(++made)) {
+                    head = elided = elided ? elided : make_free(sym_intern(ELIDED));
+                    break;
+                }
+                if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+                st[sp++] = (k_frame){NULL, t->abs_hint, base, 0, depth, K_BODY};
+                e = k_bind(k, k_closure(k, NULL, NULL, depth), e);
+                t = t->abs_body;
+                depth++;
+                base = k->sp;
+                break;
+        }
+        if (!head) continue;
+
+        // The head of this run reads back its arguments
+        if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+        st[sp++] = (k_frame){head, 0, base, k->sp, depth, K_SPINE};
+        while (sp) {
+            k_frame *f = &st[sp - 1];
+            if (f->kind == K_BODY) { // the body is done: apply the binder
+                *f = (k_frame){make_tabs(f->hint, r), 0, f->base, k->sp, f->depth, K_SPINE};
+                r = NULL;
+            }
+            if (r && (f->head != elided || r != elided)) f->head = make_tapp(f->head, r);
+            if (f->next > f->base && governor_readback(++made)) {
+                r = elided = elided ? elided : make_free(sym_intern(ELIDED));
+                f->next--;
+                continue;
+            }
+            if (f->next > f->base) { // the arguments are never neutral
+                const closure *a = k->stack[--f->next];
+                t = a->t;
+                e = a->env;
+                depth = f->depth;
+                base = k->sp;
+                r = NULL;
+                break;
+            }
+            k->sp = f->base;
+            r = f->head;
+            sp--;
+        }
+        if (!sp && r) break;
+    }
+    if (st != local) free(st);
+
+    return r;
+}
+
+term *machine_normalize(cterm *t, const term_resolver resolve, machine_stats *st) {
+    kctx k = {{NULL, NULL, INIT_ARENA_SIZE, 0, 0}, resolve, {0, 0, 0, 0}, NULL, 0, 0};
+
+    term *r = k_run(&k, t, NULL, 0);
+    if (st) *st = k.st;
+
+    free(k.stack);
+    arena_destroy(&k.mem);
+
+    return r;
+}
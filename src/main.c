@@ -2,43 +2,203 @@
  * TODO: Split lambda.h / lambda.c into logical modules: definitions, variable
  *       set, substitution, reduction, normalisation.
  *
- *       Eliminate global def_vals and sb. Pass them as parameters or make them
- *       local.
- *
- *       Fix sb_ensure realloc bug (temporary pointer) and add
- *       overflow/zero-size guards.
+ *       Eliminate global def_vals. Pass it as a parameter or make it local.
  *
  *       Protect count_applications from invalid input.
  *
  *       Decouple I/O from reduction. Normalisation should write to a provided
  *       stream or buffer.
  *
- *       Improve memory management. Consider arena allocation for expressions
- *       to reduce overhead and avoid recursive free.
- *
  *       Strengthen const‑correctness. Decide on true immutability and stick to
  *       it.
- *
- *       Address the multiple‑definition issue immediately to avoid linker
- *       errors on some platforms.
  */
 
+#define _POSIX_C_SOURCE 200809L /* getline */
+
+#include "../include/batch.h"
+#include "../include/binary.h"
+#include "../include/cache.h"
 #include "../include/expr.h"
 #include "../include/lambda.h"
-#include "../include/strbuf.h"
+#include "../include/parser.h"
+#include "../include/pool.h"
+#include "../include/stats.h"
+#include "../include/symbol.h"
 #include "../include/types.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-expr *def_vals[N_DEFS];
-strbuf sb;
+/**
+ * @brief              Command-line options.
+ */
+typedef struct options {
+    engine         eng;
+    strategy       strat;
+    bool           hashcons;
+    bool           native;
+    trace_mode     trace;
+    size_t         trace_n;
+    limits         lim;
+    cchar         *batch;    /* file of expressions, or NULL */
+    size_t         threads;  /* batch or round workers, 0 for one per processor */
+    bool           parallel; /* reduce in parallel rounds */
+    bool           cache;    /* memoize normal forms of closed subterms */
+    cchar         *cache_file; /* where to keep them between runs, or NULL */
+    cchar         *file;     /* file to read the expression from, or NULL */
+    cchar         *load;     /* binary image to read the expression from, or NULL */
+    cchar         *emit;     /* where to write the final term as an image, or NULL */
+    bool           stats;    /* print the run's statistics as JSON */
+} options;
+
+static cchar *emit_path;
+static bool   emit_failed;
+
+/**
+ * @brief              Write the final term of the reduction to the
+ *                     --emit-binary file.
+ * @param  e           the final term
+ */
+static void emit_result(cexpr *e) {
+    if (bin_save(e, emit_path)) return;
+    perror(emit_path);
+    emit_failed = true;
+}
+
+/**
+ * @brief              Parse the N of an option such as "--trace-every=N".
+ * @param  arg         the argument
+ * @param  name        the option name, up to and including '='
+ * @param  n           set to N on success
+ * @return             true if arg is name followed by a positive number
+ */
+static bool parse_count(cchar *arg, cchar *name, size_t *n) {
+    const size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || !isdigit((unsigned char) arg[len])) return false;
+
+    char *end;
+    errno = 0;
+    const unsigned long long v = strtoull(arg + len, &end, 10);
+    if (*end || errno || !v || v > SIZE_MAX) return false;
+    *n = (size_t) v;
+
+    return true;
+}
+
+/**
+ * @brief              Parse the seconds of "--max-time=SECONDS".
+ * @param  arg         the argument
+ * @param  secs        set to the seconds on success
+ * @return             true if arg is the option with a positive number
+ */
+static bool parse_seconds(cchar *arg, double *secs) {
+    cchar *name = "--max-time=";
+    const size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || !arg[len]) return false;
+
+    char *end;
+    const double v = strtod(arg + len, &end);
+    if (*end || !(v > 0)) return false;
+    *secs = v;
+
+    return true;
+}
+
+/**
+ * @brief              Parse one "--name=value" command-line option.
+ * @param  arg         the argument
+ * @param  o           the options to update
+ * @return             true if the option was recognized
+ */
+static bool parse_option(cchar *arg, options *o) {
+    if (!strcmp(arg, "--engine=rewrite")) o->eng = ENGINE_REWRITE;
+    else if (!strcmp(arg, "--engine=debruijn")) o->eng = ENGINE_DEBRUIJN;
+    else if (!strcmp(arg, "--engine=graph")) o->eng = ENGINE_GRAPH;
+    else if (!strcmp(arg, "--engine=machine")) o->eng = ENGINE_MACHINE;
+    else if (!strcmp(arg, "--engine=nbe")) o->eng = ENGINE_NBE;
+    else if (!strncmp(arg, "--strategy=", 11)) return strategy_parse(arg + 11, &o->strat);
+    else if (!strcmp(arg, "--hashcons")) o->hashcons = true;
+    else if (!strcmp(arg, "--native-arith")) o->native = true;
+    else if (!strcmp(arg, "--parallel")) o->parallel = true;
+    else if (!strcmp(arg, "--no-cache")) o->cache = false;
+    else if (!strncmp(arg, "--cache-file=", 13) && arg[13]) o->cache_file = arg + 13;
+    else if (!strncmp(arg, "--input-file=", 13) && arg[13]) o->file = arg + 13;
+    else if (!strncmp(arg, "--load-binary=", 14) && arg[14]) o->load = arg + 14;
+    else if (!strncmp(arg, "--emit-binary=", 14) && arg[14]) o->emit = arg + 14;
+    else if (!strcmp(arg, "--stats")) o->stats = true;
+    else if (!strcmp(arg, "--quiet")) o->trace = TRACE_QUIET;
+    else if (!strcmp(arg, "--final-only")) o->trace = TRACE_FINAL;
+    else if (parse_count(arg, "--trace-every=", &o->trace_n)) o->trace = TRACE_EVERY;
+    else if (parse_count(arg, "--trace-last=", &o->trace_n)) o->trace = TRACE_LAST;
+    else if (parse_count(arg, "--threads=", &o->threads)) return true;
+    else if (parse_count(arg, "--max-steps=", &o->lim.steps)) return true;
+    else if (parse_seconds(arg, &o->lim.seconds)) return true;
+    else if (parse_count(arg, "--max-memory=", &o->lim.bytes)) {
+        if (o->lim.bytes > SIZE_MAX >> 20) return false;
+        o->lim.bytes <<= 20; // given in MiB
+    }
+    else return false;
+
+    return true;
+}
 
 int main(cint argc, char *argv[]) {
     char *input = nullptr;
     expr *e = nullptr;
     int status = 1; // Default to error
+    options opts = {ENGINE_REWRITE, STRATEGY_NORMAL, false, false, TRACE_FULL, 1, {0, 0, 0}, NULL, 0, false, true, NULL, NULL, NULL, NULL, false};
+    int n_args = 0;
+
+    // Options start with "--"; everything else is part of the expression
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--batch")) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "--batch needs a file, or - for standard input\n");
+                return 1;
+            }
+            opts.batch = argv[++i];
+        } else if (strncmp(argv[i], "--", 2) != 0) argv[1 + n_args++] = argv[i];
+        else if (!parse_option(argv[i], &opts)) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opts.batch && n_args) {
+        fprintf(stderr, "--batch reads its expressions from the file only\n");
+        return 1;
+    }
+    if ((opts.file || opts.load) && (n_args || (opts.file && opts.load))) {
+        fprintf(stderr, "--input-file and --load-binary read the expression from the file only\n");
+        return 1;
+    }
+    if (opts.batch && (opts.file || opts.load || opts.emit || opts.stats)) {
+        fprintf(stderr, "--input-file, --load-binary, --emit-binary and --stats work on a single expression, not with --batch\n");
+        return 1;
+    }
+    if (opts.parallel && (opts.eng != ENGINE_REWRITE || opts.batch || opts.hashcons)) {
+        fprintf(stderr, "--parallel works with the rewrite engine only, without --batch or --hashcons\n");
+        return 1;
+    }
+
+    if (opts.strat != STRATEGY_NORMAL && (opts.eng != ENGINE_REWRITE || opts.batch || opts.parallel)) {
+        fprintf(stderr, "--strategy works with the rewrite engine only, without --batch or --parallel\n");
+        return 1;
+    }
+
+    expr_hashcons(opts.hashcons);
+    nf_cache_enable(opts.cache);
+    if (opts.cache && opts.cache_file && !nf_cache_open(opts.cache_file)) {
+        fprintf(stderr, "Cannot use %s as a normal-form cache\n", opts.cache_file);
+        return 1;
+    }
+    native_arith(opts.native);
+    trace_config(opts.trace, opts.trace_n);
+    emit_path = opts.emit;
+    if (opts.emit) trace_result(emit_result);
 
     // load δ-definitions
     for (int i = 0; i < N_DEFS; i++) {
@@ -51,11 +211,33 @@ int main(cint argc, char *argv[]) {
         }
     }
 
-    sb_init(&sb, MAX_PRINT_LEN);
+    expr_heap_seal(); // definitions are never collected
+
+    if (opts.batch) {
+        status = batch_run(opts.batch, opts.eng, &opts.lim, opts.threads ? opts.threads : pool_cpus());
+        goto cleanup;
+    }
 
-    if (argc > 1) {
+    stats_reset();
+    if (opts.file) {
+        stats_begin(PHASE_PARSE);
+        e = parse_file(opts.file);
+        stats_end();
+        if (!e) {
+            fprintf(stderr, "Cannot read %s\n", opts.file);
+            goto cleanup;
+        }
+    } else if (opts.load) {
+        stats_begin(PHASE_PARSE);
+        e = bin_load(opts.load);
+        stats_end();
+        if (!e) {
+            fprintf(stderr, "Cannot load %s as a binary term\n", opts.load);
+            goto cleanup;
+        }
+    } else if (n_args > 0) {
         size_t L = 0;
-        for (int i = 1; i < argc; i++) L += strlen(argv[i]) + 1;
+        for (int i = 1; i <= n_args; i++) L += strlen(argv[i]) + 1;
         input = malloc(L + 1);
 
         if (!input) {
@@ -65,9 +247,9 @@ int main(cint argc, char *argv[]) {
 
         input[0] = '\0';
 
-        for (int i = 1; i < argc; i++) {
+        for (int i = 1; i <= n_args; i++) {
             strcat(input, argv[i]);
-            if (i < argc - 1) strcat(input, " ");
+            if (i < n_args) strcat(input, " ");
         }
     } else {
         char *buf = nullptr;
@@ -94,19 +276,40 @@ int main(cint argc, char *argv[]) {
         }
     }
 
-    Parser p = {input, 0, strlen(input)};
-    e = parse(&p);
-    if (!e) goto cleanup;
-    normalize(e);
+    if (input) {
+        Parser p = {input, 0, strlen(input)};
+        stats_begin(PHASE_PARSE);
+        e = parse(&p);
+        stats_end();
+        if (!e) goto cleanup;
+    }
+
+    governor_start(&opts.lim);
+    stats_begin(PHASE_REDUCE);
+    const stop_reason stop = opts.parallel
+        ? normalize_parallel(e, opts.threads ? opts.threads : pool_cpus())
+        : opts.strat != STRATEGY_NORMAL ? normalize_strategy(opts.strat, e)
+        : normalize_with(opts.eng, e);
+    stats_end();
     e = nullptr;  // TODO: Does this actually need to be set to nullptr?
 
-    status = 0;
+    if (opts.stats) {
+        const run_stats st = stats_get();
+        sink err;
+        sink_init_file(&err, stderr);
+        stats_write_json(&err, &st);
+        sink_destroy(&err);
+    }
+
+    status = (int) stop; // 0, or the exit status of the limit hit
+    if (emit_failed && !status) status = 1;
 
     cleanup:
 
     if (input) free(input);
-    for (int i = 0; i < N_DEFS; i++) if (def_vals[i]) free_expr(def_vals[i]);
-    sb_destroy(&sb);
+    nf_cache_close();
+    expr_heap_destroy();
+    sym_table_destroy();
 
     return status;
 }
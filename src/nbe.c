@@ -0,0 +1,346 @@
+#include "../include/nbe.h"
+
+#include "../include/arena.h"
+#include "../include/governor.h"
+#include "../include/stack.h"
+#include "../include/symbol.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The semantic domain. A value is either a closure, an abstraction
+   paired with the environment of its loose indices, or a neutral term:
+   a free symbol or a variable bound during quoting, applied to a spine
+   of arguments. Environments and spines hold thunks, suspended terms
+   that are evaluated once and then remember their value.             */
+
+typedef struct value value;
+typedef struct thunk thunk;
+
+typedef struct env {
+    thunk         *th;
+    struct env    *next;
+} env;
+
+typedef struct spine {
+    thunk         *arg;
+    struct spine  *prev;     /* the arguments applied before this one */
+} spine;
+
+typedef enum {
+    LAM_v, VAR_v, FREE_v
+} vtag;
+
+struct value {
+    vtag           tag;
+    uint32         level;    /* VAR_v: binders quoted before this one */
+    sym            name;     /* FREE_v */
+    cterm         *lam;      /* LAM_v: the abstraction */
+    env           *env;      /* LAM_v */
+    spine         *args;     /* VAR_v, FREE_v; LAM_v left unapplied at a limit */
+};
+
+struct thunk {
+    cterm         *t;
+    env           *env;
+    value         *v;        /* NULL until forced */
+};
+
+/**
+ * @brief              State of one nbe_normalize call.
+ */
+typedef struct nctx {
+    arena          mem;
+    term_resolver  resolve;
+    nbe_stats      st;
+    thunk        **stack;    /* pending arguments, innermost on top */
+    size_t         sp;
+    size_t         cap;
+    size_t         made;     /* nodes and lookups of the readback */
+} nctx;
+
+HOT static INLINE value *v_alloc(nctx *c, const vtag tag) {
+    value *v = arena_alloc(&c->mem, sizeof *v);
+    v->tag = tag;
+    v->args = NULL;
+    c->st.values++;
+
+    return v;
+}
+
+HOT static INLINE thunk *suspend(nctx *c, cterm *t, env *e) {
+    thunk *th = arena_alloc(&c->mem, sizeof *th);
+    th->t = t;
+    th->env = e;
+    th->v = NULL;
+
+    return th;
+}
+
+HOT static INLINE env *bind(nctx *c, thunk *th, env *next) {
+    env *e = arena_alloc(&c->mem, sizeof *e);
+    e->th = th;
+    e->next = next;
+
+    return e;
+}
+
+HOT static INLINE void push(nctx *c, thunk *th) {
+    if (c->sp == c->cap) {
+        c->cap = c->cap ? 2 * c->cap : 1024;
+        c->stack = realloc(c->stack, sizeof *c->stack * c->cap);
+        if (!c->stack) {
+            perror("realloc for nbe stack");
+            exit(1);
+        }
+    }
+    c->stack[c->sp++] = th;
+}
+
+/**
+ * @brief              Apply a neutral value, or a closure that a limit
+ *                     keeps from being applied, to the pending arguments
+ *                     above base. Values are shared, so the spine is
+ *                     extended into a new value.
+ */
+static value *stuck(nctx *c, const value *n, const size_t base) {
+    if (c->sp == base) return (value *)n;
+
+    value *v = v_alloc(c, n->tag);
+    *v = *n;
+    while (c->sp > base) {
+        spine *s = arena_alloc(&c->mem, sizeof *s);
+        s->arg = c->stack[--c->sp];
+        s->prev = v->args;
+        v->args = s;
+    }
+
+    return v;
+}
+
+/**
+ * @brief              A thunk being forced, and the base of the pending
+ *                     arguments of the evaluation that forces it.
+ */
+typedef struct force_frame {
+    thunk         *th;
+    size_t         base;
+} force_frame;
+
+/**
+ * @brief              Evaluate a term in an environment to a value. The
+ *                     arguments of an application spine are suspended on
+ *                     the stack and consumed by the closures they meet.
+ *                     A variable whose thunk is not forced yet evaluates
+ *                     it in place, on an explicit stack of forces. Once a
+ *                     limit has stopped the reduction, thunks are no
+ *                     longer forced: the variable stands for the thunk's
+ *                     term, read in the thunk's environment.
+ */
+HOT static value *eval(nctx *c, cterm *t, env *e) {
+    force_frame local[STACK_LOCAL];
+    force_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    size_t base = c->sp;
+    value *v = NULL;
+
+    while (true) {
+        switch (t->type) {
+            case IDX_term: {
+                const env *x = e;
+                for (uint32 i = t->idx; i; i--) x = x->next;
+                thunk *th = x->th;
+                if (!th->v && governor_reason() != STOP_NONE) {
+                    if (!governor_readback(++c->made)) {
+                        t = th->t;
+                        e = th->env;
+                        continue;
+                    }
+                    value *n = v_alloc(c, FREE_v);
+                    n->name = sym_intern(ELIDED);
+                    v = stuck(c, n, base);
+                    break;
+                }
+                if (!th->v) {
+                    if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+                    st[sp++] = (force_frame){th, base};
+                    t = th->t;
+                    e = th->env;
+                    base = c->sp;
+                    continue;
+                }
+                v = th->v;
+                if (v->tag == LAM_v && !v->args && c->sp > base) {
+                    t = v->lam;
+                    e = v->env;
+                    continue;
+                }
+                v = stuck(c, v, base);
+                break;
+            }
+            case FREE_term: {
+                cterm *d = c->resolve ? c->resolve(t->free_sym) : NULL;
+                if (!d || governor_exceeded(c->st.beta + c->st.delta)) {
+                    value *n = v_alloc(c, FREE_v);
+                    n->name = t->free_sym;
+                    v = stuck(c, n, base);
+                    break;
+                }
+                c->st.delta++;
+                t = d;
+                e = NULL;
+                continue;
+            }
+            case APP_term:
+                push(c, suspend(c, t->app_arg, e));
+                t = t->app_fn;
+                continue;
+            case ABS_term:
+                if (c->sp == base || governor_exceeded(c->st.beta + c->st.delta)) {
+                    value *l = v_alloc(c, LAM_v);
+                    l->lam = t;
+                    l->env = e;
+                    v = stuck(c, l, base);
+                    break;
+                }
+                c->st.beta++;
+                e = bind(c, c->stack[--c->sp], e);
+                t = t->abs_body;
+                continue;
+        }
+
+        // v is the value of the innermost evaluation: remember it in the
+        // thunk forced for it, and go on with the variable that forced it
+        bool applied = false;
+        while (sp && !applied) {
+            const force_frame f = st[--sp];
+            f.th->v = v;
+            c->st.forced++;
+            base = f.base;
+            if (v->tag == LAM_v && !v->args && c->sp > base) {
+                t = v->lam;
+                e = v->env;
+                applied = true;
+            } else v = stuck(c, v, base);
+        }
+        if (!applied) break;
+    }
+    if (st != local) free(st);
+
+    return v;
+}
+
+static value *force(nctx *c, thunk *th) {
+    if (!th->v && governor_reason() != STOP_NONE) return eval(c, th->t, th->env);
+    if (!th->v) {
+        th->v = eval(c, th->t, th->env);
+        c->st.forced++;
+    }
+
+    return th->v;
+}
+
+/**
+ * @brief              A read-back waiting for a normal form: the body of
+ *                     a closure, or the next argument of a head applied
+ *                     to the spine arguments above base.
+ */
+typedef struct q_frame {
+    term          *head;     /* Q_SPINE: the head applied so far */
+    const value   *lam;      /* Q_BODY: the closure */
+    size_t         base;     /* Q_SPINE: the arguments left start above it */
+    uint32         depth;    /* binders quoted above the head */
+    enum { Q_BODY, Q_SPINE } kind;
+} q_frame;
+
+/**
+ * @brief              Read a value back as a term. The bodies and spine
+ *                     arguments being read back wait on explicit stacks;
+ *                     a spine is pushed newest first, so that its oldest
+ *                     argument is on top. The bodies and arguments left
+ *                     when governor_readback runs out are elided.
+ * @param  depth       the number of binders quoted so far
+ */
+static term *quote(nctx *c, const value *v, uint32 depth) {
+    q_frame local[STACK_LOCAL];
+    q_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    thunk *alocal[STACK_LOCAL];
+    thunk **args = alocal;
+    size_t acap = STACK_LOCAL, ap = 0;
+    term *r = NULL, *elided = NULL;
+
+    governor_readback_start();
+    while (true) {
+        term *head;
+        const spine *s = v->args;
+        if (governor_readback(++c->made)) {
+            head = elided = elided ? elided : make_free(sym_intern(ELIDED));
+            s = NULL;
+        } else if (v->tag == LAM_v) {
+            // Apply the closure to a fresh variable and quote its body
+            value *x = v_alloc(c, VAR_v);
+            x->level = depth;
+            thunk *th = suspend(c, NULL, NULL);
+            th->v = x;
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            st[sp++] = (q_frame){NULL, v, 0, depth, Q_BODY};
+            v = eval(c, v->lam->abs_body, bind(c, th, v->env));
+            depth++;
+            continue;
+        } else head = v->tag == VAR_v ? make_idx(depth - 1 - v->level) : make_free(v->name);
+
+        while (true) {
+            if (s || head) { // a head to apply to its spine
+                if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+                st[sp++] = (q_frame){head, NULL, ap, depth, Q_SPINE};
+                for (; s; s = s->prev) {
+                    if (ap == acap) args = stack_grow(args, alocal, &acap, sizeof *args);
+                    args[ap++] = s->arg;
+                }
+                head = NULL;
+                r = NULL;
+            }
+            if (!sp) break;
+            q_frame *f = &st[sp - 1];
+            if (f->kind == Q_BODY) { // the body is done: bind it and apply
+                head = make_tabs(f->lam->lam->abs_hint, r);
+                s = f->lam->args;
+                depth = f->depth;
+                sp--;
+                continue;
+            }
+            if (r && (f->head != elided || r != elided)) f->head = make_tapp(f->head, r);
+            if (ap > f->base && governor_readback(c->made)) {
+                r = elided = elided ? elided : make_free(sym_intern(ELIDED));
+                ap--;
+                continue;
+            }
+            if (ap > f->base) {
+                v = force(c, args[--ap]);
+                depth = f->depth;
+                break;
+            }
+            r = f->head;
+            sp--;
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+    if (args != alocal) free(args);
+
+    return r;
+}
+
+term *nbe_normalize(cterm *t, const term_resolver resolve, nbe_stats *st) {
+    nctx c = {{NULL, NULL, INIT_ARENA_SIZE, 0, 0}, resolve, {0, 0, 0, 0}, NULL, 0, 0, 0};
+
+    term *r = quote(&c, eval(&c, t, NULL), 0);
+    if (st) *st = c.st;
+
+    free(c.stack);
+    arena_destroy(&c.mem);
+
+    return r;
+}
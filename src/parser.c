@@ -1,13 +1,67 @@
+#define _POSIX_C_SOURCE 200809L /* posix_madvise */
+
 #include "../include/parser.h"
 
 #include "../include/expr.h"
 #include "../include/macros.h"
+#include "../include/stack.h"
+#include "../include/symbol.h"
 #include "../include/types.h"
 
-#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define IDENT_CACHE        256 /* power of two */
+
+/* The tokenizer classifies bytes with one table lookup. λ is the two
+   bytes 0xCE 0xBB; a 0xCE not followed by 0xBB is part of a name.
+   Whitespace is what isspace accepts in the C locale.               */
+enum { CC_IDENT, CC_DIGIT, CC_LAMBDA, CC_SPACE, CC_DELIM, CC_END };
+
+static const uint8 char_class[256] = {
+    ['\0'] = CC_END,
+    ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+    [' '] = CC_SPACE,
+    ['('] = CC_DELIM, [')'] = CC_DELIM, ['.'] = CC_DELIM,
+    ['0'] = CC_DIGIT, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT,
+    ['5'] = CC_DIGIT, ['6'] = CC_DIGIT, ['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+    [0xCE] = CC_LAMBDA,
+};
+
+/**
+ * @brief              A binder being parsed and the symbol its name was
+ *                     bound to outside it.
+ */
+typedef struct parse_scope {
+    sym            name;
+    sym            shadowed;
+} parse_scope;
+
+/* bound_to[s] is the symbol the innermost binder in scope named s was
+   renamed to, or SYM_NONE if there is none, so that a name is resolved
+   without searching the scope. Entries are restored as binders leave. */
+static THREAD_LOCAL sym   *bound_to;
+static THREAD_LOCAL uint32 bound_cap;
+
+/**
+ * @brief              A construct waiting for the expression inside it:
+ *                     an application collecting atoms, the body of an
+ *                     abstraction, or a parenthesized expression.
+ */
+typedef struct parse_frame {
+    enum { PF_APP, PF_ABS, PF_PAREN } kind;
+    bool           single;   /* PF_APP: stop after one atom       */
+    expr          *acc;      /* PF_APP: the atoms applied so far  */
+} parse_frame;
 
 HOT PURE INLINE char peek(const Parser *p) {
     if (p->i < p->n) return p->src[p->i];
@@ -25,143 +79,339 @@ HOT INLINE char consume(Parser *p) {
     return p->src[p->i++];
 }
 
-/* TODO: This function is called very often, so it should be optimized
-         for performance. Calls to this function should also be
-         consolidated together to reduce redundant computation. */
 HOT INLINE void skip_whitespace(Parser *p) {
     cchar *src = p->src;
     size_t i = p->i;
     const size_t n = p->n;
 
-    while (i < n && isspace((uchar)src[i])) i++;
+    while (i < n && char_class[(uchar) src[i]] == CC_SPACE) {
+        i++;
+#ifdef __SSE2__
+        // The rest of a run, such as indentation, 16 bytes at a time
+        while (n - i >= 16) {
+            const __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+            const __m128i t = _mm_sub_epi8(b, _mm_set1_epi8('\t')); // \t to \r become 0 to 4
+            const __m128i space = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8(' ')),
+                                               _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t));
+            const uint32 m = ~(uint32) _mm_movemask_epi8(space) & 0xFFFF;
+            if (m) {
+                i += (size_t) __builtin_ctz(m);
+                break;
+            }
+            i += 16;
+        }
+#endif
+    }
 
     p->i = i;
 }
 
+/**
+ * @brief              Check whether a name ends before the byte at i.
+ */
+HOT PURE static INLINE bool ends_name(cchar *src, const size_t i, const size_t n) {
+    const uint8 c = char_class[(uchar) src[i]];
+
+    return c >= CC_SPACE || (c == CC_LAMBDA && i + 1 < n && (uchar) src[i + 1] == 0xBB);
+}
+
+/**
+ * @brief              Find the end of the name starting at i. Blocks of
+ *                     16 bytes are screened at once for the bytes that
+ *                     may end it, which are then checked one by one.
+ * @return             the index just past the name
+ */
+HOT PURE static INLINE size_t name_end(cchar *src, size_t i, const size_t n) {
+#ifdef __SSE2__
+    while (n - i >= 16) {
+        const __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(b, _mm_set1_epi8(' ')), b); // NUL, whitespace
+        const __m128i paren = _mm_cmpeq_epi8(_mm_or_si128(b, _mm_set1_epi8(1)), _mm_set1_epi8(')'));
+        const __m128i other = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('.')),
+                                           _mm_cmpeq_epi8(b, _mm_set1_epi8((char) 0xCE)));
+        uint32 m = (uint32) _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(low, paren), other));
+        while (m) {
+            const size_t k = i + (size_t) __builtin_ctz(m);
+            if (ends_name(src, k, n)) return k;
+            m &= m - 1;
+        }
+        i += 16;
+    }
+#endif
+    while (i < n && !ends_name(src, i, n)) i++;
+
+    return i;
+}
+
 HOT PURE INLINE bool is_lambda(const Parser *p) {
     return (p->i + 1 < p->n) && ((uchar) p->src[p->i] == 0xCE)
                              && ((uchar) p->src[p->i + 1] == 0xBB);
 }
 
 HOT PURE INLINE bool is_invalid_char(const Parser *p, cchar c) {
-    return (!c) || (c == '(')
-                || (c == ')')
-                || (c == '.')
-                || (isspace((uchar) c))
-                || is_lambda(p);
+    return !c || char_class[(uchar) c] >= CC_SPACE || is_lambda(p);
 }
 
-expr *parse(Parser *p) {
+/**
+ * @brief              Scan the name at the parser's position.
+ * @param  p           the parser, moved past the name
+ * @return             the length of the name, or 0 if there is none
+ */
+HOT static INLINE size_t scan_name(Parser *p) {
     skip_whitespace(p);
-    expr *e = parse_expr(p);
-    skip_whitespace(p);
-    if (peek(p)) {
-        fprintf(stderr, "Unexpected '%c' at %zu\n", peek(p), p->i);
-        exit(1);
-    }
+    const size_t start = p->i;
+    p->i = name_end(p->src, start, p->n);
+    if (p->i == start) fprintf(stderr, "Invalid var start at %zu\n", p->i);
 
-    return e;
+    return p->i - start;
 }
 
-HOT INLINE expr *parse_expr(Parser *p) {
-    skip_whitespace(p);
-    return is_lambda(p) ? parse_abs(p) : parse_app(p);
+/**
+ * @brief              Parse a variable name like parse_varname, looking
+ *                     it up among the names the same parse has met
+ *                     before interning it. The cache is direct-mapped.
+ * @param  p           the parser
+ * @param  cache       IDENT_CACHE symbols, SYM_NONE where empty
+ * @return             the interned variable name, or SYM_NONE if there
+ *                     is none
+ */
+HOT static INLINE sym parse_name(Parser *p, sym *cache) {
+    const size_t len = scan_name(p);
+    if (!len) return SYM_NONE;
+    cchar *s = p->src + p->i - len;
+    const uint32 k = ((uchar) s[0] + 31u * (uchar) s[len - 1] + 131u * (uint32) len) & (IDENT_CACHE - 1);
+    const sym c = cache[k];
+    if (c != SYM_NONE && sym_len(c) == len && !memcmp(sym_name(c), s, len)) return c;
+
+    return cache[k] = sym_intern_n(s, len);
 }
 
-HOT INLINE expr *parse_abs(Parser *p) {
-    p->i += 2; // consume λ
-    char *v = parse_varname(p);
-    skip_whitespace(p);
-
-    if (consume(p) != '.') {
-        fprintf(stderr, "Expected '.' after λ\n");
-        exit(1);
+/**
+ * @brief              Enter the scope of a binder named s, renamed to b.
+ */
+static parse_scope scope_enter(const sym s, const sym b) {
+    if (s >= bound_cap) {
+        const uint32 n = sym_count();
+        bound_to = realloc(bound_to, sizeof *bound_to * n);
+        if (!bound_to) {
+            perror("realloc for binder scope");
+            exit(1);
+        }
+        memset(bound_to + bound_cap, 0xFF, sizeof *bound_to * (n - bound_cap));
+        bound_cap = n;
     }
+    const parse_scope sc = {s, bound_to[s]};
+    bound_to[s] = b;
+
+    return sc;
+}
 
-    cexpr *body = parse_expr(p);
-    expr *ret = make_abstraction(v, body);
-    free(v);
+/**
+ * @brief              Leave the scope of a binder.
+ * @return             the symbol the binder was renamed to
+ */
+static sym scope_leave(const parse_scope *sc) {
+    const sym b = bound_to[sc->name];
+    bound_to[sc->name] = sc->shadowed;
 
-    return ret;
+    return b;
 }
 
-HOT INLINE expr *parse_app(Parser *p) {
+/**
+ * @brief              Get the symbol a variable named s refers to: the
+ *                     one the innermost binder of that name was renamed
+ *                     to, or s itself if it is free.
+ */
+static sym scope_resolve(const sym s) {
+    const sym b = s < bound_cap ? bound_to[s] : SYM_NONE;
+
+    return b == SYM_NONE ? s : b;
+}
+
+expr *parse(Parser *p) {
     skip_whitespace(p);
-    expr *e = parse_atom(p);
+    expr *e = parse_expr(p);
+    if (!e) return NULL;
     skip_whitespace(p);
-    char c = peek(p);
-    while (c && c != ')' && c != '.') {
-        expr *a = parse_atom(p);
-        e = make_application(e, a);
-        skip_whitespace(p);
-        c = peek(p);
+    if (peek(p)) {
+        fprintf(stderr, "Unexpected '%c' at %zu\n", peek(p), p->i);
+        return NULL;
     }
 
     return e;
 }
 
-HOT INLINE expr *parse_atom(Parser *p) {
-    skip_whitespace(p);
-    // Check for lambda as atom
-    if (is_lambda(p)) return parse_abs(p);
-    cchar c = peek(p);
-
-    if (c == '(') {
-        consume(p);
-        expr *e = parse_expr(p);
+/**
+ * @brief              Parse with an explicit stack instead of recursing
+ *                     on nesting, so that the depth of the input is not
+ *                     bounded by the C stack. An abstraction extends as
+ *                     far right as possible, whether it starts an
+ *                     expression or appears as an argument.
+ * @param  single      true to parse one atom, false for an expression
+ * @return             the expression, or NULL if the input is malformed
+ */
+static expr *parse_frames(Parser *p, const bool single) {
+    parse_frame local[STACK_LOCAL];
+    parse_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    st[sp++] = (parse_frame){PF_APP, single, NULL};
+
+    // Binders in scope, innermost last. A binder gets a symbol of its own
+    // name and depth (Barendregt convention), distinct from every binder
+    // around it, so substitution into the parsed term rarely has to
+    // rename one, and parsing many terms adds no symbols once their
+    // names and depths have been seen.
+    parse_scope scope_local[STACK_LOCAL];
+    parse_scope *scope = scope_local;
+    size_t scope_cap = STACK_LOCAL, n_scope = 0;
+    sym names[IDENT_CACHE];
+    memset(names, 0xFF, sizeof names);
+
+    // Terms are immutable, so every occurrence of a variable can be the
+    // same node; the last node made for each slot is reused
+    expr *vars[IDENT_CACHE] = {NULL};
+    expr *atom;
+
+    while (true) {
+        parse_frame *f = &st[sp - 1]; // always an application here
         skip_whitespace(p);
-
-        if (consume(p) != ')') {
-            fprintf(stderr, "Expected ')'\n");
-            exit(1);
+        const char c = peek(p);
+
+        if (f->acc && (f->single || !c || c == ')' || c == '.')) {
+            // The application is complete: hand it to what waits for it
+            atom = f->acc;
+            for (sp--; sp && st[sp - 1].kind != PF_APP; sp--) {
+                if (st[sp - 1].kind == PF_ABS) atom = make_abs_sym(scope_leave(&scope[--n_scope]), atom);
+                else {
+                    skip_whitespace(p);
+                    if (consume(p) != ')') {
+                        fprintf(stderr, "Expected ')'\n");
+                        atom = NULL;
+                        goto done;
+                    }
+                }
+            }
+            if (!sp) break;
+        } else if (is_lambda(p)) {
+            p->i += 2; // consume λ
+            const sym v = parse_name(p, names);
+            if (v == SYM_NONE) {
+                atom = NULL;
+                goto done;
+            }
+            skip_whitespace(p);
+
+            if (consume(p) != '.') {
+                fprintf(stderr, "Expected '.' after λ\n");
+                atom = NULL;
+                goto done;
+            }
+            if (n_scope == scope_cap) scope = stack_grow(scope, scope_local, &scope_cap, sizeof *scope);
+            scope[n_scope] = scope_enter(v, sym_binder(v, (uint32) n_scope));
+            n_scope++;
+            if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+            st[sp++] = (parse_frame){PF_ABS, false, NULL};
+            st[sp++] = (parse_frame){PF_APP, false, NULL};
+            continue;
+        } else if (c == '(') {
+            consume(p);
+            if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+            st[sp++] = (parse_frame){PF_PAREN, false, NULL};
+            st[sp++] = (parse_frame){PF_APP, false, NULL};
+            continue;
+        } else if (char_class[(uchar) c] == CC_DIGIT) {
+            uint64 v;
+            if (!parse_number(p, &v)) {
+                atom = NULL;
+                goto done;
+            }
+            atom = church(v);
+        } else {
+            const sym v = parse_name(p, names);
+            if (v == SYM_NONE) {
+                atom = NULL;
+                goto done;
+            }
+            const sym b = scope_resolve(v);
+            expr **slot = &vars[b & (IDENT_CACHE - 1)];
+            if (!*slot || (*slot)->var_sym != b) *slot = make_var_sym(b);
+            atom = *slot;
         }
 
-        return e;
+        f = &st[sp - 1];
+        f->acc = f->acc ? make_application(f->acc, atom) : atom;
     }
-    if (isdigit((uchar) c)) {
-        const int v = parse_number(p);
-        return church(v);
-    }
-    char *name = parse_varname(p);
-    expr *v = make_variable(name);
-    free(name);
 
-    return v;
+    done:
+    while (n_scope) scope_leave(&scope[--n_scope]);
+    if (st != local) free(st);
+    if (scope != scope_local) free(scope);
+
+    return atom;
 }
 
-int parse_number(Parser *p) {
-    int v = 0;
+expr *parse_expr(Parser *p) {
+    return parse_frames(p, false);
+}
 
-    if (!isdigit((uchar) peek(p))) {
-        fprintf(stderr, "Expected digit at %zu\n", p->i);
-        exit(1);
-    }
+expr *parse_abs(Parser *p) {
+    return parse_frames(p, false);
+}
 
-    while (isdigit((uchar) peek(p))) v = v * 10 + (consume(p) - '0');
+expr *parse_app(Parser *p) {
+    return parse_frames(p, false);
+}
 
-    return v;
+expr *parse_atom(Parser *p) {
+    return parse_frames(p, true);
 }
 
-HOT INLINE char *parse_varname(Parser *p) {
-    skip_whitespace(p);
-    const unsigned int start = p->i;
-    while (p->i < p->n && !is_invalid_char(p, peek(p))) p->i++;
-    unsigned int len = p->i - start;
+bool parse_number(Parser *p, uint64 *out) {
+    cchar *src = p->src;
+    size_t i = p->i;
+    const size_t n = p->n;
+    uint64 v = 0;
 
-    if (len == 0) {
-        fprintf(stderr, "Invalid var start at %zu\n", p->i);
-        exit(1);
+    if (i == n || char_class[(uchar) src[i]] != CC_DIGIT) {
+        fprintf(stderr, "Expected digit at %zu\n", i);
+        return false;
     }
 
-    char *out = malloc(len + 1);
-
-    if (!out) {
-        perror("malloc");
-        exit(1);
+    for (; i < n && char_class[(uchar) src[i]] == CC_DIGIT; i++) {
+        const uint64 d = (uint64)(src[i] - '0');
+        if (v > (UINT64_MAX - d) / 10) {
+            fprintf(stderr, "Numeral too large at %zu\n", i + 1);
+            return false;
+        }
+        v = v * 10 + d;
     }
+    p->i = i;
+    *out = v;
+
+    return true;
+}
+
+HOT INLINE sym parse_varname(Parser *p) {
+    const size_t len = scan_name(p);
+    if (!len) return SYM_NONE;
+
+    return sym_intern_n(p->src + p->i - len, len);
+}
 
-    memcpy(out, p->src + start, len);
-    out[len] = '\0';
+expr *parse_file(cchar *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
 
-    return out;
+    struct stat sb;
+    char *m = fstat(fd, &sb) == 0 && sb.st_size > 0
+        ? mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+
+    posix_madvise(m, (size_t) sb.st_size, POSIX_MADV_SEQUENTIAL);
+    Parser p = {m, 0, (size_t) sb.st_size};
+    expr *e = parse(&p);
+    munmap(m, (size_t) sb.st_size);
+
+    return e;
 }
@@ -0,0 +1,191 @@
+#include "../include/pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief              The indices [next, end) a thread has yet to run.
+ *                     Its owner takes from the front, thieves from the
+ *                     back.
+ */
+typedef struct slice {
+    pthread_mutex_t lock;
+    size_t         next;
+    size_t         end;
+} slice;
+
+struct pool {
+    pthread_t     *threads;
+    size_t         n_threads;
+    slice         *slices;   /* one per worker, the last for pool_wait */
+    pthread_mutex_t lock;
+    pthread_cond_t start;    /* a loop was submitted or the pool stops */
+    pthread_cond_t done;     /* the last worker ran out of indices     */
+    pool_fn        fn;
+    void          *ctx;
+    void         (*at_exit)(void);
+    uint64         round;    /* loops submitted so far                 */
+    size_t         busy;     /* workers still running the loop         */
+    bool           stop;
+};
+
+typedef struct worker_arg {
+    pool          *p;
+    size_t         self;
+} worker_arg;
+
+/**
+ * @brief              Take the next index of a thread's slice, stealing
+ *                     the upper half of another slice when it is empty.
+ * @param  p           the pool
+ * @param  self        the slice of the calling thread
+ * @param  i           set to the index taken
+ * @return             false if every slice is empty
+ */
+static bool take(pool *p, const size_t self, size_t *i) {
+    slice *own = &p->slices[self];
+    pthread_mutex_lock(&own->lock);
+    const bool have = own->next < own->end;
+    if (have) *i = own->next++;
+    pthread_mutex_unlock(&own->lock);
+    if (have) return true;
+
+    const size_t n = p->n_threads + 1;
+    for (size_t k = 1; k < n; k++) {
+        slice *v = &p->slices[(self + k) % n];
+        pthread_mutex_lock(&v->lock);
+        const size_t left = v->end - v->next;
+        if (!left) {
+            pthread_mutex_unlock(&v->lock);
+            continue;
+        }
+        const size_t from = v->end - (left + 1) / 2, to = v->end;
+        v->end = from;
+        pthread_mutex_unlock(&v->lock);
+
+        pthread_mutex_lock(&own->lock);
+        own->next = from + 1;
+        own->end = to;
+        pthread_mutex_unlock(&own->lock);
+        *i = from;
+        return true;
+    }
+
+    return false;
+}
+
+static void run(pool *p, const size_t self) {
+    size_t i;
+    while (take(p, self, &i)) p->fn(p->ctx, i);
+}
+
+static void *worker(void *arg) {
+    pool *p = ((worker_arg *) arg)->p;
+    const size_t self = ((worker_arg *) arg)->self;
+    free(arg);
+
+    uint64 seen = 0;
+    while (true) {
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && p->round == seen) pthread_cond_wait(&p->start, &p->lock);
+        if (p->stop) {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        seen = p->round;
+        pthread_mutex_unlock(&p->lock);
+
+        run(p, self);
+
+        pthread_mutex_lock(&p->lock);
+        if (!--p->busy) pthread_cond_broadcast(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+    if (p->at_exit) p->at_exit();
+
+    return NULL;
+}
+
+size_t pool_cpus(void) {
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (size_t) n : 1;
+}
+
+pool *pool_create(const size_t threads, void (*at_exit)(void)) {
+    pool *p = calloc(1, sizeof *p);
+    if (!p) {
+        perror("calloc for pool");
+        exit(1);
+    }
+    p->n_threads = threads ? threads : 1;
+    p->at_exit = at_exit;
+    p->threads = malloc(sizeof *p->threads * p->n_threads);
+    p->slices = calloc(p->n_threads + 1, sizeof *p->slices);
+    if (!p->threads || !p->slices) {
+        perror("malloc for pool");
+        exit(1);
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+    for (size_t k = 0; k <= p->n_threads; k++) pthread_mutex_init(&p->slices[k].lock, NULL);
+
+    for (size_t k = 0; k < p->n_threads; k++) {
+        worker_arg *arg = malloc(sizeof *arg);
+        if (!arg) {
+            perror("malloc for pool");
+            exit(1);
+        }
+        *arg = (worker_arg){p, k};
+        if (pthread_create(&p->threads[k], NULL, worker, arg)) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    return p;
+}
+
+void pool_submit(pool *p, const size_t n, const pool_fn fn, void *ctx) {
+    pthread_mutex_lock(&p->lock);
+    p->fn = fn;
+    p->ctx = ctx;
+    // Contiguous slices keep neighbouring indices on one thread
+    for (size_t k = 0; k < p->n_threads; k++) {
+        p->slices[k].next = n * k / p->n_threads;
+        p->slices[k].end = n * (k + 1) / p->n_threads;
+    }
+    p->slices[p->n_threads].next = p->slices[p->n_threads].end = 0;
+    p->busy = p->n_threads;
+    p->round++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_wait(pool *p) {
+    run(p, p->n_threads);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->busy) pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_destroy(pool *p) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+    for (size_t k = 0; k < p->n_threads; k++) pthread_join(p->threads[k], NULL);
+
+    for (size_t k = 0; k <= p->n_threads; k++) pthread_mutex_destroy(&p->slices[k].lock);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->start);
+    pthread_cond_destroy(&p->done);
+    free(p->slices);
+    free(p->threads);
+    free(p);
+}
@@ -0,0 +1,124 @@
+#include "../include/sink.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void write_file(void *ctx, const char *data, const size_t len) {
+    if (fwrite(data, 1, len, ctx) != len) {
+        perror("fwrite for sink");
+        exit(1);
+    }
+}
+
+static void write_fd(void *ctx, const char *data, size_t len) {
+    const int fd = *(const int *)ctx;
+    while (len) {
+        const ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write for sink");
+            exit(1);
+        }
+        data += n;
+        len -= (size_t) n;
+    }
+}
+
+void sink_init_fn(sink *s, const sink_fn fn, void *ctx) {
+    sb_init(&s->buf, fn ? SINK_FLUSH_AT : 256);
+    s->write = fn;
+    s->ctx = ctx;
+    s->fd = -1;
+    s->bytes = 0;
+}
+
+void sink_init_file(sink *s, FILE *f) {
+    sink_init_fn(s, write_file, f);
+}
+
+void sink_init_fd(sink *s, const int fd) {
+    sink_init_fn(s, write_fd, NULL);
+    s->fd = fd;
+    s->ctx = &s->fd;
+}
+
+void sink_init_mem(sink *s) {
+    sink_init_fn(s, NULL, NULL);
+}
+
+void sink_flush(sink *s) {
+    if (!s->write || !s->buf.len) return;
+    s->write(s->ctx, s->buf.data, s->buf.len);
+    sb_reset(&s->buf);
+}
+
+HOT void sink_write(sink *s, const char *p, const size_t n) {
+    s->bytes += n;
+    // A flushing sink's buffer is exactly SINK_FLUSH_AT bytes, so room
+    // left in it also means no flush is due
+    if (n < s->buf.cap - s->buf.len) {
+        memcpy(s->buf.data + s->buf.len, p, n);
+        s->buf.len += n;
+        s->buf.data[s->buf.len] = '\0';
+        return;
+    }
+    if (s->write && s->buf.len + n >= SINK_FLUSH_AT) {
+        sink_flush(s);
+        if (n >= SINK_FLUSH_AT) {
+            s->write(s->ctx, p, n); // too big to be worth copying
+            return;
+        }
+    }
+    sb_append(&s->buf, p, n);
+}
+
+HOT void sink_putc(sink *s, const char c) {
+    if (s->buf.len + 1 < s->buf.cap) {
+        s->bytes++;
+        s->buf.data[s->buf.len++] = c;
+        s->buf.data[s->buf.len] = '\0';
+        return;
+    }
+    sink_write(s, &c, 1);
+}
+
+void sink_puts(sink *s, const char *str) {
+    sink_write(s, str, strlen(str));
+}
+
+void sink_printf(sink *s, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char small[256];
+    const int n = vsnprintf(small, sizeof small, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        perror("vsnprintf for sink");
+        exit(1);
+    }
+    if ((size_t) n < sizeof small) {
+        sink_write(s, small, (size_t) n);
+        return;
+    }
+
+    char *big = malloc((size_t) n + 1);
+    if (!big) {
+        perror("malloc for sink");
+        exit(1);
+    }
+    va_start(ap, fmt);
+    vsnprintf(big, (size_t) n + 1, fmt, ap);
+    va_end(ap);
+    sink_write(s, big, (size_t) n);
+    free(big);
+}
+
+void sink_destroy(sink *s) {
+    sink_flush(s);
+    if (s->write == write_file) fflush(s->ctx);
+    sb_destroy(&s->buf);
+}
@@ -0,0 +1,26 @@
+#include "../include/stack.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void *stack_grow(void *stack, const void *local, size_t *cap, const size_t size) {
+    if (*cap > SIZE_MAX / 2 / size) {
+        fprintf(stderr, "stack: size overflow\n");
+        exit(1);
+    }
+    const size_t n = 2 * *cap;
+    void *grown;
+    if (stack == local) {
+        grown = malloc(n * size);
+        if (grown) memcpy(grown, stack, *cap * size);
+    } else grown = realloc(stack, n * size);
+    if (!grown) {
+        perror("realloc for traversal stack");
+        exit(1);
+    }
+    *cap = n;
+
+    return grown;
+}
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include "../include/stats.h"
+
+#include "../include/cache.h"
+#include "../include/expr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PHASE_NESTING      8
+
+static THREAD_LOCAL run_stats       counters; /* events, and what stats_add added */
+static THREAD_LOCAL expr_heap_stats base;     /* the heap at the last stats_reset  */
+
+/* The phases under way, innermost last; only the innermost one runs. */
+static THREAD_LOCAL stats_phase     phases[PHASE_NESTING];
+static THREAD_LOCAL size_t          n_phases;
+static THREAD_LOCAL double          since;    /* when the innermost one resumed */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+void stats_reset(void) {
+    counters = (run_stats){0};
+    base = expr_heap_get_stats();
+    if (n_phases) since = now();
+}
+
+run_stats stats_get(void) {
+    run_stats s = counters;
+    const expr_heap_stats h = expr_heap_get_stats();
+    s.nodes_allocated += h.nodes_allocated - base.nodes_allocated;
+    s.bytes_allocated += h.bytes_allocated - base.bytes_allocated;
+    s.nodes_freed += h.nodes_freed - base.nodes_freed;
+    s.collections += h.collections - base.collections;
+    if (h.nodes_peak > s.nodes_peak) s.nodes_peak = h.nodes_peak;
+    if (n_phases) s.seconds[phases[n_phases - 1]] += now() - since;
+
+    return s;
+}
+
+void stats_add(const run_stats *s) {
+    counters.beta += s->beta;
+    counters.delta += s->delta;
+    counters.substitutions += s->substitutions;
+    counters.renamings += s->renamings;
+    counters.copied_bytes += s->copied_bytes;
+    counters.nodes_allocated += s->nodes_allocated;
+    counters.bytes_allocated += s->bytes_allocated;
+    counters.nodes_freed += s->nodes_freed;
+    counters.collections += s->collections;
+    if (s->nodes_peak > counters.nodes_peak) counters.nodes_peak = s->nodes_peak;
+    if (s->max_size > counters.max_size) counters.max_size = s->max_size;
+    if (s->max_depth > counters.max_depth) counters.max_depth = s->max_depth;
+    for (int i = 0; i < N_PHASES; i++) counters.seconds[i] += s->seconds[i];
+}
+
+HOT void stats_steps(const size_t beta, const size_t delta) {
+    counters.beta += beta;
+    counters.delta += delta;
+}
+
+HOT void stats_substitution(void) {
+    counters.substitutions++;
+}
+
+void stats_renaming(void) {
+    counters.renamings++;
+}
+
+void stats_copied(const size_t bytes) {
+    counters.copied_bytes += bytes;
+}
+
+HOT void stats_size(const size_t size, const size_t depth) {
+    if (size > counters.max_size) counters.max_size = size;
+    if (depth > counters.max_depth) counters.max_depth = depth;
+}
+
+HOT void stats_measure(cexpr *e) {
+    if (e) stats_size(e->size, e->depth);
+}
+
+void stats_begin(const stats_phase p) {
+    if (n_phases == PHASE_NESTING) {
+        fprintf(stderr, "stats: phases nested too deeply\n");
+        exit(1);
+    }
+    const double t = now();
+    if (n_phases) counters.seconds[phases[n_phases - 1]] += t - since;
+    phases[n_phases++] = p;
+    since = t;
+}
+
+void stats_end(void) {
+    if (!n_phases) return;
+    const double t = now();
+    counters.seconds[phases[--n_phases]] += t - since;
+    since = t;
+}
+
+void stats_write_json(sink *out, const run_stats *s) {
+    static cchar *names[N_PHASES] = {"parse", "reduce", "print", "abstract"};
+    const nf_cache_stats c = nf_cache_get_stats();
+
+    sink_printf(out, "{\n  \"steps\": %zu,\n  \"beta\": %zu,\n  \"delta\": %zu,\n", s->beta + s->delta, s->beta,
+                s->delta);
+    sink_printf(out, "  \"substitutions\": %zu,\n  \"renamings\": %zu,\n  \"copied_bytes\": %zu,\n",
+                s->substitutions, s->renamings, s->copied_bytes);
+    sink_printf(out, "  \"nodes_allocated\": %zu,\n  \"bytes_allocated\": %zu,\n  \"nodes_freed\": %zu,\n",
+                s->nodes_allocated, s->bytes_allocated, s->nodes_freed);
+    sink_printf(out, "  \"peak_live_nodes\": %zu,\n  \"collections\": %zu,\n", s->nodes_peak, s->collections);
+    sink_printf(out, "  \"max_term_size\": %zu,\n  \"max_term_depth\": %zu,\n", s->max_size, s->max_depth);
+    sink_printf(out, "  \"cache\": {\"hits\": %zu, \"misses\": %zu, \"entries\": %zu, \"bytes\": %zu},\n",
+                c.hits, c.misses, c.entries, c.bytes);
+    sink_puts(out, "  \"seconds\": {");
+    for (int i = 0; i < N_PHASES; i++) sink_printf(out, "%s\"%s\": %.6f", i ? ", " : "", names[i], s->seconds[i]);
+    sink_puts(out, "}\n}\n");
+}
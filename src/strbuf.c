@@ -1,36 +1,51 @@
 #include "../include/strbuf.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void sb_init(strbuf *sb, const size_t init_cap) {
-    sb->data = malloc(init_cap);
+    const size_t cap = init_cap ? init_cap : 1; // room for the terminator
+    sb->data = malloc(cap);
     if (!sb->data) {
         perror("malloc for strbuf");
         exit(1);
     }
-    sb->cap = init_cap;
+    sb->cap = cap;
     sb->len = 0;
     sb->data[0] = '\0';
 }
 
 void sb_ensure(strbuf *sb, const size_t need) {
+    if (need >= SIZE_MAX / 2 || sb->len >= SIZE_MAX / 2 - need) {
+        fprintf(stderr, "strbuf: size overflow\n");
+        exit(1);
+    }
     if (sb->len + need + 1 > sb->cap) {
-        size_t new = sb->cap * 2;
+        size_t new = sb->cap ? sb->cap * 2 : 64;
         while (new < sb->len + need + 1) new *= 2;
 
-        sb->data = realloc(sb->data, new);
-        if (!sb->data) {
+        char *grown = realloc(sb->data, new);
+        if (!grown) {
             perror("realloc for strbuf");
             exit(1);
         }
+        sb->data = grown;
         sb->cap = new;
     }
 }
 
+void sb_append(strbuf *sb, const char *p, const size_t n) {
+    sb_ensure(sb, n);
+    memcpy(sb->data + sb->len, p, n);
+    sb->len += n;
+    sb->data[sb->len] = '\0';
+}
+
 void sb_reset(strbuf *sb) {
     sb->len = 0;
-    sb->data[0] = '\0';
+    if (sb->data) sb->data[0] = '\0';
 }
 
 void sb_destroy(strbuf *sb) {
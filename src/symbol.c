@@ -0,0 +1,287 @@
+#include "../include/symbol.h"
+
+#include "../include/arena.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYM_CHUNK_BITS     16
+#define SYM_CHUNK          (1u << SYM_CHUNK_BITS)
+#define SYM_MAX_CHUNKS     (1u << (32 - SYM_CHUNK_BITS))
+
+/**
+ * @brief              Interned symbol.
+ */
+typedef struct sym_entry {
+    cchar         *name;
+    uint32         len;
+    uint32         hash;
+    sym            root;     /* the interned symbol it was made from */
+} sym_entry;
+
+/**
+ * @brief              The symbol sym_binder gives binders of a name at a
+ *                     depth, or sym_fresh gives a name at an ordinal.
+ */
+typedef struct binder_slot {
+    sym            root;     /* SYM_NONE when empty */
+    uint32         depth;    /* or ordinal */
+    sym            alias;
+} binder_slot;
+
+/**
+ * @brief              An open addressing table of binder slots.
+ */
+typedef struct binder_table {
+    binder_slot   *slots;
+    uint32         n;
+    uint32         n_slots;  /* power of two */
+} binder_table;
+
+/* One table serves every thread. Entries live in fixed chunks that
+   never move, so the accessors read them without locking: a thread only
+   ever asks about symbols it was handed after they were made. Anything
+   that adds a symbol or probes the hash table holds sym_lock.        */
+static arena        sym_text = {NULL, NULL, 64 * 1024, 0, 0};
+static sym_entry   *chunks[SYM_MAX_CHUNKS];
+static uint32       n_entries;
+static sym         *slots;    /* open addressing, SYM_NONE when empty */
+static uint32       n_slots;  /* power of two                         */
+static binder_table binders;  /* sym_binder                          */
+static binder_table renames;  /* sym_fresh                           */
+static pthread_mutex_t sym_lock = PTHREAD_MUTEX_INITIALIZER;
+
+HOT static INLINE sym_entry *entry(const sym s) {
+    return &chunks[s >> SYM_CHUNK_BITS][s & (SYM_CHUNK - 1)];
+}
+
+HOT static INLINE uint32 sym_hash(cchar *s, const size_t len) {
+    uint32 h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uchar) s[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static void sym_rehash(const uint32 new_slots) {
+    sym *t = malloc(sizeof *t * new_slots);
+    if (!t) {
+        perror("malloc for symbol table");
+        exit(1);
+    }
+    memset(t, 0xFF, sizeof *t * new_slots);
+    for (uint32 i = 0; i < n_entries; i++) {
+        if (entry(i)->root != i) continue; // generated
+        uint32 j = entry(i)->hash & (new_slots - 1);
+        while (t[j] != SYM_NONE) j = (j + 1) & (new_slots - 1);
+        t[j] = i;
+    }
+    free(slots);
+    slots = t;
+    n_slots = new_slots;
+}
+
+static sym sym_find(cchar *s, const size_t len, const uint32 h, uint32 *slot) {
+    if (!n_slots) {
+        *slot = 0;
+        return SYM_NONE;
+    }
+    uint32 j = h & (n_slots - 1);
+    while (slots[j] != SYM_NONE) {
+        const sym_entry *en = entry(slots[j]);
+        if (en->hash == h && en->len == len && !memcmp(en->name, s, len)) return slots[j];
+        j = (j + 1) & (n_slots - 1);
+    }
+    *slot = j;
+
+    return SYM_NONE;
+}
+
+/**
+ * @brief              Copy symbol text into the table's arena. The arena
+ *                     serves every thread, so its chunks are never counted
+ *                     in the reserved total of the thread that grows it.
+ *                     The caller holds sym_lock.
+ */
+static char *sym_text_alloc(const size_t len) {
+    arena_own(&sym_text);
+    char *text = arena_alloc(&sym_text, len);
+    arena_disown(&sym_text);
+
+    return text;
+}
+
+/**
+ * @brief              Append an entry to the symbol table.
+ * @return             the new symbol
+ */
+static sym sym_add(cchar *text, const uint32 len, const uint32 h, const sym root) {
+    if (n_entries == SYM_NONE) {
+        fprintf(stderr, "symbol table: too many symbols\n");
+        exit(1);
+    }
+    sym_entry **c = &chunks[n_entries >> SYM_CHUNK_BITS];
+    if (!*c) {
+        *c = malloc(sizeof **c * SYM_CHUNK);
+        if (!*c) {
+            perror("malloc for symbol table");
+            exit(1);
+        }
+    }
+    *entry(n_entries) = (sym_entry){text, len, h, root};
+
+    return n_entries++;
+}
+
+HOT sym sym_intern_n(cchar *s, const size_t len) {
+    const uint32 h = sym_hash(s, len);
+    uint32 slot;
+    pthread_mutex_lock(&sym_lock);
+    sym found = sym_find(s, len, h, &slot);
+    if (found == SYM_NONE) {
+        if (2 * (n_entries + 1) > n_slots) {
+            sym_rehash(n_slots ? 2 * n_slots : 256);
+            sym_find(s, len, h, &slot);
+        }
+        char *text = sym_text_alloc(len + 1);
+        memcpy(text, s, len);
+        text[len] = '\0';
+        slots[slot] = n_entries;
+        found = sym_add(text, (uint32) len, h, n_entries);
+    }
+    pthread_mutex_unlock(&sym_lock);
+
+    return found;
+}
+
+HOT sym sym_intern(cchar *s) {
+    return sym_intern_n(s, strlen(s));
+}
+
+sym sym_lookup(cchar *s) {
+    const size_t len = strlen(s);
+    uint32 slot;
+    pthread_mutex_lock(&sym_lock);
+    const sym found = sym_find(s, len, sym_hash(s, len), &slot);
+    pthread_mutex_unlock(&sym_lock);
+
+    return found;
+}
+
+/* Generated symbols are never entered in the hash table, so no
+   identifier the parser reads can ever resolve to one of them.      */
+
+sym sym_alias(const sym s) {
+    const sym root = entry(s)->root;
+    const sym_entry r = *entry(root);
+    pthread_mutex_lock(&sym_lock);
+    const sym a = sym_add(r.name, r.len, r.hash, root);
+    pthread_mutex_unlock(&sym_lock);
+
+    return a;
+}
+
+/**
+ * @brief              Find the slot of binders named root at a depth.
+ */
+static binder_slot *binder_find(binder_slot *t, const uint32 n, const sym root, const uint32 depth) {
+    uint32 j = (root * 2654435761u ^ depth * 2246822519u) & (n - 1);
+    while (t[j].root != SYM_NONE && (t[j].root != root || t[j].depth != depth)) j = (j + 1) & (n - 1);
+
+    return &t[j];
+}
+
+/**
+ * @brief              Find the slot of root at a depth or ordinal, making
+ *                     room for a new one first. The caller holds sym_lock
+ *                     and fills an empty slot.
+ */
+static binder_slot *binder_slot_for(binder_table *b, const sym root, const uint32 depth) {
+    if (2 * (b->n + 1) > b->n_slots) {
+        const uint32 n = b->n_slots ? 2 * b->n_slots : 256;
+        binder_slot *t = malloc(sizeof *t * n);
+        if (!t) {
+            perror("malloc for symbol table");
+            exit(1);
+        }
+        for (uint32 i = 0; i < n; i++) t[i].root = SYM_NONE;
+        for (uint32 i = 0; i < b->n_slots; i++)
+            if (b->slots[i].root != SYM_NONE) *binder_find(t, n, b->slots[i].root, b->slots[i].depth) = b->slots[i];
+        free(b->slots);
+        b->slots = t;
+        b->n_slots = n;
+    }
+
+    return binder_find(b->slots, b->n_slots, root, depth);
+}
+
+sym sym_binder(const sym s, const uint32 depth) {
+    const sym root = entry(s)->root;
+    pthread_mutex_lock(&sym_lock);
+    binder_slot *b = binder_slot_for(&binders, root, depth);
+    if (b->root == SYM_NONE) {
+        const sym_entry r = *entry(root);
+        *b = (binder_slot){root, depth, sym_add(r.name, r.len, r.hash, root)};
+        binders.n++;
+    }
+    const sym a = b->alias;
+    pthread_mutex_unlock(&sym_lock);
+
+    return a;
+}
+
+sym sym_fresh(const sym s, const uint32 ordinal) {
+    const sym root = entry(s)->root;
+    pthread_mutex_lock(&sym_lock);
+    binder_slot *b = binder_slot_for(&renames, root, ordinal);
+    if (b->root == SYM_NONE) {
+        const sym_entry r = *entry(root);
+        char *text = sym_text_alloc(r.len + 12);
+        const int len = sprintf(text, "%s%u", r.name, ordinal);
+        *b = (binder_slot){root, ordinal, sym_add(text, (uint32) len, sym_hash(text, (size_t) len), root)};
+        renames.n++;
+    }
+    const sym f = b->alias;
+    pthread_mutex_unlock(&sym_lock);
+
+    return f;
+}
+
+PURE sym sym_root(const sym s) {
+    return entry(s)->root;
+}
+
+PURE cchar *sym_name(const sym s) {
+    return entry(s)->name;
+}
+
+PURE size_t sym_len(const sym s) {
+    return entry(s)->len;
+}
+
+uint32 sym_count(void) {
+    pthread_mutex_lock(&sym_lock);
+    const uint32 n = n_entries;
+    pthread_mutex_unlock(&sym_lock);
+
+    return n;
+}
+
+void sym_table_destroy(void) {
+    arena_own(&sym_text); // so that destroying it leaves the total as it was
+    arena_destroy(&sym_text);
+    for (uint32 i = 0; i < SYM_MAX_CHUNKS && chunks[i]; i++) {
+        free(chunks[i]);
+        chunks[i] = NULL;
+    }
+    free(slots);
+    slots = NULL;
+    free(binders.slots);
+    free(renames.slots);
+    binders = renames = (binder_table){NULL, 0, 0};
+    n_entries = n_slots = 0;
+}
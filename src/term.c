@@ -0,0 +1,727 @@
+#include "../include/term.h"
+
+#include "../include/arena.h"
+#include "../include/expr.h"
+#include "../include/stack.h"
+#include "../include/symbol.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_FORWARDED UINT32_MAX
+#define TERM_SIZE     ARENA_ALIGN(sizeof(term))
+
+/* Same scheme as the expr heap: bump allocation plus a Cheney copy of
+   whatever the reducer still holds. Every thread has its own heap.   */
+static THREAD_LOCAL arena  nursery      = {NULL, NULL, INIT_ARENA_SIZE, 0, 0};
+static THREAD_LOCAL uint32 heap_gen     = 1;
+static THREAD_LOCAL size_t gc_threshold = INIT_ARENA_SIZE;
+
+CONST static INLINE uint64 sat_add(const uint64 a, const uint64 b) {
+    return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+CONST static INLINE uint32 deeper(const uint32 d) {
+    return d == UINT32_MAX ? d : d + 1;
+}
+
+HOT static INLINE term *term_alloc(const termType t, const uint32 loose, const uint64 size, const uint32 depth) {
+    term *r = arena_alloc(&nursery, sizeof *r);
+    r->type = t;
+    r->gen = heap_gen;
+    r->loose = loose;
+    r->size = size;
+    r->depth = depth;
+
+    return r;
+}
+
+HOT term *make_idx(const uint32 i) {
+    term *t = term_alloc(IDX_term, i + 1, 1, 1);
+    t->open = 0;
+    t->idx = i;
+
+    return t;
+}
+
+HOT term *make_free(const sym s) {
+    term *t = term_alloc(FREE_term, 0, 1, 1);
+    t->open = 1;
+    t->free_sym = s;
+
+    return t;
+}
+
+HOT term *make_tabs(const sym hint, term *b) {
+    term *t = term_alloc(ABS_term, b->loose ? b->loose - 1 : 0, sat_add(b->size, 1), deeper(b->depth));
+    t->open = b->open;
+    t->abs_hint = hint;
+    t->abs_body = b;
+
+    return t;
+}
+
+HOT term *make_tapp(term *f, term *a) {
+    term *t = term_alloc(APP_term, f->loose > a->loose ? f->loose : a->loose,
+                         sat_add(sat_add(f->size, a->size), 1), deeper(f->depth > a->depth ? f->depth : a->depth));
+    t->open = f->open | a->open;
+    t->app_fn = f;
+    t->app_arg = a;
+
+    return t;
+}
+
+/**
+ * @brief              A node being rebuilt, with the binders above it and
+ *                     the function part of it done so far.
+ */
+typedef struct tm_frame {
+    term          *t;
+    term          *fn;       /* APP: the rebuilt function */
+    uint32         depth;
+    enum { TM_BODY, TM_FN, TM_ARG } stage;
+} tm_frame;
+
+/**
+ * @brief              Rebuild a term bottom-up with an explicit stack,
+ *                     counting the binders passed. leaf is asked first
+ *                     about every node; a result stands for the whole
+ *                     subterm, NULL means rebuild the node from its
+ *                     rebuilt children.
+ */
+HOT static term *term_map(term *t, uint32 depth, term *(*leaf)(term *, uint32, const void *), const void *ctx) {
+    tm_frame local[STACK_LOCAL];
+    tm_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    term *r;
+
+    while (true) {
+        // Down the leftmost path to a node leaf settles
+        while (!(r = leaf(t, depth, ctx))) {
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            if (t->type == ABS_term) {
+                st[sp++] = (tm_frame){t, NULL, depth, TM_BODY};
+                t = t->abs_body;
+                depth++;
+            } else {
+                st[sp++] = (tm_frame){t, NULL, depth, TM_FN};
+                t = t->app_fn;
+            }
+        }
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            tm_frame *f = &st[sp - 1];
+            if (f->stage == TM_FN) {
+                f->fn = r;
+                f->stage = TM_ARG;
+                t = f->t->app_arg;
+                depth = f->depth;
+                break;
+            }
+            r = f->stage == TM_ARG ? make_tapp(f->fn, r) : make_tabs(f->t->abs_hint, r);
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+
+    return r;
+}
+
+HOT static term *shift_leaf(term *t, const uint32 cutoff, const void *ctx) {
+    if (t->loose <= cutoff) return t; // nothing escapes past cutoff
+    if (t->type == IDX_term) return make_idx(t->idx + *(const uint32 *) ctx);
+
+    return t->type == FREE_term ? t : NULL;
+}
+
+HOT term *term_shift(term *t, const uint32 cutoff, const uint32 d) {
+    if (d == 0) return t;
+
+    return term_map(t, cutoff, shift_leaf, &d);
+}
+
+HOT static term *subst_leaf(term *t, const uint32 depth, const void *val) {
+    if (t->loose <= depth) return t; // no index reaches the binder
+    if (t->type == IDX_term) return t->idx == depth ? term_shift((term *) val, 0, depth) : make_idx(t->idx - 1);
+
+    return t->type == FREE_term ? t : NULL;
+}
+
+HOT term *term_subst(term *t, const uint32 depth, term *val) {
+    return term_map(t, depth, subst_leaf, val);
+}
+
+HOT term *term_beta(term *b, term *a) {
+    return term_subst(b, 0, a);
+}
+
+/**
+ * @brief              The nodes term_elide may still keep, and the
+ *                     variable standing for what it leaves out.
+ */
+typedef struct elision {
+    uint64         left;
+    term          *elided;
+} elision;
+
+static term *elide_leaf(term *t, const uint32 depth, const void *ctx) {
+    (void) depth;
+    elision *el = (elision *) ctx;
+    if (t->size <= el->left) { // the whole subterm fits
+        el->left -= t->size;
+        return t;
+    }
+    if (el->left == 0) return el->elided;
+    el->left--;
+
+    return NULL;
+}
+
+term *term_elide(term *t, const uint64 nodes) {
+    if (t->size <= nodes) return t;
+    elision el = {nodes, make_free(sym_intern(ELIDED))};
+
+    return term_map(t, 0, elide_leaf, &el);
+}
+
+/**
+ * @brief              A binder above a node: its name, the depth of the
+ *                     binder of the same name it shadows, and its number
+ *                     in the order binders are met.
+ */
+typedef struct scope_entry {
+    sym            s;
+    uint32         shadowed;
+    uint32         id;
+} scope_entry;
+
+/**
+ * @brief              The binders above a node, outermost first, so that
+ *                     index i names the binder i from the top.
+ */
+typedef struct scope {
+    scope_entry    local[STACK_LOCAL];
+    scope_entry   *v;
+    size_t         cap;
+    size_t         n;
+} scope;
+
+/* innermost[s] is one more than the depth of the innermost binder in
+   scope named s, or 0 if there is none, so that a name is resolved
+   without searching the scope. Entries go back to 0 as binders leave. */
+static THREAD_LOCAL uint32 *innermost;
+static THREAD_LOCAL uint32  innermost_cap;
+
+static void scope_init(scope *sc) {
+    sc->v = sc->local;
+    sc->cap = STACK_LOCAL;
+    sc->n = 0;
+}
+
+static void scope_push(scope *sc, const sym s, const uint32 id) {
+    if (s >= innermost_cap) {
+        const uint32 n = sym_count();
+        innermost = realloc(innermost, sizeof *innermost * n);
+        if (!innermost) {
+            perror("realloc for binder scope");
+            exit(1);
+        }
+        memset(innermost + innermost_cap, 0, sizeof *innermost * (n - innermost_cap));
+        innermost_cap = n;
+    }
+    if (sc->n == sc->cap) sc->v = stack_grow(sc->v, sc->local, &sc->cap, sizeof *sc->v);
+    sc->v[sc->n] = (scope_entry){s, innermost[s], id};
+    innermost[s] = (uint32) ++sc->n;
+}
+
+static sym scope_pop(scope *sc) {
+    const scope_entry *b = &sc->v[--sc->n];
+    innermost[b->s] = b->shadowed;
+
+    return b->s;
+}
+
+static sym scope_at(const scope *sc, const uint32 i) {
+    return sc->v[sc->n - 1 - i].s;
+}
+
+/**
+ * @brief              Get the depth of the innermost binder in scope
+ *                     named s, plus one, or 0 if there is none.
+ */
+static uint32 scope_find(const sym s) {
+    return s < innermost_cap ? innermost[s] : 0;
+}
+
+/**
+ * @brief              A node being converted and the function part of it
+ *                     done so far.
+ */
+typedef struct fe_frame {
+    cexpr         *e;
+    term          *fn;       /* APP: the converted function */
+    enum { FE_BODY, FE_FN, FE_ARG } stage;
+} fe_frame;
+
+/**
+ * @brief              Convert a variable or a numeral.
+ */
+static term *from_leaf(cexpr *e, const scope *sc) {
+    if (e->type == VAR_expr) {
+        const uint32 d = scope_find(e->var_sym);
+        return d ? make_idx((uint32) sc->n - d) : make_free(e->var_sym);
+    }
+
+    // λf.λx.f (... (f x)): f is index 1 and x index 0
+    term *body = make_idx(0);
+    for (uint64 i = 0; i < e->num; i++) body = make_tapp(make_idx(1), body);
+
+    return make_tabs(sym_intern("f"), make_tabs(sym_intern("x"), body));
+}
+
+term *term_from_expr(cexpr *e) {
+    fe_frame local[STACK_LOCAL];
+    fe_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    scope sc;
+    scope_init(&sc);
+    term *r;
+
+    while (true) {
+        // Down the leftmost path to a variable or a numeral
+        while (e->type == ABS_expr || e->type == APP_expr) {
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            if (e->type == ABS_expr) {
+                st[sp++] = (fe_frame){e, NULL, FE_BODY};
+                scope_push(&sc, e->abs_sym, 0);
+                e = e->abs_body;
+            } else {
+                st[sp++] = (fe_frame){e, NULL, FE_FN};
+                e = e->app_fn;
+            }
+        }
+        r = from_leaf(e, &sc);
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            fe_frame *f = &st[sp - 1];
+            if (f->stage == FE_FN) {
+                f->fn = r;
+                f->stage = FE_ARG;
+                e = f->e->app_arg;
+                break;
+            }
+            if (f->stage == FE_ARG) r = make_tapp(f->fn, r);
+            else r = make_tabs(scope_pop(&sc), r);
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+    if (sc.v != sc.local) free(sc.v);
+
+    return r;
+}
+
+/**
+ * @brief              Where the variables of a term being converted back
+ *                     occur. Leaves are numbered left to right and
+ *                     binders in the order they are met, so the body of
+ *                     binder b holds leaves first[b] to last[b] - 1. The
+ *                     leaves referring to an owner, which is binder b or
+ *                     the free symbol numbered f as n_binders + f, are
+ *                     leaf[start[o]] to leaf[start[o + 1]] - 1, ascending.
+ *                     The free symbols are numbered up front; the rest is
+ *                     only built once a binder's name is already taken.
+ */
+typedef struct occurrences {
+    cterm         *root;
+    uint32        *first;    /* NULL until built */
+    uint32        *last;
+    uint32        *start;
+    uint32        *leaf;
+    sym           *free;     /* the free symbols, by number */
+    uint32         n_binders;
+    uint32         n_free;
+    uint32         free_cap;
+} occurrences;
+
+/* free_no[s] is one more than the number of free symbol s in the term
+   being converted back, or 0. Entries go back to 0 after the term.   */
+static THREAD_LOCAL uint32 *free_no;
+static THREAD_LOCAL uint32  free_no_cap;
+
+/**
+ * @brief              Number a free symbol when first met.
+ */
+static void oc_number_free(occurrences *o, const sym s) {
+    if (s >= free_no_cap) {
+        const uint32 n = sym_count();
+        free_no = realloc(free_no, sizeof *free_no * n);
+        if (!free_no) {
+            perror("realloc for term occurrences");
+            exit(1);
+        }
+        memset(free_no + free_no_cap, 0, sizeof *free_no * (n - free_no_cap));
+        free_no_cap = n;
+    }
+    if (free_no[s]) return;
+    if (o->n_free == o->free_cap) {
+        o->free_cap = o->free_cap ? 2 * o->free_cap : 8;
+        o->free = realloc(o->free, sizeof *o->free * o->free_cap);
+        if (!o->free) {
+            perror("realloc for term occurrences");
+            exit(1);
+        }
+    }
+    o->free[o->n_free++] = s;
+    free_no[s] = o->n_free;
+}
+
+/**
+ * @brief              A subterm to number, under depth binders, or the
+ *                     end of binder id's body if t is NULL.
+ */
+typedef struct oc_item {
+    cterm         *t;
+    uint32         depth;
+    uint32         id;
+} oc_item;
+
+static void *oc_alloc(const size_t n, const size_t size) {
+    void *p = calloc(n ? n : 1, size);
+    if (!p) {
+        perror("calloc for term occurrences");
+        exit(1);
+    }
+
+    return p;
+}
+
+/**
+ * @brief              Walk a term in conversion order, counting binders
+ *                     and leaves, and with owner set also filling in the
+ *                     body ranges and the owner of every leaf.
+ */
+static void oc_walk(cterm *t, occurrences *o, uint32 *owner, uint32 *n_leaves) {
+    oc_item local[STACK_LOCAL];
+    oc_item *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    uint32 ids_local[STACK_LOCAL];
+    uint32 *ids = ids_local;   /* binder numbers by depth */
+    size_t ids_cap = STACK_LOCAL;
+    uint32 nb = 0, nl = 0;
+
+    st[sp++] = (oc_item){t, 0, 0};
+    while (sp) {
+        const oc_item it = st[--sp];
+        t = it.t;
+        if (!t) {
+            if (owner) o->last[it.id] = nl;
+            continue;
+        }
+        if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+        switch (t->type) {
+            case ABS_term:
+                if (it.depth == ids_cap) ids = stack_grow(ids, ids_local, &ids_cap, sizeof *ids);
+                ids[it.depth] = nb;
+                if (owner) o->first[nb] = nl;
+                st[sp++] = (oc_item){NULL, 0, nb++};
+                st[sp++] = (oc_item){t->abs_body, it.depth + 1, 0};
+                break;
+            case APP_term:
+                st[sp++] = (oc_item){t->app_arg, it.depth, 0};
+                st[sp++] = (oc_item){t->app_fn, it.depth, 0};
+                break;
+            case IDX_term:
+                if (owner) owner[nl] = ids[it.depth - 1 - t->idx];
+                nl++;
+                break;
+            case FREE_term:
+                if (owner) owner[nl] = o->n_binders + free_no[t->free_sym] - 1;
+                nl++;
+                break;
+        }
+    }
+    if (st != local) free(st);
+    if (ids != ids_local) free(ids);
+    o->n_binders = nb;
+    *n_leaves = nl;
+}
+
+/**
+ * @brief              Number the free symbols of a term, skipping the
+ *                     subterms without any.
+ */
+static void oc_init(cterm *t, occurrences *o) {
+    o->root = t;
+    o->first = o->last = o->start = o->leaf = NULL;
+    o->free = NULL;
+    o->n_binders = o->n_free = o->free_cap = 0;
+
+    cterm *local[STACK_LOCAL];
+    cterm **st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    if (t->open) st[sp++] = t;
+    while (sp) {
+        t = st[--sp];
+        if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+        switch (t->type) {
+            case ABS_term:
+                if (t->abs_body->open) st[sp++] = t->abs_body;
+                break;
+            case APP_term:
+                if (t->app_arg->open) st[sp++] = t->app_arg;
+                if (t->app_fn->open) st[sp++] = t->app_fn;
+                break;
+            case FREE_term:
+                oc_number_free(o, t->free_sym);
+                break;
+            case IDX_term:
+                break;
+        }
+    }
+    if (st != local) free(st);
+}
+
+static void oc_build(occurrences *o) {
+    uint32 nl;
+    oc_walk(o->root, o, NULL, &nl);
+    const size_t n_owners = (size_t) o->n_binders + o->n_free;
+    o->first = oc_alloc(o->n_binders, sizeof *o->first);
+    o->last = oc_alloc(o->n_binders, sizeof *o->last);
+    o->start = oc_alloc(n_owners + 1, sizeof *o->start);
+    o->leaf = oc_alloc(nl, sizeof *o->leaf);
+    uint32 *owner = oc_alloc(nl, sizeof *owner);
+    oc_walk(o->root, o, owner, &nl);
+
+    // Counting sort of the leaves by owner keeps each owner's ascending
+    for (uint32 i = 0; i < nl; i++) o->start[owner[i] + 1]++;
+    for (size_t k = 0; k < n_owners; k++) o->start[k + 1] += o->start[k];
+    for (uint32 i = 0; i < nl; i++) o->leaf[o->start[owner[i]]++] = i;
+    for (size_t k = n_owners; k; k--) o->start[k] = o->start[k - 1];
+    o->start[0] = 0;
+    free(owner);
+}
+
+static void oc_free(const occurrences *o) {
+    for (uint32 i = 0; i < o->n_free; i++) free_no[o->free[i]] = 0;
+    free(o->free);
+    free(o->first);
+    free(o->last);
+    free(o->start);
+    free(o->leaf);
+}
+
+/**
+ * @brief              Check whether an owner has a leaf in [lo, hi).
+ */
+static bool oc_within(const occurrences *o, const size_t owner, const uint32 lo, const uint32 hi) {
+    uint32 a = o->start[owner], b = o->start[owner + 1];
+    while (a < b) {
+        const uint32 mid = a + (b - a) / 2;
+        if (o->leaf[mid] < lo) a = mid + 1;
+        else b = mid;
+    }
+
+    return a < o->start[owner + 1] && o->leaf[a] < hi;
+}
+
+/**
+ * @brief              Check whether naming binder id s would capture a
+ *                     variable its body refers to: a free s, or one bound
+ *                     by the innermost binder in scope named s. Any outer
+ *                     binder named s is already shadowed by that one with
+ *                     no use of it below, so it need not be checked.
+ *                     The index is only consulted when the body's loose
+ *                     indices or free variables leave it in doubt.
+ */
+static bool name_used(cterm *t, occurrences *o, const uint32 id, const sym s, const scope *sc) {
+    cterm *b = t->abs_body;
+    uint32 d = scope_find(s);
+    uint32 f = s < free_no_cap ? free_no[s] : 0;
+    if (d && b->loose <= sc->n - (d - 1)) d = 0;
+    if (!b->open) f = 0;
+    if (!d && !f) return false;
+    if (!o->first) oc_build(o);
+
+    const uint32 lo = o->first[id], hi = o->last[id];
+    if (d && oc_within(o, sc->v[d - 1].id, lo, hi)) return true;
+
+    return f && oc_within(o, (size_t) o->n_binders + f - 1, lo, hi);
+}
+
+/**
+ * @brief              Pick the name of a binder: its hint, or a numbered
+ *                     variant if the hint would capture a variable.
+ */
+static sym binder_name(cterm *t, const uint32 id, occurrences *o, const scope *sc) {
+    const sym hint = sym_root(t->abs_hint);
+    sym name = hint;
+    for (int k = 1; name_used(t, o, id, name, sc); k++) {
+        char buf[64];
+        snprintf(buf, sizeof buf, "%s%d", sym_name(hint), k);
+        name = sym_intern(buf);
+    }
+
+    return name;
+}
+
+/**
+ * @brief              A node being converted back and the function part
+ *                     of it done so far.
+ */
+typedef struct te_frame {
+    cterm         *t;
+    expr          *fn;       /* APP: the converted function */
+    enum { TE_BODY, TE_FN, TE_ARG } stage;
+} te_frame;
+
+expr *term_to_expr(cterm *t) {
+    occurrences oc;
+    oc_init(t, &oc);
+    uint32 next_id = 0;
+
+    te_frame local[STACK_LOCAL];
+    te_frame *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    scope sc;
+    scope_init(&sc);
+    expr *r;
+
+    while (true) {
+        // Down the leftmost path to a variable
+        while (t->type == ABS_term || t->type == APP_term) {
+            if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+            if (t->type == ABS_term) {
+                st[sp++] = (te_frame){t, NULL, TE_BODY};
+                const uint32 id = next_id++;
+                scope_push(&sc, binder_name(t, id, &oc, &sc), id);
+                t = t->abs_body;
+            } else {
+                st[sp++] = (te_frame){t, NULL, TE_FN};
+                t = t->app_fn;
+            }
+        }
+        r = make_var_sym(t->type == IDX_term ? scope_at(&sc, t->idx) : t->free_sym);
+        // Back up to the first application whose argument is left
+        for (; sp; sp--) {
+            te_frame *f = &st[sp - 1];
+            if (f->stage == TE_FN) {
+                f->fn = r;
+                f->stage = TE_ARG;
+                t = f->t->app_arg;
+                break;
+            }
+            if (f->stage == TE_ARG) r = make_application(f->fn, r);
+            else r = make_abs_sym(scope_pop(&sc), r);
+        }
+        if (!sp) break;
+    }
+    if (st != local) free(st);
+    if (sc.v != sc.local) free(sc.v);
+    oc_free(&oc);
+
+    return r;
+}
+
+/**
+ * @brief              Two subterms to compare.
+ */
+typedef struct eq_item {
+    cterm         *a;
+    cterm         *b;
+} eq_item;
+
+PURE bool term_equal(cterm *a, cterm *b) {
+    eq_item local[STACK_LOCAL];
+    eq_item *st = local;
+    size_t cap = STACK_LOCAL, sp = 0;
+    bool equal = true;
+
+    st[sp++] = (eq_item){a, b};
+    while (sp && equal) {
+        const eq_item it = st[--sp];
+        a = it.a;
+        b = it.b;
+        if (a == b) continue;
+        if (a->type != b->type || a->loose != b->loose) {
+            equal = false;
+            break;
+        }
+        switch (a->type) {
+            case IDX_term:
+                equal = a->idx == b->idx;
+                break;
+            case FREE_term:
+                equal = a->free_sym == b->free_sym;
+                break;
+            case ABS_term:
+                if (sp == cap) st = stack_grow(st, local, &cap, sizeof *st);
+                st[sp++] = (eq_item){a->abs_body, b->abs_body};
+                break;
+            case APP_term:
+                if (sp + 2 > cap) st = stack_grow(st, local, &cap, sizeof *st);
+                st[sp++] = (eq_item){a->app_arg, b->app_arg};
+                st[sp++] = (eq_item){a->app_fn, b->app_fn};
+                break;
+        }
+    }
+    if (st != local) free(st);
+
+    return equal;
+}
+
+static term *evacuate(term *t, const uint32 from, arena *to) {
+    if (t->gen == GEN_FORWARDED) return t->app_fn;
+    if (t->gen != from) return t;
+
+    term *c = arena_alloc(to, sizeof *c);
+    *c = *t;
+    c->gen = heap_gen;
+    t->gen = GEN_FORWARDED;
+    t->app_fn = c;
+
+    return c;
+}
+
+void term_collect(term **roots, const size_t n) {
+    const uint32 from = heap_gen++;
+    arena to = {NULL, NULL, INIT_ARENA_SIZE, 0, 0};
+
+    for (size_t i = 0; i < n; i++) if (roots[i]) roots[i] = evacuate(roots[i], from, &to);
+
+    for (const arena_chunk *c = to.first; c; c = c->next) {
+        for (size_t off = 0; off < c->used; off += TERM_SIZE) {
+            term *t = (term *)(c->data + off);
+            if (t->type == ABS_term) t->abs_body = evacuate(t->abs_body, from, &to);
+            else if (t->type == APP_term) {
+                t->app_fn = evacuate(t->app_fn, from, &to);
+                t->app_arg = evacuate(t->app_arg, from, &to);
+            }
+        }
+    }
+
+    arena_destroy(&nursery);
+    nursery = to;
+    gc_threshold = 2 * to.bytes;
+    if (gc_threshold < INIT_ARENA_SIZE) gc_threshold = INIT_ARENA_SIZE;
+}
+
+bool term_collect_maybe(term **roots, const size_t n) {
+    if (nursery.bytes < gc_threshold) return false;
+    term_collect(roots, n);
+
+    return true;
+}
+
+void term_heap_destroy(void) {
+    arena_destroy(&nursery);
+    free(innermost);
+    free(free_no);
+    innermost = NULL;
+    free_no = NULL;
+    innermost_cap = free_no_cap = 0;
+    heap_gen++;
+    gc_threshold = INIT_ARENA_SIZE;
+}
@@ -1,18 +1,32 @@
+#define _POSIX_C_SOURCE 200809L /* mkstemp, fdopen */
+
 #include "test.h"
 
+#include "../include/arena.h"
+#include "../include/batch.h"
+#include "../include/binary.h"
+#include "../include/cache.h"
 #include "../include/expr.h"
+#include "../include/fvset.h"
+#include "../include/governor.h"
+#include "../include/graph.h"
+#include "../include/machine.h"
 #include "../include/lambda.h"
 #include "../include/strbuf.h"
 #include "../include/types.h"
 #include "../include/parser.h"
+#include "../include/sink.h"
+#include "../include/stats.h"
+#include "../include/symbol.h"
 
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 // Global variables needed by the main program
-expr *def_vals[N_DEFS];
 strbuf sb;
 
 /**
@@ -27,9 +41,10 @@ static bool expr_equal(cexpr *e1, cexpr *e2) {
     if (e1->type != e2->type) return false;
 
     switch (e1->type) {
-        case VAR_expr: return strcmp(e1->var_name, e2->var_name) == 0;
-        case ABS_expr: return (strcmp(e1->abs_param, e2->abs_param) == 0) && (expr_equal(e1->abs_body, e2->abs_body));
+        case VAR_expr: return strcmp(sym_name(e1->var_sym), sym_name(e2->var_sym)) == 0;
+        case ABS_expr: return (strcmp(sym_name(e1->abs_sym), sym_name(e2->abs_sym)) == 0) && (expr_equal(e1->abs_body, e2->abs_body));
         case APP_expr: return (expr_equal(e1->app_fn, e2->app_fn)) && (expr_equal(e1->app_arg, e2->app_arg));
+        case NUM_expr: return e1->num == e2->num;
     }
 
     return false;
@@ -63,14 +78,14 @@ TEST(expr_creation) {
     expr *var = make_variable("x");
     assert(var != NULL);
     assert(var->type == VAR_expr);
-    assert(strcmp(var->var_name, "x") == 0);
+    assert(strcmp(sym_name(var->var_sym), "x") == 0);
 
     // Test abstraction
     expr *body = make_variable("y");
     expr *abs = make_abstraction("x", body);
     assert(abs != NULL);
     assert(abs->type == ABS_expr);
-    assert(strcmp(abs->abs_param, "x") == 0);
+    assert(strcmp(sym_name(abs->abs_sym), "x") == 0);
     assert(expr_equal(abs->abs_body, body));
 
     // Test application
@@ -103,14 +118,14 @@ TEST(parsing) {
     Parser p1 = {input1, 0, strlen(input1)};
     expr *e1 = parse(&p1);
     assert(e1->type == VAR_expr);
-    assert(strcmp(e1->var_name, "x") == 0);
+    assert(strcmp(sym_name(e1->var_sym), "x") == 0);
 
     // Test abstraction (lambda x.x)
     cchar *input2 = "λx.x";
     Parser p2 = {input2, 0, strlen(input2)};
     expr *e2 = parse(&p2);
     assert(e2->type == ABS_expr);
-    assert(strcmp(e2->abs_param, "x") == 0);
+    assert(strcmp(sym_name(e2->abs_sym), "x") == 0);
 
     // Test application (f x)
     cchar *input3 = "f x";
@@ -124,7 +139,7 @@ TEST(parsing) {
 }
 
 TEST(church_numerals) {
-    for (int i = 0; i < 5; i++) {
+    for (uint64 i = 0; i < 5; i++) {
         expr *c = church(i);
         assert(is_church_numeral(c));
         assert(count_applications(c) == i);
@@ -173,9 +188,9 @@ TEST(substitution) {
     expr *result = substitute(id, "y", z);
 
     assert(result->type == ABS_expr);
-    assert(strcmp(result->abs_param, "x") == 0);
+    assert(strcmp(sym_name(result->abs_sym), "x") == 0);
     assert(result->abs_body->type == VAR_expr);
-    assert(strcmp(result->abs_body->var_name, "x") == 0);
+    assert(strcmp(sym_name(result->abs_body->var_sym), "x") == 0);
 
     free_expr(id);
     free_expr(z);
@@ -193,7 +208,7 @@ TEST(beta_reduction) {
 
     assert(reduced);
     assert(result->type == VAR_expr);
-    assert(strcmp(result->var_name, "y") == 0);
+    assert(strcmp(sym_name(result->var_sym), "y") == 0);
 
     free_expr(app);
     free_expr(result);
@@ -212,6 +227,23 @@ TEST(delta_reduction) {
     free_expr(true_var);
     free_expr(result);
 
+    // A binder named like a definition shadows it: its variables are
+    // bound, so they are not unfolded
+    cchar *src[] = {"λtrue.true", "(λx.λinc.inc x) 2"};
+    cchar *want[] = {"λtrue.true", "λinc.inc (λf.(λx.f (f x)))"};
+    for (int i = 0; i < 2; i++) {
+        Parser p = {src[i], 0, strlen(src[i])};
+        expr *e = parse(&p), *next;
+        cchar *rtype;
+        while (reduce_once(e, &next, &rtype)) {
+            assert(strcmp(rtype, "δ") != 0);
+            e = next;
+        }
+        char buf[64];
+        expr_to_buffer(e, buf, sizeof buf);
+        assert(!strcmp(buf, want[i]));
+    }
+
     cleanup_delta_defs();
 }
 
@@ -291,6 +323,19 @@ TEST(complex_parsing) {
     assert(e2 != NULL);
     assert(e2->type == APP_expr);
 
+    // Malformed input is reported, not fatal
+    cchar *bad[] = {"", "(λx.x", "λ.x", "λx x", "f )", "99999999999999999999", "(λx.λy.(x y)"};
+    FILE *original_stderr = stderr;
+    FILE *errors = tmpfile();
+    stderr = errors;
+    for (size_t i = 0; i < sizeof bad / sizeof *bad; i++) {
+        Parser q = {bad[i], 0, strlen(bad[i])};
+        assert(parse(&q) == NULL);
+    }
+    stderr = original_stderr;
+    assert(ftell(errors) > 0);
+    fclose(errors);
+
     free_expr(e1);
     free_expr(e2);
 }
@@ -305,9 +350,9 @@ TEST(alpha_renaming) {
 
     // The parameter should be renamed to avoid being captured
     assert(result->type == ABS_expr);
-    assert(strcmp(result->abs_param, "y") != 0); // Should be renamed
+    assert(strcmp(sym_name(result->abs_sym), "y") != 0); // Should be renamed
     assert(result->abs_body->type == VAR_expr);
-    assert(strcmp(result->abs_body->var_name, "y") == 0);
+    assert(strcmp(sym_name(result->abs_body->var_sym), "y") == 0);
 
     free_expr(abs);
     free_expr(y_var);
@@ -349,19 +394,16 @@ TEST(church_arithmetic) {
 }
 
 TEST(fresh_variable) {
-    VarSet s;
-    vs_init(&s);
-
-    vs_add(&s, "x");
-    vs_add(&s, "y");
-    vs_add(&s, "z");
-
-    char *fresh = fresh_var(&s);
-    assert(fresh != NULL);
-    assert(!vs_has(&s, fresh));
-
-    free(fresh);
-    vs_free(&s);
+    // Capture renames the binder to the first generated symbol not in use
+    const sym x = sym_intern("x");
+    expr *abs = make_abstraction("x", make_application(make_variable("y"), make_variable("x")));
+    expr *r = substitute(abs, "y", make_variable("x"));
+    assert(r->abs_sym == sym_fresh(x, 1) && r->abs_body->app_arg->var_sym == r->abs_sym);
+
+    expr *taken = make_application(make_variable("x"), make_var_sym(sym_fresh(x, 1)));
+    r = substitute(abs, "y", taken);
+    assert(r->abs_sym == sym_fresh(x, 2) && strcmp(sym_name(r->abs_sym), "x2") == 0);
+    assert(r->abs_body->app_fn == taken && r->abs_body->app_arg->var_sym == r->abs_sym);
 }
 
 TEST(abstract_numerals) {
@@ -370,7 +412,7 @@ TEST(abstract_numerals) {
 
     assert(abstracted != NULL);
     assert(abstracted->type == VAR_expr);
-    assert(strcmp(abstracted->var_name, "3") == 0);
+    assert(strcmp(sym_name(abstracted->var_sym), "3") == 0);
 
     free_expr(num3);
     free_expr(abstracted);
@@ -381,7 +423,7 @@ TEST(abstract_numerals) {
 
     assert(abs_var != NULL);
     assert(abs_var->type == VAR_expr);
-    assert(strcmp(abs_var->var_name, "x") == 0);
+    assert(strcmp(sym_name(abs_var->var_sym), "x") == 0);
 
     free_expr(var);
     free_expr(abs_var);
@@ -427,6 +469,1146 @@ TEST(church_booleans) {
     cleanup_delta_defs();
 }
 
+TEST(arena_collect) {
+    expr *keep = make_application(make_variable("f"), num_expand(church(3)));
+    for (int i = 0; i < 100; i++) num_expand(church(50)); // garbage
+
+    const expr_heap_stats before = expr_heap_get_stats();
+    assert(before.nodes_allocated >= 100 * 103 + 11);
+
+    expr_collect(&keep, 1);
+    const expr_heap_stats after = expr_heap_get_stats();
+    assert(after.collections == before.collections + 1);
+    assert(after.nodes_live == 11);
+
+    assert(keep->type == APP_expr);
+    assert(strcmp(sym_name(keep->app_fn->var_sym), "f") == 0);
+    assert(is_church_numeral(keep->app_arg));
+    assert(count_applications(keep->app_arg) == 3);
+}
+
+TEST(symbols) {
+    const sym x = sym_intern("x");
+    assert(sym_intern("x") == x);
+    assert(sym_intern_n("xyz", 1) == x);
+    assert(sym_intern("y") != x);
+    assert(strcmp(sym_name(x), "x") == 0);
+    assert(sym_len(sym_intern("long_name")) == 9);
+    assert(sym_lookup("never_interned_name") == SYM_NONE);
+
+    cchar *input = "λx.x y";
+    Parser p = {input, 0, strlen(input)};
+    expr *e = parse(&p);
+    assert(e->abs_sym != x && sym_root(e->abs_sym) == x); // renamed binder
+    assert(e->abs_body->app_fn->var_sym == e->abs_sym);
+    assert(e->abs_body->app_arg->var_sym == sym_intern("y"));
+
+    // The table is shared, so growing it is no thread's memory
+    const size_t reserved = arena_reserved_total();
+    for (int i = 0; i < 20000; i++) {
+        char name[16];
+        snprintf(name, sizeof name, "grown%d", i);
+        sym_intern(name);
+    }
+    assert(arena_reserved_total() == reserved);
+}
+
+TEST(barendregt_renaming) {
+    // Generated symbols never collide with interned ones
+    const sym x = sym_intern("x");
+    const sym a = sym_alias(x);
+    const sym f = sym_fresh(a, 1);
+    assert(a != x && f != x && f != a && sym_fresh(x, 1) == f && sym_fresh(x, 2) != f);
+    assert(sym_root(a) == x && sym_root(f) == x);
+    assert(strcmp(sym_name(a), "x") == 0);
+    assert(sym_intern(sym_name(f)) != f);
+
+    // Each binder gets its own symbol, and occurrences follow scoping
+    cchar *input = "λx.(λx.x) x";
+    Parser p = {input, 0, strlen(input)};
+    expr *e = parse(&p);
+    cexpr *inner = e->abs_body->app_fn;
+    assert(e->abs_sym != inner->abs_sym);
+    assert(inner->abs_body->var_sym == inner->abs_sym);
+    assert(e->abs_body->app_arg->var_sym == e->abs_sym);
+
+    // Binders of one name and depth share a symbol, so parsing the same
+    // term again adds none, and substitution still renames on capture
+    const uint32 before = sym_count();
+    Parser again = {input, 0, strlen(input)};
+    assert(parse(&again)->abs_sym == e->abs_sym && sym_count() == before);
+    cchar *siblings = "(λf.λy.f y) (λz.λy.z)";
+    Parser sp = {siblings, 0, strlen(siblings)};
+    expr *s = parse(&sp), *next;
+    assert(s->app_fn->abs_body->abs_sym == s->app_arg->abs_body->abs_sym);
+    cchar *rtype;
+    expr *start = s;
+    while (reduce_once(s, &next, &rtype)) s = next;
+    char buf[64];
+    expr_to_buffer(s, buf, sizeof buf);
+    assert(strcmp(buf, "λy.(λy1.y)") == 0);
+    const uint32 renamed = sym_count();
+    for (s = start; reduce_once(s, &next, &rtype);) s = next;
+    assert(sym_count() == renamed);
+
+    // Printing maps binders back to their names, renaming only on clash
+    expr_to_buffer(e, buf, sizeof buf);
+    assert(strcmp(buf, "λx.(λx.x) x") == 0);
+    expr *clash = make_abs_sym(a, make_application(make_var_sym(x), make_var_sym(a)));
+    expr_to_buffer(clash, buf, sizeof buf);
+    assert(strcmp(buf, "λx1.x x1") == 0);
+}
+
+TEST(debruijn_terms) {
+    // λx.λy.x y z: x is index 1, y index 0, z stays free
+    cchar *input = "λx.λy.x y z";
+    Parser p = {input, 0, strlen(input)};
+    expr *e = parse(&p);
+    term *t = term_from_expr(e);
+    term *app = t->abs_body->abs_body;
+    assert(app->app_fn->app_fn->type == IDX_term && app->app_fn->app_fn->idx == 1);
+    assert(app->app_fn->app_arg->type == IDX_term && app->app_fn->app_arg->idx == 0);
+    assert(app->app_arg->type == FREE_term);
+    assert(t->loose == 0);
+    assert(expr_equal(term_to_expr(t), e));
+
+    // α-equivalent inputs give equal terms
+    cchar *other = "λa.λb.a b z";
+    Parser q = {other, 0, strlen(other)};
+    assert(term_equal(t, term_from_expr(parse(&q))));
+
+    // (λx.λy.x) y must not capture y
+    cchar *redex = "(λx.λy.x) y";
+    Parser r = {redex, 0, strlen(redex)};
+    term *next;
+    cchar *rtype;
+    assert(term_reduce_once(term_from_expr(parse(&r)), &next, &rtype));
+    assert(next->type == ABS_term);
+    assert(next->abs_body->type == FREE_term);
+    expr *shown = term_to_expr(next);
+    assert(strcmp(sym_name(shown->abs_sym), "y") != 0);
+    assert(strcmp(sym_name(shown->abs_body->var_sym), "y") == 0);
+
+    term_heap_destroy();
+}
+
+TEST(hashcons) {
+    expr_hashcons(true);
+    expr *a = num_expand(church(4));
+    expr *b = num_expand(church(4));
+    assert(a == b);
+    assert(copy_expr(a) == a);
+    assert(make_application(a, b) == make_application(b, a));
+    assert(num_expand(church(5))->abs_body->abs_body->app_arg == a->abs_body->abs_body);
+
+    expr *keep = make_application(make_variable("g"), a);
+    const size_t before = expr_heap_get_stats().nodes_unique;
+    for (int i = 0; i < 50; i++) num_expand(church(100 + i)); // garbage
+    assert(expr_heap_get_stats().nodes_unique > before);
+
+    expr_collect(&keep, 1);
+    const expr_heap_stats st = expr_heap_get_stats();
+    assert(st.nodes_unique == st.nodes_live);
+    assert(make_application(make_variable("g"), num_expand(church(4))) == keep);
+
+    expr_hashcons(false);
+    assert(church(4) != church(4));
+}
+
+/**
+ * @brief              δ-definition lookup for the term-based engines.
+ * @param  s           the symbol
+ * @return             the definition as a term, or NULL
+ */
+static term *test_resolve(const sym s) {
+    for (int i = 0; i < N_DEFS; i++)
+        if (sym_intern(def_names[i]) == s) return term_from_expr(def_vals[i]);
+
+    return NULL;
+}
+
+TEST(graph_reduction) {
+    setup_delta_defs();
+
+    cchar *input = "* 7 (- 9 3)";
+    Parser p = {input, 0, strlen(input)};
+    graph_stats st;
+    term *r = graph_normalize(term_from_expr(parse(&p)), test_resolve, &st);
+    assert(term_equal(r, term_from_expr(church(42))));
+    assert(st.beta > 0 && st.delta > 0);
+
+    // The argument is used twice but its redex is contracted once
+    cchar *shared = "(λx.x x) ((λy.y) (λz.z))";
+    Parser q = {shared, 0, strlen(shared)};
+    r = graph_normalize(term_from_expr(parse(&q)), NULL, &st);
+    assert(r->type == ABS_term && r->abs_body->type == IDX_term);
+    assert(st.beta == 3);
+
+    term_heap_destroy();
+    cleanup_delta_defs();
+}
+
+TEST(machine_reduction) {
+    setup_delta_defs();
+
+    cchar *input = "* 7 (- 9 3)";
+    Parser p = {input, 0, strlen(input)};
+    machine_stats st;
+    term *r = machine_normalize(term_from_expr(parse(&p)), test_resolve, &st);
+    assert(term_equal(r, term_from_expr(church(42))));
+
+    // Same number of steps as normal-order rewriting
+    cchar *small = "+ 2 3";
+    Parser q = {small, 0, strlen(small)};
+    expr *e = parse(&q);
+    int steps = 0;
+    expr *next;
+    cchar *rtype;
+    for (expr *cur = e; reduce_once(cur, &next, &rtype); cur = next) steps++;
+    r = machine_normalize(term_from_expr(e), test_resolve, &st);
+    assert(term_equal(r, term_from_expr(church(5))));
+    assert((int)(st.beta + st.delta) == steps);
+
+    term_heap_destroy();
+    cleanup_delta_defs();
+}
+
+TEST(nbe_normal_form) {
+    setup_delta_defs();
+
+    cchar *input = "* 7 (- 9 3)";
+    Parser p = {input, 0, strlen(input)};
+    nbe_stats st;
+    expr *r = normal_form(parse(&p), &st);
+    assert(is_church_numeral(r) && count_applications(r) == 42);
+    assert(st.beta > 0 && st.delta > 0);
+
+    // The diverging argument is never needed, so never evaluated
+    cchar *lazy = "(λx.z) ((λx.x x) (λx.x x))";
+    Parser q = {lazy, 0, strlen(lazy)};
+    r = normal_form(parse(&q), NULL);
+    assert(r->type == VAR_expr && !strcmp(sym_name(r->var_sym), "z"));
+
+    cleanup_delta_defs();
+}
+
+TEST(path_copying) {
+    cchar *input = "f ((λx.x) y) (g h)";
+    Parser p = {input, 0, strlen(input)};
+    expr *e = parse(&p);
+    expr *next;
+    cchar *rtype;
+    assert(reduce_once(e, &next, &rtype));
+
+    // Only the path to the redex is rebuilt; siblings are shared
+    assert(next != e && next->app_arg == e->app_arg);
+    assert(next->app_fn->app_fn == e->app_fn->app_fn);
+    assert(next->app_fn->app_arg == e->app_fn->app_arg->app_arg);
+
+    // Substituting into a term without the variable returns it unchanged
+    assert(substitute(e->app_arg, "x", next) == e->app_arg);
+}
+
+TEST(free_var_sets) {
+    cchar *a = "λx.x y (z x)";
+    cchar *b = "(λw.z) y";
+    Parser p = {a, 0, strlen(a)};
+    Parser q = {b, 0, strlen(b)};
+    expr *e = parse(&p);
+    expr *f = parse(&q);
+
+    // Computed when the node is built, and interned
+    assert(e->fv->n == 2 && fv_has(e->fv, sym_intern("y")) && fv_has(e->fv, sym_intern("z")));
+    assert(!fv_has(e->fv, sym_intern("x")));
+    assert(e->fv == f->fv);
+    assert(fv_union(e->fv, fv_empty()) == e->fv);
+    assert(church(3)->fv == fv_empty());
+
+    // Past FV_MAX members a set only keeps a filter; fv_occurs stays exact
+    char wide[256];
+    size_t len = 0;
+    for (int i = 0; i < 40; i++) len += (size_t) snprintf(wide + len, sizeof wide - len, "%sv%d", i ? " " : "", i);
+    Parser w = {wide, 0, len};
+    expr *g = parse(&w);
+    assert(!fv_exact(g->fv) && fv_occurs(g, sym_intern("v5")) && !fv_occurs(g, sym_intern("y")));
+    VarSet vs = free_vars(g);
+    assert(vs.c == 40);
+    vs_free(&vs);
+
+    // The printer still renames a binder only when its body needs it
+    const sym v0 = sym_alias(sym_intern("v0"));
+    expr *h = make_abs_sym(v0, make_application(make_variable("y"), make_var_sym(v0)));
+    expr *keep = substitute(h, "y", g);
+    char buf[512];
+    expr_to_buffer(keep, buf, sizeof buf);
+    assert(strncmp(buf, "λv01.v0 v1 v2 ", strlen("λv01.v0 v1 v2 ")) == 0);
+    assert(strcmp(buf + strlen(buf) - strlen(" v39 v01"), " v39 v01") == 0);
+
+    // Sets move with the nodes when they are collected
+    expr_collect(&keep, 1);
+    assert(!fv_exact(keep->fv) && fv_occurs(keep, sym_intern("v39")) && !fv_occurs(keep, v0));
+    char again[512];
+    expr_to_buffer(keep, again, sizeof again);
+    assert(strcmp(buf, again) == 0);
+}
+
+/**
+ * @brief              Reduce an expression to normal form without printing.
+ * @return             the normal form
+ */
+static expr *reduce_fully(expr *e, int *steps) {
+    expr *next;
+    cchar *rtype;
+    for (*steps = 0; reduce_once(e, &next, &rtype); e = next) (*steps)++;
+
+    return e;
+}
+
+TEST(native_arithmetic) {
+    setup_delta_defs();
+
+    cchar *inputs[] = {"+ 4 5", "* 3 4", "- 3 5", "- 7 2", "inc 0", "dec 3", "iszero 0", "<= 4 2", "+ 1 2 f x"};
+    for (size_t i = 0; i < sizeof inputs / sizeof *inputs; i++) {
+        Parser p = {inputs[i], 0, strlen(inputs[i])};
+        expr *e = parse(&p);
+        int slow, fast;
+        term *want = term_from_expr(reduce_fully(e, &slow));
+        native_arith(true);
+        term *got = term_from_expr(reduce_fully(e, &fast));
+        native_arith(false);
+        assert(term_equal(want, got));
+        assert(fast < slow);
+    }
+
+    // Only numerals are computed natively
+    cchar *open = "+ 2 y";
+    Parser q = {open, 0, strlen(open)};
+    expr *out;
+    assert(!native_reduce(parse(&q), &out));
+
+    term_heap_destroy();
+    cleanup_delta_defs();
+}
+
+TEST(numeral_nodes) {
+    // Stored as one node, whatever the size
+    const expr_heap_stats before = expr_heap_get_stats();
+    expr *big = church(UINT64_C(10000000000));
+    assert(expr_heap_get_stats().nodes_allocated == before.nodes_allocated + 1);
+    assert(is_church_numeral(big) && count_applications(big) == UINT64_C(10000000000));
+
+    cchar *input = "18446744073709551615";
+    Parser p = {input, 0, strlen(input)};
+    assert(count_applications(parse(&p)) == UINT64_MAX);
+
+    // Printed and converted exactly like the expanded abstraction
+    char a[64], b[64];
+    expr_to_buffer(church(3), a, sizeof a);
+    expr_to_buffer(num_expand(church(3)), b, sizeof b);
+    assert(strcmp(a, b) == 0);
+    assert(term_equal(term_from_expr(church(3)), term_from_expr(num_expand(church(3)))));
+
+    // Expanded only when applied
+    cchar *app = "2 g y";
+    Parser q = {app, 0, strlen(app)};
+    int steps;
+    expr *r = reduce_fully(parse(&q), &steps);
+    expr_to_buffer(r, a, sizeof a);
+    assert(steps == 2 && strcmp(a, "g (g y)") == 0);
+
+    term_heap_destroy();
+}
+
+/**
+ * @brief              Count the bytes and flushes a callback sink sees.
+ */
+static void count_flush(void *ctx, const char *data, size_t len) {
+    size_t *seen = ctx;
+    seen[0] += len;
+    seen[1]++;
+    (void)data;
+}
+
+TEST(sink_output) {
+    // A memory sink keeps everything, growing past its first allocation
+    sink m;
+    sink_init_mem(&m);
+    for (int i = 0; i < 10000; i++) sink_printf(&m, "%d,", i % 10);
+    assert(m.bytes == 20000 && m.buf.len == 20000);
+    assert(strncmp(m.buf.data, "0,1,2,", 6) == 0);
+    sink_destroy(&m);
+
+    // A callback sink flushes in chunks and on destroy
+    size_t seen[2] = {0, 0};
+    sink f;
+    sink_init_fn(&f, count_flush, seen);
+    for (int i = 0; i < 3 * SINK_FLUSH_AT; i++) sink_putc(&f, 'x');
+    assert(seen[1] >= 2 && seen[0] < 3 * SINK_FLUSH_AT);
+    sink_destroy(&f);
+    assert(seen[0] == 3 * SINK_FLUSH_AT);
+
+    // Deep terms are written whole, without recursion or truncation
+    expr *e = make_variable("x");
+    for (int i = 0; i < 200000; i++) e = make_application(make_variable("f"), e);
+    sink_init_mem(&m);
+    expr_write(&m, e);
+    assert(m.bytes == 4 * 200000 - 1 && m.buf.data[m.bytes - 1] == ')');
+    sink_destroy(&m);
+}
+
+/**
+ * @brief              Normalize input with a trace mode, counting the step
+ *                     lines and all lines printed.
+ */
+static void trace_lines(cchar *input, const trace_mode mode, const size_t n, int *steps, int *lines) {
+    Parser p = {input, 0, strlen(input)};
+    expr *e = parse(&p);
+
+    FILE *original_stdout = stdout;
+    FILE *temp = tmpfile();
+    stdout = temp;
+    trace_config(mode, n);
+    normalize(e);
+    trace_config(TRACE_FULL, 1);
+    fflush(stdout);
+    stdout = original_stdout;
+
+    rewind(temp);
+    char line[1024];
+    *steps = *lines = 0;
+    while (fgets(line, sizeof line, temp)) {
+        (*lines)++;
+        if (!strncmp(line, "Step ", 5)) (*steps)++;
+    }
+    fclose(temp);
+}
+
+TEST(trace_modes) {
+    setup_delta_defs();
+
+    cchar *input = "+ 2 3"; // 13 steps
+    int steps, lines;
+    trace_lines(input, TRACE_FULL, 1, &steps, &lines);
+    assert(steps == 14);
+    trace_lines(input, TRACE_EVERY, 5, &steps, &lines);
+    assert(steps == 4); // 0, 5, 10 and the last
+    trace_lines(input, TRACE_LAST, 3, &steps, &lines);
+    assert(steps == 3);
+    trace_lines(input, TRACE_FINAL, 1, &steps, &lines);
+    assert(steps == 0 && lines == 3);
+    trace_lines(input, TRACE_QUIET, 1, &steps, &lines);
+    assert(lines == 0);
+
+    cleanup_delta_defs();
+}
+
+TEST(resource_limits) {
+    setup_delta_defs();
+    const limits none = {0, 0, 0};
+    const limits ten = {10, 0, 0};
+
+    // Divergent terms stop at the limit with the term they got to
+    cchar *omega = "(λx.x x) (λx.x x)";
+    Parser p = {omega, 0, strlen(omega)};
+    term *t = term_from_expr(parse(&p));
+    machine_stats ms;
+    governor_start(&ten);
+    assert(term_equal(machine_normalize(t, NULL, &ms), t));
+    assert(governor_reason() == STOP_STEPS && ms.beta == 10);
+    governor_start(&ten);
+    graph_stats gs;
+    assert(term_equal(graph_normalize(t, NULL, &gs), t) && gs.beta == 10);
+    governor_start(&ten);
+    nbe_stats ns;
+    assert(term_equal(nbe_normalize(t, NULL, &ns), t) && ns.beta == 10);
+
+    // A term that explodes is read back in bounded space after the limit
+    cchar *boom = "5 5 5 (λz.z) w";
+    Parser q = {boom, 0, strlen(boom)};
+    t = term_from_expr(parse(&q));
+    const limits twenty = {20, 0, 0};
+    const size_t before = arena_reserved_total();
+    term *r[3];
+    governor_start(&twenty);
+    r[0] = machine_normalize(t, NULL, &ms);
+    assert(governor_reason() == STOP_STEPS);
+    governor_start(&twenty);
+    r[1] = graph_normalize(t, NULL, &gs);
+    assert(governor_reason() == STOP_STEPS);
+    governor_start(&twenty);
+    r[2] = nbe_normalize(t, NULL, &ns);
+    assert(governor_reason() == STOP_STEPS);
+    assert(arena_reserved_total() - before < (size_t) 64 << 20);
+    for (size_t i = 0; i < 3; i++) {
+        term *cut = term_elide(r[i], READBACK_NODES);
+        assert(cut->size <= 2 * READBACK_NODES);
+        assert(term_to_expr(cut));
+    }
+
+    // A stopped rewrite reduction reports the limit; an unlimited one does not
+    int steps, lines;
+    governor_start(&ten);
+    trace_lines("+ 2 3", TRACE_LAST, 1, &steps, &lines);
+    assert(governor_reason() == STOP_STEPS && steps == 1);
+    governor_start(&none);
+    trace_lines("+ 2 3", TRACE_QUIET, 1, &steps, &lines);
+    assert(governor_reason() == STOP_NONE);
+
+    term_heap_destroy();
+    cleanup_delta_defs();
+}
+
+TEST(deep_terms) {
+    setup_delta_defs();
+
+    // g (g (... ((λy.y) x))) a million levels deep
+    const size_t depth = 1000000;
+    cchar *inner = "(λy.y) x";
+    const size_t len = 3 * depth + strlen(inner) + depth;
+    char *src = malloc(len + 1);
+    assert(src);
+    for (size_t i = 0; i < depth; i++) memcpy(src + 3 * i, "g (", 3);
+    strcpy(src + 3 * depth, inner);
+    memset(src + 3 * depth + strlen(inner), ')', depth);
+    src[len] = '\0';
+    Parser p = {src, 0, len};
+    expr *e = parse(&p);
+
+    // The redex at the bottom is found and the path above it rebuilt
+    expr *next;
+    cchar *rtype;
+    assert(reduce_once(e, &next, &rtype) && strcmp(rtype, "β") == 0);
+    expr *nf = next;
+    assert(!reduce_once(nf, &next, &rtype));
+
+    // Substitution, copying, numeral abstraction and printing all reach
+    // the bottom
+    expr *sub = substitute(nf, "x", church(2));
+    expr *abs = abstract_numerals(copy_expr(sub));
+    cexpr *cur = abs;
+    for (size_t i = 0; i < depth; i++) cur = cur->app_arg;
+    assert(cur->type == VAR_expr && strcmp(sym_name(cur->var_sym), "2") == 0);
+    VarSet fv = free_vars(sub);
+    assert(fv.c == 1 && vs_has(&fv, "g"));
+    vs_free(&fv);
+
+    sink out;
+    sink_init_mem(&out);
+    expr_write(&out, nf);
+    assert(out.bytes == 4 * depth - 1);
+    sink_destroy(&out);
+
+    // The term conversions and the core engines reach the bottom as well
+    term *want = term_from_expr(nf);
+    assert(term_equal(term_from_expr(term_to_expr(want)), want));
+    term *t = term_from_expr(e);
+    term *r;
+    assert(term_reduce_once(t, &r, &rtype) && term_equal(r, want));
+    graph_stats gs;
+    assert(term_equal(graph_normalize(t, NULL, &gs), want) && gs.beta == 1);
+    machine_stats ms;
+    assert(term_equal(machine_normalize(t, NULL, &ms), want) && ms.beta == 1);
+    nbe_stats ns;
+    assert(term_equal(nbe_normalize(t, NULL, &ns), want) && ns.beta == 1);
+
+    // (λy.y) (λx.λx. ... λx.x) with 300000 binders of one name: every
+    // engine gets through, and converting back renames none of them
+    const size_t binders = 300000;
+    const size_t head = strlen("(λy.y) ("), step = strlen("λx.");
+    const size_t dlen = head + step * binders + 2;
+    char *dsrc = malloc(dlen + 1);
+    assert(dsrc);
+    memcpy(dsrc, "(λy.y) (", head);
+    for (size_t i = 0; i < binders; i++) memcpy(dsrc + head + step * i, "λx.", step);
+    strcpy(dsrc + dlen - 2, "x)");
+    Parser q = {dsrc, 0, dlen};
+    expr *d = parse(&q);
+    term *dt = term_from_expr(d);
+    term *dwant = term_from_expr(d->app_arg);
+    assert(term_reduce_once(dt, &r, &rtype) && term_equal(r, dwant));
+    assert(term_equal(graph_normalize(dt, NULL, &gs), dwant) && gs.beta == 1);
+    assert(term_equal(machine_normalize(dt, NULL, &ms), dwant) && ms.beta == 1);
+    assert(term_equal(nbe_normalize(dt, NULL, &ns), dwant) && ns.beta == 1);
+
+    sink back, orig;
+    sink_init_mem(&back);
+    sink_init_mem(&orig);
+    expr_write(&back, term_to_expr(dwant));
+    expr_write(&orig, d->app_arg);
+    assert(back.bytes == orig.bytes && memcmp(back.buf.data, orig.buf.data, back.bytes) == 0);
+    sink_destroy(&back);
+    sink_destroy(&orig);
+
+    // λx.λy.λy. ... λy.x x ... x with 200000 binders and occurrences:
+    // each occurrence resolves to the outermost binder without a search
+    const size_t refs = 200000;
+    const size_t x_head = strlen("λx."), y_step = strlen("λy.");
+    const size_t rlen = x_head + y_step * refs + 2 * refs - 1;
+    char *rsrc = malloc(rlen + 1);
+    assert(rsrc);
+    memcpy(rsrc, "λx.", x_head);
+    for (size_t i = 0; i < refs; i++) memcpy(rsrc + x_head + y_step * i, "λy.", y_step);
+    for (size_t i = 0; i < refs; i++) memcpy(rsrc + x_head + y_step * refs + 2 * i, "x ", 2);
+    rsrc[rlen] = '\0';
+    Parser rp = {rsrc, 0, rlen};
+    expr *re = parse(&rp);
+    cexpr *body = re->abs_body;
+    for (size_t i = 0; i < refs; i++) body = body->abs_body;
+    for (size_t i = 1; i < refs; i++, body = body->app_fn) assert(body->app_arg->var_sym == re->abs_sym);
+    assert(body->type == VAR_expr && body->var_sym == re->abs_sym);
+
+    term_heap_destroy();
+    free(rsrc);
+    free(dsrc);
+    free(src);
+    cleanup_delta_defs();
+}
+
+/**
+ * @brief              Run a batch file with stdout captured and what the
+ *                     parser reports on stderr dropped.
+ * @param  path        the batch file
+ * @param  lim         the limits
+ * @param  status      set to what batch_run returned
+ * @return             the output, to be freed by the caller
+ */
+static char *batch_output(cchar *path, const limits *lim, int *status) {
+    FILE *original_stdout = stdout, *original_stderr = stderr;
+    FILE *temp = tmpfile(), *errors = tmpfile();
+    stdout = temp;
+    stderr = errors;
+    *status = batch_run(path, ENGINE_REWRITE, lim, 3);
+    stdout = original_stdout;
+    stderr = original_stderr;
+    fclose(errors);
+
+    const long len = ftell(temp);
+    char *text = malloc((size_t) len + 1);
+    assert(text);
+    rewind(temp);
+    assert(fread(text, 1, (size_t) len, temp) == (size_t) len);
+    text[len] = '\0';
+    fclose(temp);
+
+    return text;
+}
+
+/**
+ * @brief              Normalize input with only the final trace, the
+ *                     parallel rounds on a pool of threads if threads is
+ *                     not 0, into a string to free.
+ */
+static char *final_trace(cchar *input, const bool parallel, const size_t threads) {
+    Parser p = {input, 0, strlen(input)};
+    sink out;
+    sink_init_mem(&out);
+    trace_output(&out);
+    trace_config(TRACE_FINAL, 1);
+    if (parallel) normalize_parallel(parse(&p), threads);
+    else normalize(parse(&p));
+    trace_config(TRACE_FULL, 1);
+    trace_output(NULL);
+
+    char *s = strdup(out.buf.data);
+    sink_destroy(&out);
+
+    return s;
+}
+
+TEST(parallel_rounds) {
+    setup_delta_defs();
+    expr_heap_seal(); // the workers share the definitions
+
+    // One round contracts every outermost redex, and nothing inside them
+    cchar *src = "(λx.x) a ((λy.y) ((λz.z) b))";
+    Parser p = {src, 0, strlen(src)};
+    expr *e = parse(&p), *r;
+    size_t n;
+    assert(reduce_parallel(e, &r, &n));
+    assert(n == 2);
+    char buf[64];
+    expr_to_buffer(r, buf, sizeof buf);
+    assert(!strcmp(buf, "a ((λz.z) b)"));
+    assert(reduce_parallel(r, &r, &n) && n == 1);
+    assert(!reduce_parallel(r, &r, &n) && n == 0);
+
+    // Large enough to be split across the pool, with the normal form and
+    // the number of contractions of the sequential reduction
+    cchar *big = "λg.g (* 25 25) (* 25 25) (* 25 25) (* 25 25)";
+    char *seq = final_trace(big, false, 0);
+    for (size_t threads = 0; threads <= 3; threads += 3) {
+        char *par = final_trace(big, true, threads);
+        int steps, rounds, contractions;
+        assert(sscanf(seq, "Steps: %d", &steps) == 1);
+        assert(sscanf(par, "Rounds: %d\nContractions: %d", &rounds, &contractions) == 2);
+        assert(rounds < steps && contractions >= rounds);
+        assert(!strcmp(strstr(par, "δ-abstracted"), strstr(seq, "δ-abstracted")));
+        free(par);
+    }
+    free(seq);
+}
+
+TEST(nf_cache) {
+    setup_delta_defs();
+
+    // α-equivalent terms share a key
+    cchar *src[] = {"λx.λy.x y", "λp.λq.p q", "λx.λy.y x"};
+    nf_key key[3];
+    for (int i = 0; i < 3; i++) {
+        Parser p = {src[i], 0, strlen(src[i])};
+        key[i] = nf_cache_key(parse(&p));
+        assert(!key[i].data);
+        nf_key_encode(&key[i]);
+    }
+    assert(key[0].hash == key[1].hash && key[0].len == key[1].len);
+    assert(!memcmp(key[0].data, key[1].data, key[0].len));
+    assert(key[0].hash != key[2].hash);
+
+    // Terms that differ only in where their bound variables occur hash
+    // apart
+    cchar *apart[][2] = {
+        {"λx.λy.λz.x (y z)", "λx.λy.λz.y (x z)"},
+        {"λx.λy.λz.x (y z)", "λx.λy.λz.x (z y)"},
+        {"λx.λy.λz.y (x z)", "λx.λy.λz.x (z y)"},
+        {"λf.λx.f (f (f x))", "λf.λx.f (x (f x))"},
+    };
+    for (size_t i = 0; i < sizeof apart / sizeof *apart; i++) {
+        Parser a = {apart[i][0], 0, strlen(apart[i][0])}, b = {apart[i][1], 0, strlen(apart[i][1])};
+        assert(nf_cache_key(parse(&a)).hash != nf_cache_key(parse(&b)).hash);
+    }
+
+    // A repeated closed subterm is normalized once, to the same result
+    cchar *pair = "pair (* 2 2) (* 2 2)";
+    char *plain = final_trace(pair, false, 0);
+    char path[] = "/tmp/lambda_cache_XXXXXX";
+    close(mkstemp(path));
+    nf_cache_enable(true);
+    assert(nf_cache_open(path));
+    const nf_cache_stats before = nf_cache_get_stats();
+    char *cached = final_trace(pair, false, 0);
+    const nf_cache_stats after = nf_cache_get_stats();
+    int plain_steps, steps;
+    assert(sscanf(plain, "Steps: %d", &plain_steps) == 1);
+    assert(sscanf(cached, "Steps: %d\n\nδ-abstracted", &steps) == 1); // counters only in --stats
+    assert(after.hits > before.hits && after.misses > before.misses && steps < plain_steps);
+    assert(!strcmp(strstr(cached, "δ-abstracted"), strstr(plain, "δ-abstracted")));
+    free(plain);
+    free(cached);
+    nf_cache_close();
+    assert(nf_cache_get_stats().entries == 0);
+
+    // Another run finds the normal forms in the file
+    assert(nf_cache_open(path));
+    assert(nf_cache_get_stats().entries >= 1);
+    const size_t hits = nf_cache_get_stats().hits;
+    cached = final_trace("* 2 2", false, 0);
+    assert(sscanf(cached, "Steps: %d", &steps) == 1);
+    assert(steps == 1 && nf_cache_get_stats().hits == hits + 1);
+    free(cached);
+    nf_cache_close();
+
+    // A key with the hash of another but different bytes does not hit
+    Parser q = {src[0], 0, strlen(src[0])};
+    nf_cache_put(&key[0], parse(&q));
+    expr *nf = nf_cache_get(&key[0]);
+    assert(nf && nf->type == ABS_expr);
+    key[2].hash = key[0].hash;
+    assert(!nf_cache_get(&key[2]));
+
+    // A miss on a hash no entry has does not encode the key
+    cchar *other = "λx.λy.λz.z";
+    Parser r = {other, 0, strlen(other)};
+    nf_key fresh = nf_cache_key(parse(&r));
+    assert(!nf_cache_get(&fresh) && !fresh.data);
+    nf_key_free(&fresh);
+
+    // The cache counts against the memory limit
+    const size_t held = nf_cache_get_stats().bytes;
+    assert(held >= 1024);
+    const limits tight = {0, 0, arena_reserved_total() + held / 2};
+    governor_start(&tight);
+    assert(governor_exceeded(0) && governor_reason() == STOP_MEMORY);
+    nf_cache_close();
+    assert(nf_cache_get_stats().bytes == 0);
+    governor_start(&tight);
+    assert(!governor_exceeded(0));
+    governor_start(&(limits){0, 0, 0});
+    nf_cache_enable(false);
+    for (int i = 0; i < 3; i++) nf_key_free(&key[i]);
+
+    // A file of another format or version is refused
+    cchar *bad[] = {"LCNFC\0\0\2", "LCNF\1\0\0\0", "LCTB\1\0\0\0"};
+    for (int i = 0; i < 3; i++) {
+        FILE *f = fopen(path, "wb");
+        assert(f && fwrite(bad[i], 1, 8, f) == 8);
+        fclose(f);
+        assert(!nf_cache_open(path));
+    }
+
+    unlink(path);
+    expr_heap_destroy();
+}
+
+static char emitted[64];
+static char emit_file[] = "/tmp/lambda_image_XXXXXX";
+
+static void emit_to_file(cexpr *e) {
+    expr_to_buffer(e, emitted, sizeof emitted);
+    assert(bin_save(e, emit_file));
+}
+
+TEST(binary_terms) {
+    setup_delta_defs();
+
+    // Images print like the terms they were made from, and keep binders
+    // apart exactly where the original did
+    cchar *src[] = {"λx.λy.x y", "(λx.x x) (λx.x x)", "λx.λx.x", "λx.(λx.x) x", "pair (* 2 2) c"};
+    for (size_t i = 0; i < sizeof src / sizeof *src; i++) {
+        Parser p = {src[i], 0, strlen(src[i])};
+        expr *e = parse(&p);
+        strbuf b;
+        sb_init(&b, 64);
+        assert(bin_encode(e, &b));
+        expr *back = bin_decode((const byte *) b.data, b.len);
+        assert(back);
+        char want[64], got[64];
+        expr_to_buffer(e, want, sizeof want);
+        expr_to_buffer(back, got, sizeof got);
+        assert(!strcmp(got, want));
+        nf_key kb = nf_cache_key(back), ke = nf_cache_key(e);
+        nf_key_encode(&kb);
+        nf_key_encode(&ke);
+        assert(kb.hash == ke.hash && kb.len == ke.len && !memcmp(kb.data, ke.data, kb.len));
+        nf_key_free(&kb);
+        nf_key_free(&ke);
+
+        // A cut or stale image is refused
+        assert(!bin_decode((const byte *) b.data, b.len - 8));
+        b.data[4]++;
+        assert(!bin_decode((const byte *) b.data, b.len));
+        sb_destroy(&b);
+    }
+    expr *num = make_application(make_variable("f"), make_num(7));
+    strbuf b;
+    sb_init(&b, 64);
+    assert(bin_encode(num, &b));
+    expr *back = bin_decode((const byte *) b.data, b.len);
+    assert(back->app_arg->type == NUM_expr && back->app_arg->num == 7);
+    sb_destroy(&b);
+
+    // Deep terms go through without recursion
+    expr *deep = make_variable("x");
+    for (int i = 0; i < 100000; i++) deep = make_application(make_variable("g"), deep);
+    assert(bin_save(deep, "/dev/null"));
+
+    // The final term of a reduction, saved as it is reached and mapped
+    // back in
+    close(mkstemp(emit_file));
+    trace_result(emit_to_file);
+    trace_config(TRACE_QUIET, 1);
+    Parser p = {"* 2 3", 0, 5};
+    normalize(parse(&p));
+    trace_config(TRACE_FULL, 1);
+    trace_result(NULL);
+    expr *nf = bin_load(emit_file);
+    assert(nf);
+    char got[64];
+    expr_to_buffer(nf, got, sizeof got);
+    assert(!strcmp(got, emitted));
+    unlink(emit_file);
+    assert(!bin_load(emit_file));
+
+    expr_heap_destroy();
+}
+
+TEST(fast_parsing) {
+    // Names, whitespace runs and λ found across 16-byte blocks
+    cchar *src[][2] = {
+        {"a_name_longer_than_sixteen_bytes\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\ty",
+         "a_name_longer_than_sixteen_bytes y"},
+        {"long_function_name_for_blocksλx.x", "long_function_name_for_blocks (λx.x)"},
+        {"name_with_a_stray_\xce_byte_in_it    \n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n  (z)",
+         "name_with_a_stray_\xce_byte_in_it z"},
+        {"λx.x (λx.x x) x y", "λx.x (λx.x x) x y"},
+    };
+    for (size_t i = 0; i < sizeof src / sizeof *src; i++) {
+        Parser p = {src[i][0], 0, strlen(src[i][0])};
+        char buf[128];
+        expr_to_buffer(parse(&p), buf, sizeof buf);
+        assert(!strcmp(buf, src[i][1]));
+    }
+
+    // Occurrences of a variable share its node, and shadowing binders
+    // still get symbols of their own
+    Parser p = {"λx.x (λx.x x) x", 0, strlen("λx.x (λx.x x) x")};
+    expr *e = parse(&p);
+    cexpr *outer = e->abs_body->app_fn, *inner = e->abs_body->app_fn->app_arg->abs_body;
+    assert(outer->app_fn == e->abs_body->app_arg);
+    assert(inner->app_fn == inner->app_arg && inner->app_fn->var_sym != outer->app_fn->var_sym);
+
+    // Files are mapped and parsed in place
+    char path[] = "/tmp/lambda_input_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    cchar *text = "λf.λx.\n    f (f x)\n";
+    assert(write(fd, text, strlen(text)) == (ssize_t) strlen(text));
+    close(fd);
+    char buf[64];
+    expr_to_buffer(parse_file(path), buf, sizeof buf);
+    assert(!strcmp(buf, "λf.(λx.f (f x))"));
+    unlink(path);
+    assert(!parse_file(path));
+
+    expr_heap_destroy();
+}
+
+TEST(runtime_stats) {
+    setup_delta_defs();
+    governor_start(&(limits){0, 0, 0});
+
+    // Steps split into β and δ; binders are renamed only where numerals,
+    // which all expand with the same names, would capture
+    int steps, lines;
+    stats_reset();
+    trace_lines("+ 2 3", TRACE_QUIET, 1, &steps, &lines);
+    run_stats st = stats_get();
+    assert(st.beta == 10 && st.delta == 3 && st.substitutions == 10 && !st.renamings);
+    assert(st.nodes_allocated > 0 && st.bytes_allocated >= st.nodes_allocated);
+    stats_reset();
+    trace_lines("2 2", TRACE_QUIET, 1, &steps, &lines);
+    st = stats_get();
+    assert(st.beta == 6 && !st.delta && st.renamings == 3);
+    stats_reset();
+    trace_lines("(λx.λy.x) y", TRACE_QUIET, 1, &steps, &lines);
+    st = stats_get();
+    assert(st.beta == 1 && st.substitutions == 1);
+    assert(st.max_size == 5 && st.max_depth == 4); // the initial term
+
+    // The largest term is seen wherever the run meets it, and a
+    // substitution that leaves the term alone still counts
+    stats_reset();
+    trace_lines("(λx.(λy.z) (x x x x x x)) (λw.λv.w)", TRACE_QUIET, 1, &steps, &lines);
+    st = stats_get();
+    assert(st.beta == 2 && st.substitutions == 2);
+    assert(st.max_size == 26 && st.max_depth == 9); // after the first step; the depth is the initial term's
+
+    // A numeral counts as the term it stands for; copies count their bytes
+    stats_reset();
+    stats_measure(make_num(3)); // λf.λx.f (f (f x))
+    expr *copy = copy_expr(make_application(make_variable("a"), make_variable("b")));
+    st = stats_get();
+    assert(st.max_size == 9 && st.max_depth == 6 && copy && st.copied_bytes > 0);
+
+    // Nested phases pause the outer one
+    stats_reset();
+    stats_begin(PHASE_REDUCE);
+    stats_begin(PHASE_PRINT);
+    stats_end();
+    stats_end();
+    st = stats_get();
+    assert(st.seconds[PHASE_REDUCE] >= 0 && st.seconds[PHASE_PRINT] > 0 && st.seconds[PHASE_PARSE] == 0);
+
+    sink out;
+    sink_init_mem(&out);
+    st.beta = 7;
+    stats_write_json(&out, &st);
+    sink_putc(&out, '\0');
+    assert(strstr(out.buf.data, "\"beta\": 7,") && strstr(out.buf.data, "\"seconds\": {\"parse\": 0.000000,"));
+    sink_destroy(&out);
+
+    cleanup_delta_defs();
+}
+
+/**
+ * @brief              Reduce with a strategy until it stops, at most
+ *                     limit steps, and print the result.
+ * @return             the number of steps taken
+ */
+static size_t run_strategy(const strategy st, cchar *input, const size_t limit, char *buf, const size_t cap) {
+    Parser p = {input, 0, strlen(input)};
+    expr *e = parse(&p), *next;
+    cchar *rtype;
+    size_t n = 0;
+    while (n < limit && reduce_once_with(st, e, &next, &rtype)) {
+        e = next;
+        n++;
+    }
+    expr_to_buffer(e, buf, cap);
+
+    return n;
+}
+
+TEST(strategies) {
+    setup_delta_defs();
+    char buf[256];
+
+    // Only the lazy strategies discard the divergent argument unreduced
+    cchar *discard = "(λx.λy.y) ((λx.x x) (λx.x x)) z";
+    assert(run_strategy(STRATEGY_NORMAL, discard, 50, buf, sizeof buf) == 2 && !strcmp(buf, "z"));
+    assert(run_strategy(STRATEGY_CBN, discard, 50, buf, sizeof buf) == 2 && !strcmp(buf, "z"));
+    assert(run_strategy(STRATEGY_WHNF, discard, 50, buf, sizeof buf) == 2 && !strcmp(buf, "z"));
+    assert(run_strategy(STRATEGY_APPLICATIVE, discard, 50, buf, sizeof buf) == 50);
+    assert(run_strategy(STRATEGY_CBV, discard, 50, buf, sizeof buf) == 50);
+
+    // Innermost first
+    assert(run_strategy(STRATEGY_APPLICATIVE, "(λx.λy.x) ((λa.a) b)", 1, buf, sizeof buf) == 1);
+    assert(!strcmp(buf, "(λx.(λy.x)) b"));
+    assert(run_strategy(STRATEGY_NORMAL, "(λx.λy.x) ((λa.a) b)", 1, buf, sizeof buf) == 1);
+    assert(!strcmp(buf, "λy.(λa.a) b"));
+
+    // The weak strategies stop at an abstraction, the head ones at a
+    // variable head
+    cchar *under = "(λx.x) (λy.(λz.z) y)";
+    assert(run_strategy(STRATEGY_CBV, under, 50, buf, sizeof buf) == 1 && !strcmp(buf, "λy.(λz.z) y"));
+    assert(run_strategy(STRATEGY_CBN, under, 50, buf, sizeof buf) == 1 && !strcmp(buf, "λy.(λz.z) y"));
+    assert(run_strategy(STRATEGY_WHNF, under, 50, buf, sizeof buf) == 1);
+    assert(run_strategy(STRATEGY_HNF, under, 50, buf, sizeof buf) == 2 && !strcmp(buf, "λy.y"));
+    assert(run_strategy(STRATEGY_WHNF, "x ((λy.y) z)", 50, buf, sizeof buf) == 0);
+    assert(run_strategy(STRATEGY_HNF, "λa.x ((λy.y) z)", 50, buf, sizeof buf) == 0);
+    assert(run_strategy(STRATEGY_CBN, "x ((λy.y) z)", 50, buf, sizeof buf) == 1 && !strcmp(buf, "x z"));
+    assert(run_strategy(STRATEGY_CBV, "x ((λy.y) z)", 50, buf, sizeof buf) == 1 && !strcmp(buf, "x z"));
+
+    // The trace ends with the form the strategy reached
+    cchar *reached[N_STRATEGIES] = {"→ normal form", "→ normal form", "→ weak normal form",
+                                    "→ weak normal form", "→ weak head normal form", "→ head normal form"};
+    for (int i = 0; i < N_STRATEGIES; i++) {
+        Parser p = {under, 0, strlen(under)};
+        sink out;
+        sink_init_mem(&out);
+        trace_output(&out);
+        assert(normalize_strategy((strategy) i, parse(&p)) == STOP_NONE);
+        trace_output(NULL);
+        sink_putc(&out, '\0');
+        char want[64];
+        snprintf(want, sizeof want, "%s reached.", reached[i]);
+        assert(strstr(out.buf.data, want));
+        sink_destroy(&out);
+    }
+
+    // The strong strategies agree on normal forms
+    char nf[256];
+    run_strategy(STRATEGY_NORMAL, "* 3 (+ 1 1)", 1000, nf, sizeof nf);
+    run_strategy(STRATEGY_APPLICATIVE, "* 3 (+ 1 1)", 1000, buf, sizeof buf);
+    assert(!strcmp(buf, nf));
+
+    for (int i = 0; i < N_STRATEGIES; i++) {
+        strategy st;
+        assert(strategy_parse(strategy_name((strategy) i), &st) && st == (strategy) i);
+    }
+    assert(!strategy_parse("lazy", &(strategy){0}));
+
+    cleanup_delta_defs();
+}
+
+/**
+ * @brief              Check that normalize prints the steps one call of
+ *                     reduce_once after another does, searching from the
+ *                     root each time.
+ */
+static bool same_steps(cchar *input) {
+    Parser p = {input, 0, strlen(input)};
+    expr *e = parse(&p), *next;
+    sink want, got;
+    sink_init_mem(&want);
+    sink_init_mem(&got);
+
+    cchar *rtype;
+    sink_puts(&want, "Step 0: ");
+    expr_write(&want, e);
+    for (int step = 1; reduce_once(e, &next, &rtype); step++) {
+        e = next;
+        sink_printf(&want, "\nStep %d (%s): ", step, rtype);
+        expr_write(&want, e);
+    }
+    sink_puts(&want, "\n\n");
+
+    Parser q = {input, 0, strlen(input)};
+    trace_output(&got);
+    normalize(parse(&q));
+    trace_output(NULL);
+    sink_putc(&want, '\0');
+    sink_putc(&got, '\0');
+    const bool same = !strncmp(got.buf.data, want.buf.data, strlen(want.buf.data));
+    sink_destroy(&want);
+    sink_destroy(&got);
+
+    return same;
+}
+
+TEST(resumed_search) {
+    setup_delta_defs();
+    // A contractum that makes its parent a redex, one deep in a numeral,
+    // and a search that has to go back up to the next argument
+    assert(same_steps("(λa.λb.b) c d e"));
+    assert(same_steps("λg.g (+ 3 4)"));
+    assert(same_steps("(λx.x ((λy.y) z)) ((λu.u) w)"));
+    assert(same_steps("* 3 (+ 1 1)"));
+    assert(same_steps("(λn.n (λp.pair (p false) (+ (p true) (p false))) (pair 0 1) true) 5"));
+
+    native_arith(true);
+    assert(same_steps("+ ((λx.x) 2) (inc ((λf.λx.f (f x)) (λy.y) 3))"));
+    assert(same_steps("(λa.λb.+ a b) 2 ((λx.x) 3)"));
+    native_arith(false);
+
+    cleanup_delta_defs();
+}
+
+TEST(batch_mode) {
+    setup_delta_defs();
+    expr_heap_seal(); // the workers share the definitions
+
+    cchar *lines[] = {"* 3 4", "(λx.λy.x) y", "- 9 4", "and true false", "pair 1 2", "+ 2 3"};
+    const size_t n = sizeof lines / sizeof *lines;
+    char path[] = "/tmp/lambda_batch_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    for (size_t i = 0; i < n; i++) fprintf(f, "%s\n%s", lines[i], i == 2 ? "\n" : "");
+    fclose(f);
+
+    // Same as the lines run one at a time, in input order
+    sink want;
+    sink_init_mem(&want);
+    trace_output(&want);
+    for (size_t i = 0; i < n; i++) {
+        sink_printf(&want, "λ-expr> %s\n", lines[i]);
+        Parser p = {lines[i], 0, strlen(lines[i])};
+        normalize(parse(&p));
+        sink_putc(&want, '\n');
+    }
+    trace_output(NULL);
+
+    const limits none = {0, 0, 0};
+    int status;
+    char *got = batch_output(path, &none, &status);
+    assert(status == 0);
+    assert(!strcmp(got, want.buf.data));
+    free(got);
+    sink_destroy(&want);
+
+    // Every line gets its own step budget
+    const limits few = {5, 0, 0};
+    got = batch_output(path, &few, &status);
+    assert(status == STOP_STEPS);
+    size_t stopped = 0;
+    for (cchar *s = got; (s = strstr(s, "step limit reached")); s++) stopped++;
+    assert(stopped == 4); // all but the two short ones
+    free(got);
+
+    // A line that does not parse fails alone
+    f = fopen(path, "w");
+    fprintf(f, "+ 2 3\n(λx.x\n* 2 2\n");
+    fclose(f);
+    got = batch_output(path, &none, &status);
+    assert(status == 1);
+    assert(strstr(got, "λ-expr> (λx.x\nMalformed expression\n"));
+    assert(strstr(got, "λ-expr> * 2 2\n"));
+    free(got);
+
+    unlink(path);
+    expr_heap_destroy();
+}
+
 int main(void) {
     printf("\n==== Lambda Calculus Test Suite ====\n\n");
 
@@ -448,6 +1630,30 @@ int main(void) {
     RUN_TEST(fresh_variable);     /* TODO: verify test is complete */
     RUN_TEST(abstract_numerals);  /* TODO: verify test is complete */
     RUN_TEST(church_booleans);    /* TODO: verify test is complete */
+    RUN_TEST(arena_collect);
+    RUN_TEST(symbols);
+    RUN_TEST(debruijn_terms);
+    RUN_TEST(hashcons);
+    RUN_TEST(graph_reduction);
+    RUN_TEST(machine_reduction);
+    RUN_TEST(nbe_normal_form);
+    RUN_TEST(path_copying);
+    RUN_TEST(free_var_sets);
+    RUN_TEST(barendregt_renaming);
+    RUN_TEST(native_arithmetic);
+    RUN_TEST(numeral_nodes);
+    RUN_TEST(sink_output);
+    RUN_TEST(trace_modes);
+    RUN_TEST(resource_limits);
+    RUN_TEST(deep_terms);
+    RUN_TEST(parallel_rounds);
+    RUN_TEST(nf_cache);
+    RUN_TEST(binary_terms);
+    RUN_TEST(fast_parsing);
+    RUN_TEST(runtime_stats);
+    RUN_TEST(strategies);
+    RUN_TEST(resumed_search);
+    RUN_TEST(batch_mode);
 
     printf("\n==== All tests passed successfully. ====\n\n");
     return 0;
@@ -1,6 +1,7 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include "../include/term.h"
 #include "../include/types.h"
 
 #include <stdbool.h>
@@ -20,11 +21,12 @@ void vs_rm(VarSet *s, const char *x);
 void vs_free(const VarSet *s);
 
 VarSet free_vars(const expr *e);
-char *fresh_var(const VarSet *s);
 
 expr *substitute(expr *e, const char *v, expr *val);
 bool beta_reduce(const expr *e, expr **out);
 bool delta_reduce(const expr *e, expr **out);
+bool native_reduce(const expr *e, expr **out);
 bool reduce_once(const expr *e, expr **ne, const char **rtype);
+bool term_reduce_once(term *t, term **out, const char **rtype);
 
 #endif //TEST_H